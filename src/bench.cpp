@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "bvh.h"
+#include "camera_path.h"
+#include "model.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "occlusion_raster.h"
+#include "ray_query.h"
+#include "scene_graph.h"
+#include "simplify.h"
+#include "util.h"
+
+// CPU only, no window or GL context, times the import time mesh processing of model::load_model()
+// usage: bench [model path], defaults to the glTF Sponza
+
+struct bench_mesh {
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+    bool alpha_tested; // like mesh::alpha_tested(), its material has an opacity map
+};
+
+// what scene_graph reads of a model for bounds and ray queries, without GL buffers
+struct bench_model {
+    struct ray_mesh {
+        glm::vec3 bounds_min{FLT_MAX};
+        glm::vec3 bounds_max{-FLT_MAX};
+        triangle_bvh ray_tree;
+    };
+
+    std::vector<ray_mesh> meshes;
+    std::vector<model_node> nodes;
+};
+
+// the node hierarchy like model::process_node(), meshes index the scene's meshes which import_meshes() keeps in order
+void import_nodes(aiNode const * node, int parent, std::vector<model_node>& nodes) {
+    aiMatrix4x4 const& t = node->mTransformation; // row major
+    glm::mat4 local{t.a1, t.b1, t.c1, t.d1, t.a2, t.b2, t.c2, t.d2, t.a3, t.b3, t.c3, t.d3, t.a4, t.b4, t.c4, t.d4};
+    nodes.push_back({node->mName.C_Str(), parent, local, {}});
+    int index = static_cast<int>(nodes.size() - 1);
+    for (size_t i = 0; i < node->mNumMeshes; ++i) nodes[index].meshes.push_back(node->mMeshes[i]);
+    for (size_t i = 0; i < node->mNumChildren; ++i) import_nodes(node->mChildren[i], index, nodes);
+}
+
+// the same import flags and triangle filtering as model::load_model(), without materials
+std::vector<bench_mesh> import_meshes(std::string const& path, std::vector<model_node>& nodes) {
+    Assimp::Importer import;
+    aiScene const * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals |
+    aiProcess_JoinIdenticalVertices | aiProcess_RemoveRedundantMaterials | aiProcess_FindInvalidData | aiProcess_OptimizeGraph);
+
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cerr << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<bench_mesh> res;
+    for (size_t m = 0; m < scene->mNumMeshes; ++m) {
+        aiMesh const * ai_mesh = scene->mMeshes[m];
+        bench_mesh mesh;
+        mesh.alpha_tested = scene->mMaterials[ai_mesh->mMaterialIndex]->GetTextureCount(aiTextureType_OPACITY) > 0;
+        for (size_t i = 0; i < ai_mesh->mNumVertices; ++i) {
+            mesh.vertices.push_back({
+                glm::vec3(ai_mesh->mVertices[i].x, ai_mesh->mVertices[i].y, ai_mesh->mVertices[i].z),
+                glm::vec3(ai_mesh->mNormals[i].x, ai_mesh->mNormals[i].y, ai_mesh->mNormals[i].z),
+                ai_mesh->mTextureCoords[0]
+                    ? glm::vec2(ai_mesh->mTextureCoords[0][i].x, ai_mesh->mTextureCoords[0][i].y)
+                    : glm::vec2(0.0f, 0.0f),
+                glm::vec3(0.0f), glm::vec3(0.0f)
+            });
+        }
+        for (size_t i = 0; i < ai_mesh->mNumFaces; ++i) {
+            if (ai_mesh->mFaces[i].mNumIndices != 3) continue;
+            for (size_t j = 0; j < 3; ++j) mesh.indices.push_back(ai_mesh->mFaces[i].mIndices[j]);
+        }
+        res.push_back(std::move(mesh));
+    }
+    import_nodes(scene->mRootNode, -1, nodes);
+    return res;
+}
+
+template<typename Func>
+double time_ms(Func const& func) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// build, refit and query times of bvh for count random boxes in a 2000 unit cube, like scattered scene objects
+void bench_bvh(size_t count) {
+    std::mt19937 rng{1};
+    std::uniform_real_distribution<float> position{-1000.0f, 1000.0f};
+    std::uniform_real_distribution<float> size{0.5f, 10.0f};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+
+    std::vector<aabb> boxes(count);
+    for (auto& box : boxes) {
+        glm::vec3 centre{position(rng), position(rng), position(rng)};
+        glm::vec3 extent{size(rng), size(rng), size(rng)};
+        box = {centre - extent, centre + extent};
+    }
+
+    bvh tree;
+    double build_ms = time_ms([&]() { tree.build(boxes); });
+    float built_cost = tree.sah_cost();
+
+    // a tenth of the objects moves a little, like a frame of animation
+    std::vector<uint32_t> moved;
+    for (uint32_t i = 0; i < count; i += 10) {
+        glm::vec3 offset = glm::vec3(unit(rng), unit(rng), unit(rng)) * 5.0f;
+        boxes[i] = {boxes[i].lo + offset, boxes[i].hi + offset};
+        moved.push_back(i);
+    }
+    double partial_refit_ms = time_ms([&]() { tree.refit(boxes, moved); });
+    double refit_ms = time_ms([&]() { tree.refit(boxes); });
+
+    static constexpr size_t view_count = 100;
+    glm::mat4 const projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    size_t visible{0};
+    double frustum_ms = time_ms([&]() {
+        for (size_t v = 0; v < view_count; ++v) {
+            glm::vec3 eye{position(rng), position(rng), position(rng)};
+            cull_view view = cull_view::perspective(projection * glm::lookAt(eye, eye + glm::vec3(unit(rng), unit(rng), unit(rng)), glm::vec3(0.0f, 1.0f, 0.0f)), eye);
+            tree.traverse([&view](aabb const& box) { return !box.outside(view.planes); }, [&visible](uint32_t) { ++visible; });
+        }
+    });
+
+    static constexpr size_t ray_count = 100000;
+    size_t hits{0};
+    double ray_ms = time_ms([&]() {
+        for (size_t r = 0; r < ray_count; ++r) {
+            glm::vec3 origin{position(rng), position(rng), position(rng)};
+            glm::vec3 dir = glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(1e-4f);
+            glm::vec3 inv_dir = 1.0f / dir;
+            float t_max{FLT_MAX};
+            hits += tree.raycast(origin, dir, t_max, [&](uint32_t i, float t) { return boxes[i].ray_entry(origin, inv_dir, t); }) >= 0;
+        }
+    });
+
+    std::cout << "bvh over " << count << " boxes: build " << build_ms << " ms, SAH cost " << built_cost << ", refit " << partial_refit_ms << " ms for "
+              << moved.size() << " moved, " << refit_ms << " ms for all, SAH cost after " << tree.sah_cost() << ", frustum query "
+              << frustum_ms / view_count << " ms with " << visible / view_count << " visible, " << ray_count / ray_ms * 1e-3 << " M nearest box rays/s, "
+              << hits << " hits" << std::endl;
+}
+
+// CPU ray queries against the model moved by transform, through a scene_graph over per mesh trees like main.cpp
+// picks and, for comparison, through one tree over all triangles in world space, primary rays along the camera
+// path in 8 x 4 pixel packets, then short ambient occlusion rays from their hits like an offline bake would cast
+void bench_rays(std::vector<bench_mesh> const& meshes, std::vector<model_node> const& nodes, glm::mat4 const& transform) {
+    bench_model source{std::vector<bench_model::ray_mesh>(meshes.size()), nodes};
+    double mesh_build_ms = time_ms([&meshes, &source]() {
+        parallel_for(meshes.size(), [&meshes, &source](size_t i) {
+            bench_model::ray_mesh& m = source.meshes[i];
+            m.ray_tree.build(meshes[i].vertices, meshes[i].indices);
+            for (auto const& v : meshes[i].vertices) {
+                m.bounds_min = glm::min(m.bounds_min, v.pos);
+                m.bounds_max = glm::max(m.bounds_max, v.pos);
+            }
+        });
+    });
+    size_t mesh_tree_bytes{0};
+    for (auto const& m : source.meshes) mesh_tree_bytes += m.ray_tree.bytes();
+
+    basic_scene_graph<bench_model> scene;
+    scene.add_model(source, transform);
+    double scene_ms = time_ms([&scene]() { scene.update(); });
+
+    // every object baked into world space for one tree over all triangles, which main.cpp doesn't do
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+    for (auto const& o : scene.objects) {
+        GLuint base = static_cast<GLuint>(vertices.size());
+        for (vertex v : meshes[o.mesh].vertices) {
+            v.pos = glm::vec3(scene.nodes[o.node].world * glm::vec4(v.pos, 1.0f));
+            vertices.push_back(v);
+        }
+        for (GLuint i : meshes[o.mesh].indices) indices.push_back(base + i);
+    }
+    triangle_bvh tree;
+    double build_ms = time_ms([&]() { tree.build(vertices, indices); });
+    std::cout << "triangle_bvh: " << mesh_build_ms << " ms for " << meshes.size() << " meshes in parallel, " << mesh_tree_bytes / 1024 << " KB, scene_graph "
+              << scene_ms << " ms for " << scene.objects.size() << " objects, merged " << build_ms << " ms for all " << indices.size() / 3 << " triangles, "
+              << tree.nodes.size() << " nodes, " << tree.bytes() / 1024 << " KB" << std::endl;
+
+    static constexpr int width = 320;
+    static constexpr int height = 180;
+    static constexpr size_t frames = 16;
+    static constexpr size_t tile_rays = 32; // primary rays come in 8x4 tiles
+    float const tan_half_fov = std::tan(glm::radians(45.0f) * 0.5f);
+    camera_path const flight;
+    std::vector<ray> primary;
+    for (size_t frame = 0; frame < frames; ++frame) {
+        auto [pos, front] = flight.at(static_cast<float>(frame) / (frames - 1));
+        glm::vec3 right = glm::normalize(glm::cross(front, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up = glm::cross(right, front);
+        for (int tile_y = 0; tile_y < height; tile_y += 4) {
+            for (int tile_x = 0; tile_x < width; tile_x += 8) {
+                for (int y = tile_y; y < tile_y + 4; ++y) {
+                    for (int x = tile_x; x < tile_x + 8; ++x) {
+                        float sx = ((x + 0.5f) / width * 2.0f - 1.0f) * tan_half_fov * width / height;
+                        float sy = ((y + 0.5f) / height * 2.0f - 1.0f) * tan_half_fov;
+                        primary.push_back({pos, front + sx * right + sy * up});
+                    }
+                }
+            }
+        }
+    }
+    size_t const tiles = primary.size() / tile_rays;
+
+    // what picking in main.cpp does, the object bvh finds the candidates and each one's ray tree is queried in
+    // object space, on one thread and then a tile per item on all threads
+    std::vector<float> scene_t(primary.size());
+    auto scene_pick = [&scene, &primary, &scene_t](size_t i) {
+        float t = primary[i].t_max;
+        scene.pick(primary[i].origin, primary[i].dir, t);
+        scene_t[i] = t;
+    };
+    double scene_single_ms = time_ms([&]() {
+        for (size_t i = 0; i < primary.size(); ++i) scene_pick(i);
+    });
+    double scene_batch_ms = time_ms([&]() {
+        parallel_for(tiles, [&scene_pick](size_t tile) {
+            for (size_t i = tile * tile_rays; i < (tile + 1) * tile_rays; ++i) scene_pick(i);
+        });
+    });
+
+    // the merged tree alone, one thread without the thread pool, then batches of single rays and of packets on all threads
+    std::vector<ray_hit> hits(primary.size());
+    double single_ms = time_ms([&]() {
+        for (size_t i = 0; i < primary.size(); ++i) hits[i] = tree.intersect(primary[i]);
+    });
+    double batch_ms = time_ms([&]() { hits = tree.intersect(primary, false); });
+    double packet_ms = time_ms([&]() { hits = tree.intersect(primary, true); });
+
+    // both setups have to see the same surfaces, up to rounding at triangle edges
+    size_t disagree{0};
+    for (size_t i = 0; i < primary.size(); ++i) disagree += std::abs(scene_t[i] - hits[i].t) > 1e-3f * std::min(scene_t[i], hits[i].t);
+
+    std::mt19937 rng{1};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+    static constexpr size_t ao_per_hit = 4;
+    static constexpr float ao_radius = 20.0f;
+    std::vector<ray> ao;
+    for (size_t i = 0; i < primary.size(); ++i) {
+        if (!hits[i].hit()) continue;
+        uint32_t t = hits[i].triangle;
+        glm::vec3 p0 = vertices[indices[3 * t]].pos;
+        glm::vec3 normal = glm::cross(vertices[indices[3 * t + 1]].pos - p0, vertices[indices[3 * t + 2]].pos - p0);
+        if (glm::dot(normal, primary[i].dir) > 0.0f) normal = -normal;
+        normal = glm::normalize(normal);
+        glm::vec3 point = primary[i].origin + hits[i].t * primary[i].dir + 0.01f * normal;
+        for (size_t k = 0; k < ao_per_hit; ++k) {
+            glm::vec3 dir;
+            do {
+                dir = {unit(rng), unit(rng), unit(rng)};
+            } while (glm::dot(dir, dir) > 1.0f || glm::dot(dir, dir) < 1e-4f);
+            if (glm::dot(dir, normal) < 0.0f) dir = -dir;
+            ao.push_back({point, glm::normalize(dir), ao_radius});
+        }
+    }
+    std::vector<uint8_t> scene_occluded(ao.size());
+    double scene_ao_ms = time_ms([&]() {
+        parallel_for((ao.size() + tile_rays - 1) / tile_rays, [&scene, &ao, &scene_occluded](size_t chunk) {
+            for (size_t i = chunk * tile_rays; i < std::min((chunk + 1) * tile_rays, ao.size()); ++i) {
+                scene_occluded[i] = scene.occluded(ao[i].origin, ao[i].origin + ao[i].t_max * ao[i].dir);
+            }
+        });
+    });
+    std::vector<uint8_t> occluded;
+    double ao_ms = time_ms([&]() { occluded = tree.occluded(ao); });
+
+    size_t hit_count{0}, occluded_count{0};
+    for (auto const& hit : hits) hit_count += hit.hit();
+    for (size_t i = 0; i < ao.size(); ++i) {
+        occluded_count += occluded[i];
+        disagree += occluded[i] != scene_occluded[i];
+    }
+    std::cout << "rays, " << primary.size() << " primary with " << 100.0 * hit_count / primary.size() << "% hits, " << ao.size() << " ambient occlusion with "
+              << 100.0 * occluded_count / std::max<size_t>(ao.size(), 1) << "% occluded" << std::endl;
+    std::cout << "rays through scene_graph: " << primary.size() / scene_single_ms * 1e-3 << " M rays/s on one thread, " << primary.size() / scene_batch_ms * 1e-3
+              << " M rays/s on all threads, ambient occlusion " << ao.size() / scene_ao_ms * 1e-3 << " M rays/s on all threads, " << disagree
+              << " results differ from the merged tree" << std::endl;
+    std::cout << "rays through the merged triangle_bvh: " << primary.size() / single_ms * 1e-3 << " M rays/s on one thread, " << primary.size() / batch_ms * 1e-3
+              << " M rays/s batched, " << primary.size() / packet_ms * 1e-3 << " M rays/s batched in packets, ambient occlusion " << ao.size() / ao_ms * 1e-3
+              << " M rays/s batched" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    std::string path = argc > 1 ? argv[1] : "res/sponza_gltf/sponza.gltf";
+    std::vector<model_node> nodes;
+    std::vector<bench_mesh> meshes = import_meshes(path, nodes);
+
+    size_t triangle_count{0};
+    for (auto& mesh : meshes) triangle_count += mesh.indices.size() / 3;
+    std::cout << path << ": " << meshes.size() << " meshes, " << triangle_count << " triangles" << std::endl;
+
+    double opt_ms = time_ms([&meshes]() {
+        for (auto& mesh : meshes) optimize_mesh(mesh.vertices, mesh.indices);
+    });
+    std::cout << "optimize_mesh: " << opt_ms << " ms, " << triangle_count / opt_ms * 1e-3 << " M triangles/s" << std::endl;
+
+    // the first level alone is the plain simplifier throughput, the chain is what an import pays
+    double half_ms = time_ms([&meshes]() {
+        for (auto& mesh : meshes) {
+            std::vector<GLuint> indices = mesh.indices;
+            simplify(indices, mesh.vertices, indices.size() / 6 * 3);
+        }
+    });
+    std::cout << "simplify to 50%: " << half_ms << " ms, " << triangle_count / half_ms * 1e-3 << " M triangles/s" << std::endl;
+
+    std::vector<std::vector<lod_level>> chains(meshes.size());
+    double chain_ms = time_ms([&meshes, &chains]() {
+        for (size_t i = 0; i < meshes.size(); ++i) chains[i] = build_lod_chain(meshes[i].vertices, meshes[i].indices);
+    });
+    std::cout << "build_lod_chain: " << chain_ms << " ms, " << triangle_count / chain_ms * 1e-3 << " M input triangles/s" << std::endl;
+
+    double parallel_ms = time_ms([&meshes, &chains]() {
+        parallel_for(meshes.size(), [&meshes, &chains](size_t i) {
+            chains[i] = build_lod_chain(meshes[i].vertices, meshes[i].indices);
+        });
+    });
+    std::cout << "build_lod_chain, parallel_for over meshes: " << parallel_ms << " ms, " << triangle_count / parallel_ms * 1e-3 << " M input triangles/s" << std::endl;
+
+    // the software occlusion culling main.cpp does with K, along the --occlusion-bench camera path
+    glm::mat4 const transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.75f, 0.0f));
+    glm::mat4 const projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<occluder<vertex>> occluders;
+    for (size_t i : pick_occluders(meshes, 16384, [](bench_mesh const& m) { return !m.alpha_tested; })) {
+        occluders.push_back({&meshes[i].vertices, &meshes[i].indices, transform});
+    }
+    std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+    for (auto const& mesh : meshes) {
+        glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+        for (auto const& v : mesh.vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        boxes.emplace_back(lo, hi);
+    }
+
+    camera_path const flight;
+    occlusion_rasterizer rasterizer;
+    static constexpr size_t path_frames = 240;
+    size_t occluder_triangles{0}, in_frustum_triangles{0}, occluded_triangles{0};
+    double raster_ms{0.0}, test_ms{0.0};
+    for (size_t frame = 0; frame < path_frames; ++frame) {
+        auto [pos, front] = flight.at(static_cast<float>(frame) / (path_frames - 1));
+        glm::mat4 view_projection = projection * glm::lookAt(pos, pos + front, glm::vec3(0.0f, 1.0f, 0.0f));
+        cull_view view = cull_view::perspective(view_projection, pos);
+        depth_pyramid pyramid;
+        raster_ms += time_ms([&]() {
+            occluder_triangles += rasterizer.render(occluders, view_projection);
+            pyramid = rasterizer.pyramid();
+        });
+        test_ms += time_ms([&]() {
+            for (size_t i = 0; i < meshes.size(); ++i) {
+                glm::vec3 centre = glm::vec3(transform * glm::vec4(0.5f * (boxes[i].first + boxes[i].second), 1.0f));
+                if (view.outside(centre, 0.5f * glm::length(boxes[i].second - boxes[i].first))) continue;
+                size_t count = meshes[i].indices.size() / 3;
+                in_frustum_triangles += count;
+                if (pyramid.occludes_box(boxes[i].first, boxes[i].second, view_projection * transform)) occluded_triangles += count;
+            }
+        });
+    }
+    std::cout << "software occlusion, " << occluders.size() << " occluders, " << occluder_triangles / path_frames << " triangles binned per frame: "
+              << raster_ms / path_frames << " ms rasterising, " << test_ms / path_frames << " ms testing " << meshes.size() << " boxes per frame, "
+              << 100.0 * occluded_triangles / std::max<size_t>(in_frustum_triangles, 1) << "% of the triangles inside the frustum culled" << std::endl;
+
+    for (size_t count : {10000, 100000, 1000000}) bench_bvh(count);
+    bench_rays(meshes, nodes, transform);
+
+    // meshes whose chain stopped early count with their coarsest level
+    std::vector<size_t> level_triangles;
+    for (size_t l = 0; l < 4; ++l) {
+        size_t count{0};
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            count += chains[i].empty() ? meshes[i].indices.size() / 3 : chains[i][std::min(l, chains[i].size() - 1)].indices.size() / 3;
+        }
+        level_triangles.push_back(count);
+    }
+    std::cout << "LOD triangles: " << triangle_count;
+    for (size_t count : level_triangles) std::cout << " " << count;
+    std::cout << std::endl;
+
+    return 0;
+}
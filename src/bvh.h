@@ -0,0 +1,312 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct aabb {
+    glm::vec3 lo{FLT_MAX};
+    glm::vec3 hi{-FLT_MAX};
+
+    bool empty() const {
+        return lo.x > hi.x || lo.y > hi.y || lo.z > hi.z;
+    }
+
+    glm::vec3 centre() const {
+        return 0.5f * (lo + hi);
+    }
+
+    // half the surface area, the constant factor cancels in SAH costs
+    float half_area() const {
+        if (empty()) return 0.0f;
+        glm::vec3 d = hi - lo;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    void grow(glm::vec3 p) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    void grow(aabb const& b) {
+        lo = glm::min(lo, b.lo);
+        hi = glm::max(hi, b.hi);
+    }
+
+    bool overlaps(aabb const& b) const {
+        return lo.x <= b.hi.x && b.lo.x <= hi.x && lo.y <= b.hi.y && b.lo.y <= hi.y && lo.z <= b.hi.z && b.lo.z <= hi.z;
+    }
+
+    bool operator==(aabb const& b) const {
+        return lo == b.lo && hi == b.hi;
+    }
+
+    // box of the transformed box, see Arvo's "Transforming Axis-Aligned Bounding Boxes"
+    aabb transformed(glm::mat4 const& m) const {
+        if (empty()) return *this;
+        glm::vec3 centre = glm::vec3(m * glm::vec4(this->centre(), 1.0f));
+        glm::vec3 extent = 0.5f * (hi - lo);
+        glm::vec3 new_extent{0.0f};
+        for (int col = 0; col < 3; ++col) new_extent += glm::abs(glm::vec3(m[col])) * extent[col];
+        return {centre - new_extent, centre + new_extent};
+    }
+
+    // whether the box lies entirely behind one of the inward facing planes
+    template<size_t N>
+    bool outside(std::array<glm::vec4, N> const& planes) const {
+        for (auto const& plane : planes) {
+            glm::vec3 farthest{plane.x >= 0.0f ? hi.x : lo.x, plane.y >= 0.0f ? hi.y : lo.y, plane.z >= 0.0f ? hi.z : lo.z};
+            if (glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f) return true;
+        }
+        return false;
+    }
+
+    // entry distance of the ray origin + t dir into the box within [0, t_max], FLT_MAX when it misses, inv_dir is
+    // 1 / dir and may hold infinities
+    float ray_entry(glm::vec3 origin, glm::vec3 inv_dir, float t_max) const {
+        glm::vec3 t0 = (lo - origin) * inv_dir;
+        glm::vec3 t1 = (hi - origin) * inv_dir;
+        glm::vec3 near = glm::min(t0, t1);
+        glm::vec3 far = glm::max(t0, t1);
+        float enter = std::max({near.x, near.y, near.z, 0.0f});
+        float exit = std::min({far.x, far.y, far.z, t_max});
+        return enter <= exit ? enter : FLT_MAX;
+    }
+};
+
+// bounding volume hierarchy over the boxes of items 0 .. n - 1, top down with binned surface area heuristic splits,
+// see Wald's "On fast Construction of SAH-based Bounding Volume Hierarchies", refit() follows moving items without
+// changing the topology, so rebuild once sah_cost() has grown too far past the cost right after build()
+struct bvh {
+    static constexpr size_t bin_count = 16;
+    static constexpr uint32_t max_leaf_items = 4;
+    static constexpr float traversal_cost = 1.0f; // relative to testing one item
+
+    // leaves have count items at items[first], interior nodes have count 0 and their children at first and first + 1
+    struct node {
+        aabb bounds;
+        uint32_t first;
+        uint32_t count;
+
+        bool leaf() const {
+            return count > 0;
+        }
+    };
+
+    std::vector<node> nodes; // nodes[0] is the root, children come after their parents
+    std::vector<uint32_t> items;
+    std::vector<uint32_t> parents;   // per node, the root's is its own index
+    std::vector<uint32_t> item_leaf; // per item
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    void build(std::vector<aabb> const& boxes) {
+        nodes.clear();
+        items.resize(boxes.size());
+        for (uint32_t i = 0; i < items.size(); ++i) items[i] = i;
+        parents.clear();
+        item_leaf.assign(boxes.size(), 0);
+        if (boxes.empty()) return;
+
+        std::vector<glm::vec3> centres(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) centres[i] = boxes[i].centre();
+
+        nodes.reserve(2 * boxes.size());
+        nodes.push_back({{}, 0, static_cast<uint32_t>(boxes.size())});
+        parents.push_back(0);
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            uint32_t index = stack.back();
+            stack.pop_back();
+
+            uint32_t first = nodes[index].first, count = nodes[index].count;
+            aabb bounds, centre_bounds;
+            for (uint32_t i = first; i < first + count; ++i) {
+                bounds.grow(boxes[items[i]]);
+                centre_bounds.grow(centres[items[i]]);
+            }
+            nodes[index].bounds = bounds;
+
+            uint32_t mid = count > max_leaf_items ? split(boxes, centres, first, count, bounds, centre_bounds) : first;
+            if (mid == first) {
+                for (uint32_t i = first; i < first + count; ++i) item_leaf[items[i]] = index;
+                continue;
+            }
+
+            uint32_t left = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({{}, first, mid - first});
+            nodes.push_back({{}, mid, first + count - mid});
+            parents.push_back(index);
+            parents.push_back(index);
+            nodes[index] = {bounds, left, 0};
+            stack.push_back(left + 1);
+            stack.push_back(left);
+        }
+    }
+
+    // updates every node's bounds to boxes, children come after their parents so a reverse sweep sees children first
+    void refit(std::vector<aabb> const& boxes) {
+        for (size_t index = nodes.size(); index-- > 0;) {
+            node& n = nodes[index];
+            aabb bounds;
+            if (n.leaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) bounds.grow(boxes[items[i]]);
+            } else {
+                bounds = nodes[n.first].bounds;
+                bounds.grow(nodes[n.first + 1].bounds);
+            }
+            n.bounds = bounds;
+        }
+    }
+
+    // refits only the leaves of the changed items and their ancestors, stopping where the bounds stay the same,
+    // cheaper than refit() when few items move
+    void refit(std::vector<aabb> const& boxes, std::vector<uint32_t> const& changed) {
+        for (uint32_t item : changed) {
+            uint32_t index = item_leaf[item];
+            while (true) {
+                node& n = nodes[index];
+                aabb bounds;
+                if (n.leaf()) {
+                    for (uint32_t i = n.first; i < n.first + n.count; ++i) bounds.grow(boxes[items[i]]);
+                } else {
+                    bounds = nodes[n.first].bounds;
+                    bounds.grow(nodes[n.first + 1].bounds);
+                }
+                if (bounds == n.bounds) break;
+                n.bounds = bounds;
+                if (index == 0) break;
+                index = parents[index];
+            }
+        }
+    }
+
+    // expected cost of a random ray query relative to the root's area
+    float sah_cost() const {
+        if (nodes.empty()) return 0.0f;
+        float root_area = std::max(nodes[0].bounds.half_area(), FLT_MIN);
+        float res{0.0f};
+        for (auto const& n : nodes) res += n.bounds.half_area() / root_area * (n.leaf() ? n.count : traversal_cost);
+        return res;
+    }
+
+    // calls func(item) for the items of every leaf whose path from the root passes visit(bounds)
+    template<typename Visit, typename Func>
+    void traverse(Visit const& visit, Func const& func) const {
+        if (nodes.empty()) return;
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            node const& n = nodes[stack.back()];
+            stack.pop_back();
+            if (!visit(n.bounds)) continue;
+            if (n.leaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) func(items[i]);
+            } else {
+                stack.push_back(n.first + 1);
+                stack.push_back(n.first);
+            }
+        }
+    }
+
+    // nearest hit along origin + t dir for t in [0, t_max), hit(item, t_max) returns the item's hit distance or
+    // FLT_MAX, nearer children are visited first so farther subtrees are mostly skipped, returns the item or -1
+    template<typename Hit>
+    int64_t raycast(glm::vec3 origin, glm::vec3 dir, float& t_max, Hit const& hit) const {
+        if (nodes.empty()) return -1;
+        glm::vec3 inv_dir = 1.0f / dir;
+        int64_t res{-1};
+        std::vector<std::pair<uint32_t, float>> stack{{0, nodes[0].bounds.ray_entry(origin, inv_dir, t_max)}};
+        while (!stack.empty()) {
+            auto [index, entry] = stack.back();
+            stack.pop_back();
+            if (entry >= t_max) continue;
+
+            node const& n = nodes[index];
+            if (n.leaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                    float t = hit(items[i], t_max);
+                    if (t < t_max) {
+                        t_max = t;
+                        res = items[i];
+                    }
+                }
+                continue;
+            }
+
+            float t0 = nodes[n.first].bounds.ray_entry(origin, inv_dir, t_max);
+            float t1 = nodes[n.first + 1].bounds.ray_entry(origin, inv_dir, t_max);
+            bool left_first = t0 <= t1;
+            stack.push_back({left_first ? n.first + 1 : n.first, left_first ? t1 : t0});
+            stack.push_back({left_first ? n.first : n.first + 1, left_first ? t0 : t1});
+        }
+        return res;
+    }
+
+private:
+    // partitions items[first, first + count) at the cheapest bin boundary along the widest centre axis and returns
+    // the first item of the right half, or first when a leaf is cheaper
+    uint32_t split(std::vector<aabb> const& boxes, std::vector<glm::vec3> const& centres, uint32_t first, uint32_t count,
+                   aabb const& bounds, aabb const& centre_bounds) {
+        glm::vec3 extent = centre_bounds.hi - centre_bounds.lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        if (extent[axis] <= 0.0f) return first; // coincident centres can't be split
+
+        float scale = bin_count / extent[axis];
+        auto bin_of = [&](uint32_t item) {
+            return std::min(static_cast<size_t>((centres[item][axis] - centre_bounds.lo[axis]) * scale), bin_count - 1);
+        };
+
+        std::array<aabb, bin_count> bin_bounds;
+        std::array<uint32_t, bin_count> bin_items{};
+        for (uint32_t i = first; i < first + count; ++i) {
+            size_t b = bin_of(items[i]);
+            bin_bounds[b].grow(boxes[items[i]]);
+            ++bin_items[b];
+        }
+
+        // right_area[b] and right_items[b] cover bins b .. bin_count - 1
+        std::array<float, bin_count> right_area{};
+        std::array<uint32_t, bin_count> right_items{};
+        aabb right;
+        uint32_t right_count{0};
+        for (size_t b = bin_count; b-- > 1;) {
+            right.grow(bin_bounds[b]);
+            right_count += bin_items[b];
+            right_area[b] = right.half_area();
+            right_items[b] = right_count;
+        }
+
+        float best_cost{FLT_MAX};
+        size_t best_bin{0};
+        aabb left;
+        uint32_t left_count{0};
+        for (size_t b = 1; b < bin_count; ++b) {
+            left.grow(bin_bounds[b - 1]);
+            left_count += bin_items[b - 1];
+            if (left_count == 0 || right_items[b] == 0) continue;
+            float cost = left.half_area() * left_count + right_area[b] * right_items[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_bin = b;
+            }
+        }
+
+        float leaf_cost = bounds.half_area() * count;
+        float split_cost = traversal_cost * bounds.half_area() + best_cost;
+        if (best_bin == 0 || (split_cost >= leaf_cost && count <= 4 * max_leaf_items)) return first;
+
+        uint32_t* mid = std::partition(items.data() + first, items.data() + first + count, [&](uint32_t item) { return bin_of(item) < best_bin; });
+        return static_cast<uint32_t>(mid - items.data());
+    }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// scripted flight through sponza for repeatable measurements, down the nave, back along the south aisle and
+// through the north gallery, t in [0, 1] covers the whole path
+struct camera_path {
+    struct keyframe {
+        glm::vec3 pos;
+        glm::vec3 target;
+    };
+
+    std::vector<keyframe> keys{
+        {{-320.0f, 25.0f, 0.0f}, {300.0f, 25.0f, 0.0f}},
+        {{300.0f, 25.0f, 0.0f}, {300.0f, 25.0f, -140.0f}},
+        {{300.0f, 25.0f, -140.0f}, {-320.0f, 25.0f, -140.0f}},
+        {{-320.0f, 25.0f, -140.0f}, {-320.0f, 160.0f, 140.0f}},
+        {{-320.0f, 160.0f, 140.0f}, {300.0f, 160.0f, 140.0f}},
+        {{300.0f, 160.0f, 140.0f}, {0.0f, 25.0f, 0.0f}},
+    };
+
+    // position and unit front vector
+    std::pair<glm::vec3, glm::vec3> at(float t) const {
+        float f = glm::clamp(t, 0.0f, 1.0f) * (keys.size() - 1);
+        size_t i = std::min(static_cast<size_t>(f), keys.size() - 2);
+        float s = f - i;
+        glm::vec3 pos = glm::mix(keys[i].pos, keys[i + 1].pos, s);
+        glm::vec3 target = glm::mix(keys[i].target, keys[i + 1].target, s);
+        return {pos, glm::normalize(target - pos)};
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef CONSTANT_RING_H
+#define CONSTANT_RING_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+// per-frame constants allocator: one buffer split into frame_count regions, the CPU writes the
+// current frame's region while the GPU still reads the previous ones, a fence per region keeps the CPU
+// from overwriting data in flight so the driver never has to synchronise buffer updates itself
+struct constant_ring {
+    // sub-allocation of the ring, bind it to a uniform block or, with GL 4.3, a shader storage block
+    struct range {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+
+        void bind(GLuint binding, GLenum target = GL_UNIFORM_BUFFER) const {
+            glBindBufferRange(target, binding, buffer, offset, size);
+        }
+    };
+
+    GLuint ubo;
+    size_t frame_size;
+    size_t frame_count;
+    size_t alignment;
+    unsigned char * mapped{nullptr}; // null without GL 4.4, allocations then fall back to glBufferSubData
+    std::vector<GLsync> fences;
+
+    size_t frame_idx{0};
+    size_t head{0}; // bytes used in the current frame's region
+    size_t peak{0}; // most bytes used by a frame so far
+
+    constant_ring(size_t frame_size = 256 * 1024, size_t frame_count = 3) : frame_size{frame_size}, frame_count{frame_count}, fences(frame_count, nullptr) {
+        GLint offset_alignment{256};
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+        alignment = static_cast<size_t>(offset_alignment);
+        if (GLAD_GL_VERSION_4_3) {
+            // both are powers of two
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            alignment = std::max(alignment, static_cast<size_t>(offset_alignment));
+        }
+
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        if (GLAD_GL_VERSION_4_4) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, frame_size * frame_count, NULL, flags);
+            mapped = static_cast<unsigned char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, frame_size * frame_count, flags));
+        } else {
+            glBufferData(GL_UNIFORM_BUFFER, frame_size * frame_count, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    constant_ring(constant_ring const & other) = delete;
+    constant_ring & operator=(constant_ring const & other) = delete;
+
+    ~constant_ring() {
+        for (GLsync fence : fences) {
+            if (fence) glDeleteSync(fence);
+        }
+        if (mapped) {
+            glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &ubo);
+    }
+
+    // moves on to the next region, only waits if the GPU is still frame_count frames behind
+    void begin_frame() {
+        frame_idx = (frame_idx + 1) % frame_count;
+        head = 0;
+
+        GLsync& fence = fences[frame_idx];
+        if (!fence) return;
+
+        GLbitfield wait_flags{0};
+        for (;;) {
+            GLenum res = glClientWaitSync(fence, wait_flags, 1000000000);
+            if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED) break;
+            if (res == GL_WAIT_FAILED) {
+                std::cerr << "ERROR waiting for constant ring fence" << std::endl;
+                break;
+            }
+            wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // after the last draw reading this frame's constants
+    void end_frame() {
+        fences[frame_idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    range alloc(void const * data, size_t size) {
+        size_t offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > frame_size) {
+            std::cerr << "ERROR constant ring out of space, " << frame_size << " bytes per frame" << std::endl;
+            std::exit(1);
+        }
+        head = offset + size;
+        peak = std::max(peak, head);
+
+        size_t ring_offset = frame_idx * frame_size + offset;
+        if (mapped) {
+            std::memcpy(mapped + ring_offset, data, size);
+        } else {
+            glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+            glBufferSubData(GL_UNIFORM_BUFFER, ring_offset, size, data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        return {ubo, static_cast<GLintptr>(ring_offset), static_cast<GLsizeiptr>(size)};
+    }
+
+    template<typename T>
+    range push(T const& value) {
+        return alloc(&value, sizeof(T));
+    }
+
+    // an empty range can't be bound, an empty list still takes one value initialised element
+    template<typename T>
+    range push(std::vector<T> const& values) {
+        if (values.empty()) return push(T{});
+        return alloc(values.data(), values.size() * sizeof(T));
+    }
+};
+
+#endif
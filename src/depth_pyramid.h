@@ -0,0 +1,109 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// CPU hierarchical depth, every level keeps the farthest window space depth of the texels it covers so a bounding
+// volume whose nearest depth lies behind a level's texels is hidden, odd sizes round up and the last row and
+// column take in the texels left over
+struct depth_pyramid {
+    struct level {
+        size_t width;
+        size_t height;
+        std::vector<float> depth;
+
+        float at(size_t x, size_t y) const {
+            return depth[y * width + x];
+        }
+    };
+
+    std::vector<level> levels;
+
+    depth_pyramid() = default;
+
+    // depth is row major window space depth in [0, 1], bottom row first like glReadPixels
+    depth_pyramid(std::vector<float> depth, size_t width, size_t height) {
+        levels.push_back({width, height, std::move(depth)});
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            level const& src = levels.back();
+            level dst{(src.width + 1) / 2, (src.height + 1) / 2, {}};
+            dst.depth.resize(dst.width * dst.height);
+            for (size_t y = 0; y < dst.height; ++y) {
+                size_t y1 = y + 1 == dst.height ? src.height - 1 : 2 * y + 1;
+                for (size_t x = 0; x < dst.width; ++x) {
+                    size_t x1 = x + 1 == dst.width ? src.width - 1 : 2 * x + 1;
+                    float farthest{0.0f};
+                    for (size_t sy = 2 * y; sy <= y1; ++sy) {
+                        for (size_t sx = 2 * x; sx <= x1; ++sx) farthest = std::max(farthest, src.at(sx, sy));
+                    }
+                    dst.depth[y * dst.width + x] = farthest;
+                }
+            }
+            levels.push_back(std::move(dst));
+        }
+    }
+
+    bool empty() const {
+        return levels.empty();
+    }
+
+    size_t width() const {
+        return levels.empty() ? 0 : levels[0].width;
+    }
+
+    size_t height() const {
+        return levels.empty() ? 0 : levels[0].height;
+    }
+
+    // farthest depth over the pixel rectangle [x0, x1] x [y0, y1], read from the level where it spans at most 2 x 2 texels
+    float farthest(size_t x0, size_t y0, size_t x1, size_t y1) const {
+        size_t extent = std::max(x1 - x0, y1 - y0) + 1;
+        size_t l{0};
+        while (l + 1 < levels.size() && (size_t{1} << l) < extent) ++l;
+
+        level const& lvl = levels[l];
+        float res{0.0f};
+        for (size_t y = std::min(y0 >> l, lvl.height - 1); y <= std::min(y1 >> l, lvl.height - 1); ++y) {
+            for (size_t x = std::min(x0 >> l, lvl.width - 1); x <= std::min(x1 >> l, lvl.width - 1); ++x) res = std::max(res, lvl.at(x, y));
+        }
+        return res;
+    }
+
+    // whether the sphere is hidden behind the depth this pyramid was built from, conservative since it tests the
+    // screen rectangle and nearest depth of the sphere's bounding box, anything crossing the near plane is visible
+    bool occludes(glm::vec3 centre, float radius, glm::mat4 const& view_projection) const {
+        return occludes_box(centre - glm::vec3(radius), centre + glm::vec3(radius), view_projection);
+    }
+
+    // the same for the box [lo, hi], clip_from_box takes it to clip space so object space boxes stay tight
+    bool occludes_box(glm::vec3 lo, glm::vec3 hi, glm::mat4 const& clip_from_box) const {
+        if (levels.empty()) return false;
+
+        glm::vec3 ndc_lo{FLT_MAX}, ndc_hi{-FLT_MAX};
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 pos{corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y, corner & 4 ? hi.z : lo.z};
+            glm::vec4 clip = clip_from_box * glm::vec4(pos, 1.0f);
+            if (clip.w <= 1e-5f) return false;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndc_lo = glm::min(ndc_lo, ndc);
+            ndc_hi = glm::max(ndc_hi, ndc);
+        }
+        if (ndc_hi.x < -1.0f || ndc_lo.x > 1.0f || ndc_hi.y < -1.0f || ndc_lo.y > 1.0f) return false;
+
+        auto to_pixel = [](float ndc, size_t size) {
+            float px = std::floor((glm::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * size);
+            return std::min(static_cast<size_t>(std::max(px, 0.0f)), size - 1);
+        };
+        size_t x0 = to_pixel(ndc_lo.x, width()), x1 = to_pixel(ndc_hi.x, width());
+        size_t y0 = to_pixel(ndc_lo.y, height()), y1 = to_pixel(ndc_hi.y, height());
+        float nearest = ndc_lo.z * 0.5f + 0.5f;
+        return nearest > farthest(x0, y0, x1, y1);
+    }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <utility>
+
+#include "model.h"
+#include "shapes.h"
+#include "util.h"
+
+// GPU buffers of a shape at one LOD, without a material, share them through geometry_cache
+struct shape_mesh : mesh {
+    shape_mesh(shape s, size_t lod) : shape_mesh{generate_shape(s, lod)} { }
+
+private:
+    shape_mesh(geometry_data && data) : mesh{std::move(data.vertices), std::move(data.indices), nullptr} { }
+};
+
+using geometry_cache = shared_cache<shape_mesh, shape, size_t>;
+
+#endif
@@ -1,11 +1,15 @@
 #ifndef GL_UTIL_H
 #define GL_UTIL_H
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <unordered_map>
 
 #include "shader.h"
 #include "model.h"
 #include "texture.h"
+#include "constant_ring.h"
 
 struct vao {
     GLuint id;
@@ -33,8 +37,68 @@ struct vao {
     }
 };
 
+// std140 layout of the vp block in common/vp.glsl
+struct vp_std140 {
+    glm::mat4 view;
+    glm::mat4 projection;
+    float user_ev;
+    float pad[3];
+};
+
+static constexpr GLuint vp_binding = 0;
+
+// a fresh copy of the camera block for every view, so earlier passes keep reading theirs
+inline void push_vp(constant_ring & constants, glm::mat4 const& view, glm::mat4 const& projection, float user_ev) {
+    constants.push(vp_std140{view, projection, user_ev, {}}).bind(vp_binding);
+}
+
+static constexpr GLuint transforms_binding = 0;
+
+// model matrices of a pass as one shader storage block, see common/transforms.glsl, draw id i reads transforms[i],
+// nothing is pushed for a pass without draws, like a frustum query that found nothing
+inline void push_transforms(constant_ring & constants, std::vector<glm::mat4> const& transforms) {
+    if (transforms.empty()) return;
+    constants.push(transforms).bind(transforms_binding, GL_SHADER_STORAGE_BUFFER);
+}
+
+inline void push_transforms(constant_ring & constants, std::vector<std::pair<model*, glm::mat4>> const& geometry) {
+    std::vector<glm::mat4> transforms;
+    for (auto& object : geometry) transforms.push_back(object.second);
+    push_transforms(constants, transforms);
+}
+
+// draws geometry after push_transforms(), the model matrices are no longer set per draw, each model is drawn whole
+// under its matrix so node transforms are ignored, see model::has_flat_nodes()
+inline void draw_geometry(shader_program const& program, std::vector<std::pair<model*, glm::mat4>> const& geometry) {
+    for (size_t i = 0; i < geometry.size(); ++i) {
+        geometry[i].first->draw(program, static_cast<GLuint>(i));
+    }
+}
+
+// depth only version of draw_geometry(), see mesh::draw_depth()
+inline void draw_geometry_depth(shader_permutations & permutations, std::vector<std::pair<model*, glm::mat4>> const& geometry) {
+    for (size_t i = 0; i < geometry.size(); ++i) {
+        geometry[i].first->draw_depth(permutations, static_cast<GLuint>(i));
+    }
+}
+
+// std140 layout of light_type in common/lights.glsl
+struct light_std140 {
+    glm::vec3 pos;
+    float constant;
+    glm::vec3 dir;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutoff;
+    glm::vec3 specular;
+    float outer_cutoff;
+};
+
+static_assert(sizeof(light_std140) == 80, "light_std140 has to match the std140 layout of light_type");
+
 struct light {
-    std::string name;
     glm::vec3 pos;
     glm::vec3 dir;
     glm::vec3 color;
@@ -42,16 +106,17 @@ struct light {
     float constant;
     float linear;
     float quadratic;
-
-    void setup(shader_program const& program) const {
-        program.set_uniform(name + ".pos", pos);
-        program.set_uniform(name + ".dir", dir);
-        program.set_uniform(name + ".ambient", strength.x * color);
-        program.set_uniform(name + ".diffuse", strength.y * color);
-        program.set_uniform(name + ".specular", strength.z * color);
-        program.set_uniform(name + ".constant", constant);
-        program.set_uniform(name + ".linear", linear);
-        program.set_uniform(name + ".quadratic", quadratic);
+    float cutoff{1.0f}; // cosines of the spot cone, unused by other lights
+    float outer_cutoff{1.0f};
+
+    light_std140 std140() const {
+        return {
+            pos, constant,
+            dir, linear,
+            strength.x * color, quadratic,
+            strength.y * color, cutoff,
+            strength.z * color, outer_cutoff
+        };
     }
 };
 
@@ -73,13 +138,51 @@ static const std::array<glm::vec3, 6> ups{
     glm::vec3( 0.0f, -1.0f,  0.0f)
 };
 
+// what an environment map is used for, each purpose has its own resolution
+enum class env_map_use {
+    source,     // environment captured once and filtered into the other maps
+    irradiance, // diffuse convolution, very low frequency
+    prefilter,  // specular convolution with one roughness per mip
+    reflection  // scene capture for mirror-like surfaces
+};
+
+inline size_t env_map_size(env_map_use use) {
+    switch (use) {
+        case env_map_use::source: return 1024;
+        case env_map_use::irradiance: return 32;
+        case env_map_use::prefilter: return 256;
+        case env_map_use::reflection: return 256;
+    }
+    return 256;
+}
+
+// bytes per texel of the internal formats used for render targets, for VRAM accounting
+inline size_t texel_size(GLenum internal_format) {
+    switch (internal_format) {
+        case GL_RGB16F: return 6;
+        case GL_RGBA16F: return 8;
+        case GL_RGB32F: return 12;
+        case GL_RGBA32F: return 16;
+        default: return 4; // GL_R11F_G11F_B10F, GL_RGB9_E5, GL_RG16F, GL_DEPTH24_STENCIL8, ...
+    }
+}
+
+// number of levels of a full mip chain
+inline GLsizei mip_count(size_t size) {
+    return static_cast<GLsizei>(std::log2(size)) + 1;
+}
+
 struct env_map {
     size_t size;
+    GLenum internal_format;
+    GLsizei levels;
     GLuint fb;
     GLuint tex;
-    GLuint rbo;
+    GLuint rbo{0}; // stays 0 without a depth buffer
 
-    env_map(size_t size) : size{size} {
+    // GL_RGB9_E5 is not color-renderable, only use it for maps that are filled by uploads
+    env_map(size_t size, GLenum internal_format = GL_R11F_G11F_B10F, bool with_depth = true, bool with_mips = false)
+        : size{size}, internal_format{internal_format}, levels{with_mips ? mip_count(size) : 1} {
         glActiveTexture(GL_TEXTURE0);
 
         glGenFramebuffers(1, &fb);
@@ -87,10 +190,8 @@ struct env_map {
 
         glGenTextures(1, &tex);
         glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-        for (size_t i = 0; i < 6; ++i) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, NULL);
-        }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, internal_format, size, size);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, with_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -98,11 +199,13 @@ struct env_map {
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, tex, 0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-        glGenRenderbuffers(1, &rbo);
-        glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size, size);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+        if (with_depth) {
+            glGenRenderbuffers(1, &rbo);
+            glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size, size);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+        }
 
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             std::cerr << "ERROR: framebuffer lacking completeness" << std::endl;
@@ -111,24 +214,71 @@ struct env_map {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void render(glm::vec3 pos, GLuint vp_ubo, std::function<void(glm::vec3)> render_func) const {
-        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    env_map(env_map_use use, GLenum internal_format = GL_R11F_G11F_B10F, bool with_depth = true, bool with_mips = false)
+        : env_map(env_map_size(use), internal_format, with_depth, with_mips) { }
 
-        glm::mat4 cube_proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
-        glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(cube_proj));
+    env_map(env_map && other) : size{other.size}, internal_format{other.internal_format}, levels{other.levels}, fb{other.fb}, tex{other.tex}, rbo{other.rbo} {
+        other.fb = 0;
+        other.tex = 0;
+        other.rbo = 0;
+    }
+
+    env_map & operator=(env_map && other) {
+        std::swap(size, other.size);
+        std::swap(internal_format, other.internal_format);
+        std::swap(levels, other.levels);
+        std::swap(fb, other.fb);
+        std::swap(tex, other.tex);
+        std::swap(rbo, other.rbo);
+        return *this;
+    }
+
+    env_map(env_map const & other) = delete;
+    env_map & operator=(env_map const & other) = delete;
+
+    ~env_map() {
+        glDeleteRenderbuffers(1, &rbo);
+        glDeleteTextures(1, &tex);
+        glDeleteFramebuffers(1, &fb);
+    }
+
+    void render(glm::vec3 pos, constant_ring & constants, float ev, std::function<void(glm::vec3)> render_func) const {
         for (size_t face_idx = 0; face_idx < 6; ++face_idx) {
-            glm::mat4 cube_view = glm::lookAt(pos, pos + targets[face_idx], ups[face_idx]);
-            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(cube_view));
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face_idx, tex, 0);
-            glViewport(0, 0, size, size);
-            render_func(pos);
-            glClear(GL_DEPTH_BUFFER_BIT);
+            render_face(pos, constants, ev, face_idx, render_func);
         }
+    }
+
+    // render a single face, lets callers spread a capture over several frames
+    void render_face(glm::vec3 pos, constant_ring & constants, float ev, size_t face_idx, std::function<void(glm::vec3)> const& render_func) const {
+        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+
+        glm::mat4 cube_proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
+        glm::mat4 cube_view = glm::lookAt(pos, pos + targets[face_idx], ups[face_idx]);
+        push_vp(constants, cube_view, cube_proj, ev);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face_idx, tex, 0);
+        glViewport(0, 0, size, size);
+        if (rbo) glClear(GL_DEPTH_BUFFER_BIT);
+        render_func(pos);
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    // fill the mip chain from level 0, once after render()
+    void generate_mipmaps() const {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    size_t vram_bytes() const {
+        size_t res{rbo ? size * size * texel_size(GL_DEPTH24_STENCIL8) : 0};
+        for (GLsizei level = 0; level < levels; ++level) {
+            size_t level_size = std::max<size_t>(size >> level, 1);
+            res += 6 * level_size * level_size * texel_size(internal_format);
+        }
+        return res;
+    }
+
     void activate(shader_program const & program, std::string name, int unit) const {
         glActiveTexture(GL_TEXTURE0 + unit);
         glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
@@ -137,13 +287,16 @@ struct env_map {
     }
 };
 
+// specular prefiltered cube map, one roughness per mip level, rendered by full screen passes without depth
 struct reflection_map {
+    static constexpr size_t mip_levels = 5;
+
     size_t size;
+    GLenum internal_format;
     GLuint fb;
     GLuint tex;
-    GLuint rbo;
 
-    reflection_map(size_t size) : size{size} {
+    reflection_map(size_t size, GLenum internal_format = GL_R11F_G11F_B10F) : size{size}, internal_format{internal_format} {
         glActiveTexture(GL_TEXTURE0);
 
         glGenFramebuffers(1, &fb);
@@ -151,24 +304,15 @@ struct reflection_map {
 
         glGenTextures(1, &tex);
         glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-        for (size_t i = 0; i < 6; ++i) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, NULL);
-        }
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, mip_levels, internal_format, size, size);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP, tex, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, tex, 0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-        glGenRenderbuffers(1, &rbo);
-        glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size, size);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             std::cerr << "ERROR: framebuffer lacking completeness" << std::endl;
         }
@@ -176,34 +320,57 @@ struct reflection_map {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void render(glm::vec3 pos, GLuint vp_ubo, std::function<void(glm::vec3, float)> render_func) const {
+    reflection_map(reflection_map && other) : size{other.size}, internal_format{other.internal_format}, fb{other.fb}, tex{other.tex} {
+        other.fb = 0;
+        other.tex = 0;
+    }
+
+    reflection_map & operator=(reflection_map && other) {
+        std::swap(size, other.size);
+        std::swap(internal_format, other.internal_format);
+        std::swap(fb, other.fb);
+        std::swap(tex, other.tex);
+        return *this;
+    }
+
+    reflection_map(reflection_map const & other) = delete;
+    reflection_map & operator=(reflection_map const & other) = delete;
+
+    ~reflection_map() {
+        glDeleteTextures(1, &tex);
+        glDeleteFramebuffers(1, &fb);
+    }
+
+    void render(glm::vec3 pos, constant_ring & constants, float ev, std::function<void(glm::vec3, float)> render_func) const {
         glBindFramebuffer(GL_FRAMEBUFFER, fb);
 
         glm::mat4 cube_proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
-        glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(cube_proj));
 
-        constexpr static size_t mip_levels = 5;
         for (size_t mip = 0; mip < mip_levels; ++mip) {
-            size_t mip_size = size * std::pow(0.5, mip);
-
-            glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mip_size, mip_size);
+            size_t mip_size = std::max<size_t>(size >> mip, 1);
             glViewport(0, 0, mip_size, mip_size);
 
             float roughness = static_cast<float>(mip) / static_cast<float>(mip_levels - 1);
             for (size_t face_idx = 0; face_idx < 6; ++face_idx) {
                 glm::mat4 cube_view = glm::lookAt(pos, pos + targets[face_idx], ups[face_idx]);
-                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(cube_view));
+                push_vp(constants, cube_view, cube_proj, ev);
                 glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face_idx, tex, mip);
                 render_func(pos, roughness);
-                glClear(GL_DEPTH_BUFFER_BIT);
             }
         }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    size_t vram_bytes() const {
+        size_t res{0};
+        for (size_t mip = 0; mip < mip_levels; ++mip) {
+            size_t mip_size = std::max<size_t>(size >> mip, 1);
+            res += 6 * mip_size * mip_size * texel_size(internal_format);
+        }
+        return res;
+    }
+
     void activate(shader_program const & program, std::string name, int unit) const {
         glActiveTexture(GL_TEXTURE0 + unit);
         glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
@@ -247,16 +414,17 @@ struct dir_shadow_map {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void render(shader_program const & program, glm::mat4 light_space, std::vector<std::pair<model*, glm::mat4>> const & geometry) const {
-        program.use();
-        program.set_uniform("light_space", light_space);
+    // program has the material permutation bits, only the opacity map one is used, draw() pushes the casters'
+    // transforms and draws them with it, e.g. through draw_geometry_depth()
+    template<typename Draw>
+    void render(shader_permutations & program, glm::mat4 light_space, Draw const & draw) const {
+        program.set_shared_uniforms([light_space](shader_program const& variant) {
+            variant.set_uniform("light_space", light_space);
+        });
         glViewport(0, 0, size, size);
         glBindFramebuffer(GL_FRAMEBUFFER, fb);
         glClear(GL_DEPTH_BUFFER_BIT);
-        for (auto && object : geometry) {
-            program.set_uniform("model", object.second);
-            object.first->draw(program);
-        }
+        draw();
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
@@ -270,6 +438,8 @@ struct dir_shadow_map {
 };
 
 struct omni_shadow_map {
+    static constexpr float projection_far = 400.0f;
+
     size_t size;
     GLuint fb;
     GLuint tex;
@@ -305,8 +475,10 @@ struct omni_shadow_map {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void render(shader_program const & program, glm::vec3 light_pos, float far, std::vector<std::pair<model*, glm::mat4>> const & geometry) const {
-        glm::mat4 omni_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 400.0f);
+    // see dir_shadow_map::render(), nothing beyond projection_far of light_pos casts a shadow
+    template<typename Draw>
+    void render(shader_permutations & program, glm::vec3 light_pos, float far, Draw const & draw) const {
+        glm::mat4 omni_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, projection_far);
         glViewport(0, 0, size, size);
         glBindFramebuffer(GL_FRAMEBUFFER, fb);
         glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0);
@@ -320,17 +492,17 @@ struct omni_shadow_map {
             glm::lookAt(light_pos, light_pos + glm::vec3( 0.0, 0.0,-1.0), glm::vec3(0.0,-1.0, 0.0))
         };
         std::array<glm::mat4, omni_views.size()> omni_transforms;
-        program.use();
         for (size_t i = 0; i < omni_views.size(); ++i) {
             omni_transforms[i] = omni_projection * omni_views[i];
-            program.set_uniform("shadow_transforms[" + std::to_string(i) + "]", omni_transforms[i]);
         }
 
-        program.set_uniforms("far", far, "light_pos", light_pos);
-        for (auto && object : geometry) {
-            program.set_uniform("model", object.second);
-            object.first->draw(program);
-        }
+        program.set_shared_uniforms([omni_transforms, far, light_pos](shader_program const& variant) {
+            for (size_t i = 0; i < omni_transforms.size(); ++i) {
+                variant.set_uniform("shadow_transforms[" + std::to_string(i) + "]", omni_transforms[i]);
+            }
+            variant.set_uniforms("far", far, "light_pos", light_pos);
+        });
+        draw();
     }
 
     void activate(shader_program const & program, std::string name, int unit) const {
@@ -348,13 +520,13 @@ struct framebuffer {
     size_t width;
     size_t height;
 
-    framebuffer(size_t width, size_t height, bool use_rbo) : width{width}, height{height} {
+    framebuffer(size_t width, size_t height, bool use_rbo, GLenum internal_format) : width{width}, height{height} {
         glGenFramebuffers(1, &id);
         glBindFramebuffer(GL_FRAMEBUFFER, id);
 
         glGenTextures(1, &color_buf);
         glBindTexture(GL_TEXTURE_2D, color_buf);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -376,6 +548,8 @@ struct framebuffer {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    framebuffer(size_t width, size_t height, bool use_rbo) : framebuffer(width, height, use_rbo, GL_RGB16F) {}
+
     framebuffer(size_t width, size_t height) : framebuffer(width, height, true) {}
 
     framebuffer(GLuint id, GLuint color_buf, GLuint rbo, size_t width, size_t height) :
@@ -467,4 +641,129 @@ void activate_texture(TexType const & tex, shader_program const & program, std::
     program.set_uniform(name, unit);
 }
 
+// one side of a normalized gaussian kernel, weights[0] is the center tap
+// sigma = radius / 2 roughly reproduces the 5-tap bloom kernel at radius 2
+std::vector<float> gaussian_weights(int radius) {
+    float sigma = std::max(radius / 2.0f, 0.5f);
+    std::vector<float> weights(radius + 1);
+    float sum = 0.0f;
+    for (int i = 0; i <= radius; ++i) {
+        weights[i] = std::exp(-0.5f * i * i / (sigma * sigma));
+        sum += (i == 0 ? 1.0f : 2.0f) * weights[i];
+    }
+    for (auto& weight : weights) weight /= sum;
+    return weights;
+}
+
+enum class blur_type {
+    separable, // one tap per texel, two 1D passes
+    linear,    // adjacent taps merged into a single bilinear fetch, roughly halving the tap count
+    compute    // separable in a compute shader with the source row cached in shared memory
+};
+
+struct gaussian_blur {
+    static constexpr int max_taps = 16;
+    static constexpr int max_radius = 15;
+
+    blur_type type;
+    int radius;
+    std::vector<float> offsets;
+    std::vector<float> weights;
+    shader_program program;
+    size_t kernel_generation{0}; // program generation the kernel uniforms were set on
+    bool kernel_set{false};
+    std::unordered_map<std::tuple<size_t, size_t, size_t>, framebuffer> tmp_fbs;
+
+    gaussian_blur(blur_type type, int radius) :
+        type{type},
+        radius{std::min(radius, max_radius)},
+        program{type == blur_type::compute
+            ? shader_program{{GL_COMPUTE_SHADER, "src/shaders/blur.comp"}}
+            : shader_program{{GL_VERTEX_SHADER, "src/shaders/blur.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/blur.frag"}}}
+    {
+        weights = gaussian_weights(this->radius);
+        for (size_t i = 0; i < weights.size(); ++i) offsets.push_back(static_cast<float>(i));
+
+        if (type == blur_type::linear) {
+            std::vector<float> linear_offsets{0.0f};
+            std::vector<float> linear_weights{weights[0]};
+            for (size_t i = 1; i < weights.size(); i += 2) {
+                float w1 = weights[i];
+                float w2 = i + 1 < weights.size() ? weights[i + 1] : 0.0f;
+                linear_weights.push_back(w1 + w2);
+                linear_offsets.push_back((offsets[i] * w1 + (i + 1) * w2) / (w1 + w2));
+            }
+            offsets = std::move(linear_offsets);
+            weights = std::move(linear_weights);
+        }
+    }
+
+    // the program is used, the kernel is set again whenever a reload replaced the program
+    void use_program() {
+        program.use();
+        if (kernel_set && kernel_generation == program.generation) return;
+
+        program.set_uniforms("tex", 0, "tap_count", static_cast<int>(weights.size()));
+        for (size_t i = 0; i < weights.size(); ++i) {
+            program.set_uniform("offsets[" + std::to_string(i) + "]", offsets[i]);
+            program.set_uniform("weights[" + std::to_string(i) + "]", weights[i]);
+        }
+        kernel_generation = program.generation;
+        kernel_set = true;
+    }
+
+    // index tells apart several intermediate targets of one size
+    framebuffer& tmp_fb(size_t width, size_t height, size_t index = 0) {
+        auto found = tmp_fbs.find(std::make_tuple(width, height, index));
+        if (found == tmp_fbs.end()) {
+            GLenum internal_format = type == blur_type::compute ? GL_RGBA16F : GL_RGB16F;
+            found = tmp_fbs.emplace(std::make_tuple(width, height, index), framebuffer{width, height, false, internal_format}).first;
+        }
+        return found->second;
+    }
+
+    static GLint internal_format(GLuint tex) {
+        GLint res{0};
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &res);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return res;
+    }
+
+    // dst may alias src and has to be the same size for the compute path, which writes an RGBA16F dst directly and
+    // any other format through a second intermediate target and a blit
+    void apply(framebuffer const& src, framebuffer const& dst) {
+        framebuffer& tmp = tmp_fb(src.width, src.height);
+        use_program();
+
+        if (type == blur_type::compute) {
+            static constexpr size_t group_size = 128;
+            bool direct = internal_format(dst.color_buf) == GL_RGBA16F;
+            framebuffer const& out = direct ? dst : tmp_fb(src.width, src.height, 1);
+            glActiveTexture(GL_TEXTURE0);
+
+            glBindTexture(GL_TEXTURE_2D, src.color_buf);
+            glBindImageTexture(0, tmp.color_buf, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            program.set_uniform("horizontal", true);
+            glDispatchCompute((src.width + group_size - 1) / group_size, src.height, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            glBindTexture(GL_TEXTURE_2D, tmp.color_buf);
+            glBindImageTexture(0, out.color_buf, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            program.set_uniform("horizontal", false);
+            glDispatchCompute((src.height + group_size - 1) / group_size, src.width, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+            if (!direct) blit_buffer(out, dst, GL_COLOR_ATTACHMENT0);
+            return;
+        }
+
+        program.set_uniform("dir", glm::vec2{1.0f, 0.0f});
+        render_to_buffer(program, tmp, {src.color_buf});
+        program.set_uniform("dir", glm::vec2{0.0f, 1.0f});
+        render_to_buffer(program, dst, {tmp.color_buf});
+    }
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// GPU time between begin() and end() from two timestamp queries, unlike GL_TIME_ELAPSED queries timers can nest,
+// every begin() / end() pair writes the next of latency query pairs so a timer used once per frame can read the
+// previous frame's result with elapsed_ms() while the GPU is still working on this one
+struct gpu_timer {
+    static constexpr size_t latency = 2;
+
+    GLuint queries[latency][2];
+    size_t current{0}; // the pair the next begin() writes
+    size_t ended{0};   // end() calls so far
+
+    gpu_timer() {
+        glGenQueries(2 * latency, queries[0]);
+    }
+
+    gpu_timer(gpu_timer const & other) = delete;
+    gpu_timer & operator=(gpu_timer const & other) = delete;
+
+    ~gpu_timer() {
+        glDeleteQueries(2 * latency, queries[0]);
+    }
+
+    void begin() const {
+        glQueryCounter(queries[current][0], GL_TIMESTAMP);
+    }
+
+    void end() {
+        glQueryCounter(queries[current][1], GL_TIMESTAMP);
+        current = (current + 1) % latency;
+        ++ended;
+    }
+
+    // whether the last end() has reached the GPU, doesn't wait
+    bool ready() const {
+        if (ended == 0) return false;
+        GLint available{0};
+        glGetQueryObjectiv(queries[(current + latency - 1) % latency][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        return available;
+    }
+
+    // the pair before the last one, a frame old for per-frame timers so normally done without waiting, 0 before there is one
+    double elapsed_ms() const {
+        return ended < 2 ? 0.0 : result_ms((current + latency - 2) % latency);
+    }
+
+    // the last pair, waits for the GPU unless ready()
+    double latest_ms() const {
+        return ended == 0 ? 0.0 : result_ms((current + latency - 1) % latency);
+    }
+
+private:
+    double result_ms(size_t pair) const {
+        GLuint64 start{0}, stop{0};
+        glGetQueryObjectui64v(queries[pair][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[pair][1], GL_QUERY_RESULT, &stop);
+        return (stop - start) / 1e6;
+    }
+};
+
+#endif
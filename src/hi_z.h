@@ -0,0 +1,241 @@
+#ifndef HI_Z_H
+#define HI_Z_H
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_util.h"
+#include "model.h"
+#include "shader.h"
+
+// GPU version of depth_pyramid, an R32F mip chain of the farthest depth built by hi_z.comp, level sizes round down
+// like every GL mip chain and the last row and column of a level cover what that leaves over
+struct hi_z_pyramid {
+    static constexpr GLuint group_size = 8;
+
+    size_t width;
+    size_t height;
+    GLsizei levels;
+    GLuint tex;
+    shader_program program{{GL_COMPUTE_SHADER, "src/shaders/hi_z.comp"}};
+
+    hi_z_pyramid(size_t width, size_t height) : width{width}, height{height}, levels{mip_count(std::max(width, height))} {
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    hi_z_pyramid(hi_z_pyramid const & other) = delete;
+    hi_z_pyramid & operator=(hi_z_pyramid const & other) = delete;
+
+    ~hi_z_pyramid() {
+        glDeleteTextures(1, &tex);
+    }
+
+    // depth_tex has to match the pyramid's size, level 0 copies it and every further level reduces the one before
+    void build(GLuint depth_tex) const {
+        program.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depth_tex);
+        program.set_uniforms("src", 0, "copy_depth", true, "src_level", 0);
+        for (GLsizei level = 0; level < levels; ++level) {
+            if (level == 1) {
+                glBindTexture(GL_TEXTURE_2D, tex);
+                program.set_uniform("copy_depth", false);
+            }
+            if (level > 0) program.set_uniform("src_level", static_cast<int>(level - 1));
+
+            size_t level_width = std::max<size_t>(width >> level, 1);
+            size_t level_height = std::max<size_t>(height >> level, 1);
+            glBindImageTexture(0, tex, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((level_width + group_size - 1) / group_size, (level_height + group_size - 1) / group_size, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void activate(GLenum unit) const {
+        glActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+// std430 layout of cull_unit in occlusion_cull.comp
+struct cull_unit_std430 {
+    glm::vec4 sphere;
+    glm::vec4 cone_apex; // w is the cone cutoff
+    glm::vec4 cone_axis;
+    GLuint first_index;
+    GLuint index_count;
+    GLuint mesh;
+    GLuint whole_mesh;
+};
+
+static_assert(sizeof(cull_unit_std430) == 64, "cull_unit_std430 has to match the std430 layout of cull_unit");
+
+// counters of one frame of occlusion_culler, units are meshlets or whole meshes
+struct occlusion_stats {
+    GLuint frustum_culled;
+    GLuint backface_culled;
+    GLuint occluded;     // rejected by both phases
+    GLuint drawn_first;  // visible against the previous frame's depth
+    GLuint drawn_second; // hidden by the previous frame's depth, but not by this frame's first phase
+    GLuint triangles_drawn;
+    GLuint triangles_total;
+
+    float culled_percent() const {
+        return triangles_total ? 100.0f * (1.0f - static_cast<float>(triangles_drawn) / triangles_total) : 0.0f;
+    }
+};
+
+// two phase occlusion culling of one model's meshlets, or whole meshes for meshes without them, on the GPU:
+// phase 1 draws what survives frustum, cone and hi-Z culling against the previous frame's depth, phase 2 retests only
+// what phase 1 found occluded against a pyramid of phase 1's depth and draws what became visible, so objects
+// uncovered by camera motion never miss a frame, the pyramid is rebuilt after phase 2 as the next frame's history
+struct occlusion_culler {
+    static constexpr GLuint group_size = 64;
+    // shader storage bindings, clear of the transforms at 0 and pbr's instance materials at 1
+    static constexpr GLuint units_binding = 2;
+    static constexpr GLuint mesh_ranges_binding = 3;
+    static constexpr GLuint rejected_binding = 4;
+    static constexpr GLuint commands_binding = 5;
+    static constexpr GLuint stats_binding = 6;
+
+    model const& object;
+    hi_z_pyramid pyramid;
+    shader_program program{{GL_COMPUTE_SHADER, "src/shaders/occlusion_cull.comp"}};
+
+    std::vector<std::pair<GLuint, GLuint>> mesh_units; // first unit and unit count of every mesh
+    GLuint unit_count{0};
+    GLuint units_ssbo;
+    GLuint mesh_ranges_ssbo;
+    GLuint rejected_ssbo;
+    GLuint stats_ssbo;
+    std::array<GLuint, 2> command_buffers; // per phase
+
+    glm::mat4 prev_view_projection{1.0f};
+    bool history_valid{false};
+
+    // width and height of the depth buffer draw() gets
+    occlusion_culler(model const& object, size_t width, size_t height) : object{object}, pyramid{width, height} {
+        std::vector<cull_unit_std430> units;
+        for (size_t i = 0; i < object.meshes.size(); ++i) {
+            mesh const& m = object.meshes[i];
+            mesh_units.emplace_back(units.size(), 1 + m.meshlets.size());
+            units.push_back({glm::vec4(m.bounds_centre, m.bounds_radius), glm::vec4(0.0f, 0.0f, 0.0f, 2.0f), glm::vec4(0.0f),
+                             m.lods[0].first_index, m.lods[0].index_count, static_cast<GLuint>(i), 1});
+            for (auto const& ml : m.meshlets) {
+                units.push_back({glm::vec4(ml.centre, ml.radius), glm::vec4(ml.cone_apex, ml.cone_cutoff), glm::vec4(ml.cone_axis, 0.0f),
+                                 ml.first_index, ml.index_count, static_cast<GLuint>(i), 0});
+            }
+        }
+        unit_count = units.size();
+
+        glGenBuffers(1, &units_ssbo);
+        glGenBuffers(1, &mesh_ranges_ssbo);
+        glGenBuffers(1, &rejected_ssbo);
+        glGenBuffers(1, &stats_ssbo);
+        glGenBuffers(command_buffers.size(), command_buffers.data());
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, units_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, units.size() * sizeof(cull_unit_std430), units.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_ranges_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, object.meshes.size() * sizeof(glm::uvec4), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, rejected_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, units.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(occlusion_stats), NULL, GL_DYNAMIC_READ);
+        for (GLuint buffer : command_buffers) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, units.size() * sizeof(draw_elements_indirect_command), NULL, GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    occlusion_culler(occlusion_culler const & other) = delete;
+    occlusion_culler & operator=(occlusion_culler const & other) = delete;
+
+    ~occlusion_culler() {
+        glDeleteBuffers(1, &units_ssbo);
+        glDeleteBuffers(1, &mesh_ranges_ssbo);
+        glDeleteBuffers(1, &rejected_ssbo);
+        glDeleteBuffers(1, &stats_ssbo);
+        glDeleteBuffers(command_buffers.size(), command_buffers.data());
+    }
+
+    // the next frame's first phase only does frustum and cone culling
+    void invalidate() {
+        history_valid = false;
+    }
+
+    // both phases into the bound framebuffer, whose depth attachment is depth_tex, with the meshes' current LODs,
+    // depth has to be cleared already and transforms pushed like for model::draw(), culls the model's flat mesh list
+    // under transform, so node transforms are ignored, see model::has_flat_nodes()
+    void draw(shader_permutations & permutations, GLuint depth_tex, glm::mat4 const& transform, glm::mat4 const& view_projection, glm::vec3 camera_pos,
+              uint32_t extra_features = 0, GLuint draw_id = 0) {
+        std::vector<glm::uvec4> ranges;
+        for (auto const& m : object.meshes) {
+            mesh_lod const& level = m.lods[m.lod];
+            ranges.emplace_back(level.first_index, level.index_count, !m.meshlets.empty() && m.lod == 0 ? 1 : 0, 0);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_ranges_ssbo);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, ranges.size() * sizeof(glm::uvec4), ranges.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_ssbo);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glm::mat3 linear{transform};
+        float scale = std::max({glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2])});
+        program.use();
+        program.set_uniforms("hi_z", 0, "hi_z_levels", static_cast<int>(pyramid.levels), "transform", transform, "scale", scale,
+                             "view_projection", view_projection, "camera_pos", camera_pos, "unit_count", static_cast<size_t>(unit_count),
+                             "draw_id", static_cast<size_t>(draw_id));
+
+        for (int phase = 0; phase < 2; ++phase) {
+            if (phase == 1) pyramid.build(depth_tex);
+
+            program.use();
+            program.set_uniforms("second_phase", phase == 1, "hi_z_valid", phase == 1 || history_valid,
+                                 "occlusion_view_projection", phase == 1 ? view_projection : prev_view_projection);
+            pyramid.activate(GL_TEXTURE0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, units_binding, units_ssbo);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, mesh_ranges_binding, mesh_ranges_ssbo);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, rejected_binding, rejected_ssbo);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commands_binding, command_buffers[phase]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, stats_binding, stats_ssbo);
+            glDispatchCompute((unit_count + group_size - 1) / group_size, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+            for (size_t i = 0; i < object.meshes.size(); ++i) {
+                GLintptr offset = mesh_units[i].first * sizeof(draw_elements_indirect_command);
+                object.meshes[i].draw_indirect(permutations, extra_features, command_buffers[phase], offset, mesh_units[i].second);
+            }
+        }
+
+        pyramid.build(depth_tex);
+        prev_view_projection = view_projection;
+        history_valid = true;
+    }
+
+    // counters of the last draw(), waits for the GPU to finish it
+    occlusion_stats read_stats() const {
+        occlusion_stats res{};
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_ssbo);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(occlusion_stats), &res);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return res;
+    }
+};
+
+#endif
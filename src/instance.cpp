@@ -16,6 +16,7 @@
 
 #include "vertices.h"
 #include "shader.h"
+#include "shader_watcher.h"
 #include "model.h"
 #include "texture.h"
 #include "gl_util.h"
@@ -196,6 +197,16 @@ struct light {
 static constexpr size_t instance_count = 100000;
 glm::mat4 model_matrices[instance_count];
 
+// points the instanced matrix attributes of the bound vertex array at the instance_vbo range starting at first_instance
+void set_instance_attributes(size_t first_instance) {
+    size_t base = first_instance * sizeof(glm::mat4);
+    for (GLuint col = 0; col < 4; ++col) {
+        glEnableVertexAttribArray(3 + col);
+        glVertexAttribPointer(3 + col, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*) (base + col * sizeof(glm::vec4)));
+        glVertexAttribDivisor(3 + col, 1);
+    }
+}
+
 int main(int, char * []) {
     sdl_window window(width, height, "LearnOpenGL");
 
@@ -205,6 +216,8 @@ int main(int, char * []) {
     }
 
     shader_program program{{GL_VERTEX_SHADER, "src/shaders/instance.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/instance.frag"}};
+    shader_watcher shader_watch;
+    shader_watch.add(program);
 
     model planet{"res/planet/planet.obj"};
     model rock{"res/rock/rock.obj"};
@@ -233,32 +246,20 @@ int main(int, char * []) {
         model_matrices[i] = model;
     }
 
+    // every rock mesh gets instance_count matrices, rewritten each frame sorted by the level each instance draws with
     GLuint instance_vbo;
     glGenBuffers(1, &instance_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
-    glBufferData(GL_ARRAY_BUFFER, instance_count * sizeof(glm::mat4), model_matrices, GL_STATIC_DRAW);
-    
-    for (size_t i = 0; i < rock.meshes.size(); ++i) {
-        glBindVertexArray(rock.meshes[i].vao);
-
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(glm::vec4), (void*) 0);
-        glVertexAttribDivisor(3, 1);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(glm::vec4), (void*) sizeof(glm::vec4));
-        glVertexAttribDivisor(4, 1);
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(glm::vec4), (void*) (2 * sizeof(glm::vec4)));
-        glVertexAttribDivisor(5, 1);
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(glm::vec4), (void*) (3 * sizeof(glm::vec4)));
-        glVertexAttribDivisor(6, 1);
-    }
+    glBufferData(GL_ARRAY_BUFFER, rock.meshes.size() * instance_count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+    std::vector<size_t> instance_lods(instance_count);
+    std::vector<glm::mat4> sorted_matrices(instance_count);
 
     glEnable(GL_DEPTH_TEST);
 
     while (window.running) {
         window.handle_events();
+        shader_watch.update();
 
         static float prev_time = window.get_time();
         float cur_time = window.get_time();
@@ -284,9 +285,32 @@ int main(int, char * []) {
 
         program.use();
         program.set_uniform("is_instanced", true);
+        lod_view lod_selection = lod_view::perspective(camera_pos, glm::radians(fov), height);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
         for (size_t i = 0; i < rock.meshes.size(); ++i) {
-            glBindVertexArray(rock.meshes[i].vao);
-            glDrawElementsInstanced(GL_TRIANGLES, rock.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, instance_count);
+            mesh& rock_mesh = rock.meshes[i];
+
+            // counting sort by level, every level is then one instanced draw over its range of the buffer
+            std::vector<size_t> first_instance(rock_mesh.lods.size() + 1, 0);
+            for (size_t j = 0; j < instance_count; ++j) {
+                instance_lods[j] = rock_mesh.select_lod(lod_selection, model_matrices[j]);
+                ++first_instance[instance_lods[j] + 1];
+            }
+            for (size_t l = 0; l < rock_mesh.lods.size(); ++l) first_instance[l + 1] += first_instance[l];
+            std::vector<size_t> next(first_instance.begin(), first_instance.end() - 1);
+            for (size_t j = 0; j < instance_count; ++j) sorted_matrices[next[instance_lods[j]]++] = model_matrices[j];
+
+            size_t base = i * instance_count;
+            glBufferSubData(GL_ARRAY_BUFFER, base * sizeof(glm::mat4), instance_count * sizeof(glm::mat4), sorted_matrices.data());
+
+            glBindVertexArray(rock_mesh.vao);
+            for (size_t l = 0; l < rock_mesh.lods.size(); ++l) {
+                GLsizei count = first_instance[l + 1] - first_instance[l];
+                if (count == 0) continue;
+                set_instance_attributes(base + first_instance[l]);
+                mesh_lod const& level = rock_mesh.lods[l];
+                glDrawElementsInstanced(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT, (void*) (level.first_index * sizeof(GLuint)), count);
+            }
         }
 
         window.swap_buffer();
@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <fstream>
 #include <iterator>
 #include <random>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
@@ -21,6 +25,14 @@
 #include "model.h"
 #include "texture.h"
 #include "gl_util.h"
+#include "gpu_timer.h"
+#include "hi_z.h"
+#include "camera_path.h"
+#include "occlusion_raster.h"
+#include "scene_graph.h"
+#include "reflection_probe.h"
+#include "shader_watcher.h"
+#include "probe_grid.h"
 
 static unsigned int width = 1920;
 static unsigned int height = 1080;
@@ -40,7 +52,16 @@ static bool use_ao{true};
 static bool is_day{false};
 static bool light_changed{true};
 static bool use_frag_tbn{false};
+static bool use_taa{true};
+static bool redraw_shadows{false};
+static bool use_probes{true};
+static bool use_lods{true};
+static bool use_occlusion_culling{true};
+static bool use_cpu_occlusion{false};
+static bool pick_requested{false};
+static bool uniform_count_requested{false};
 static const float gamma_strength{2.2f};
+static float const lod_pixel_error{1.0f};
 
 static float point_falloff = 0.0015f;
 static float const point_falloff_delta = 0.0001f;
@@ -71,13 +92,13 @@ struct sdl_window {
     SDL_GLContext context;
     bool running;
 
-    sdl_window(unsigned int width, unsigned int height, char const * title) : running(true) {
+    sdl_window(unsigned int width, unsigned int height, char const * title, bool hidden = false) : running(true) {
         if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
             std::cerr << "ERROR initializing SDL: " << SDL_GetError() << std::endl;
             std::exit(1);
         }
 
-        window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_FULLSCREEN);
+        window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | (hidden ? SDL_WINDOW_HIDDEN : SDL_WINDOW_FULLSCREEN));
 
         if (!window) {
             std::cerr << "ERROR creating SDL window: " << SDL_GetError() << std::endl;
@@ -88,8 +109,6 @@ struct sdl_window {
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
         SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
 
         int context_flags{0};
         SDL_GL_GetAttribute(SDL_GL_CONTEXT_FLAGS, &context_flags);
@@ -102,7 +121,7 @@ struct sdl_window {
             std::exit(1);
         }
 
-        SDL_SetRelativeMouseMode(SDL_TRUE);
+        if (!hidden) SDL_SetRelativeMouseMode(SDL_TRUE);
     }
 
     float get_time() {
@@ -125,11 +144,19 @@ struct sdl_window {
                         case SDL_SCANCODE_B: use_bloom = !use_bloom; break;
                         case SDL_SCANCODE_C: use_ao = !use_ao; break;
                         case SDL_SCANCODE_F: use_frag_tbn = !use_frag_tbn; break;
+                        case SDL_SCANCODE_G: use_probes = !use_probes; break;
+                        case SDL_SCANCODE_H: use_occlusion_culling = !use_occlusion_culling; break;
+                        case SDL_SCANCODE_I: pick_requested = true; break;
+                        case SDL_SCANCODE_K: use_cpu_occlusion = !use_cpu_occlusion; break;
+                        case SDL_SCANCODE_L: use_lods = !use_lods; break;
                         case SDL_SCANCODE_M: draw_magicube = !draw_magicube; break;
                         case SDL_SCANCODE_N: draw_hair = !draw_hair; break;
                         case SDL_SCANCODE_O: draw_outline_suit = !draw_outline_suit; break;
                         case SDL_SCANCODE_P: use_spotlight = !use_spotlight; break;
+                        case SDL_SCANCODE_Q: use_taa = !use_taa; break;
+                        case SDL_SCANCODE_R: redraw_shadows = true; break;
                         case SDL_SCANCODE_T: is_day = !is_day; light_changed = true; break;
+                        case SDL_SCANCODE_U: uniform_count_requested = true; break;
                         case SDL_SCANCODE_KP_MINUS: point_falloff -= point_falloff_delta; std::cout << std::to_string(point_falloff) << std::endl; break;
                         case SDL_SCANCODE_KP_PLUS: point_falloff += point_falloff_delta; std::cout << std::to_string(point_falloff) << std::endl; break;
                         default: break;
@@ -193,6 +220,18 @@ struct sdl_window {
     }
 };
 
+// sub-pixel jitter sequence for temporal AA
+float halton(int index, int base) {
+    float f = 1.0f;
+    float res = 0.0f;
+    while (index > 0) {
+        f /= base;
+        res += f * (index % base);
+        index /= base;
+    }
+    return res;
+}
+
 // TODO replace with dir_light.dir
 glm::vec3 const sunlight_dir = glm::normalize(glm::vec3{-0.2f, -1.0f, 0.1f});
 
@@ -205,6 +244,13 @@ glm::vec3 const spot_light_color = glm::pow(glm::vec3(1.0f), gamma_vec);
 struct environment {
     static constexpr size_t point_light_count{4};
 
+    // std140 layout of the lights block in common/lights.glsl
+    struct lights_std140 {
+        light_std140 dir_light;
+        light_std140 point_lights[point_light_count];
+        light_std140 spot_light;
+    };
+
     glm::vec3 const point_light_pos[point_light_count] = {
         glm::vec3(-124.0f, 25.0f, -44.0f),
         glm::vec3(-124.0f, 25.0f,  29.0f),
@@ -219,6 +265,7 @@ struct environment {
     light dir_light;
     light point_lights[point_light_count];
     light spot_light;
+    uniform_block<lights_std140> light_block{2};
 
     cubemap* skybox;
 
@@ -231,10 +278,48 @@ struct environment {
         omni_shadow_map{2048}
     };
 
-    env_map reflect_map{2048};
+    // what render_shadows() and render_scene() draw with, main() registers them with the shader watcher
+    shader_permutations depth{{{GL_VERTEX_SHADER, "src/shaders/depth.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/depth.frag"}}, material::feature_defines};
+    shader_permutations depth_cube{{{GL_VERTEX_SHADER, "src/shaders/depth_cube.vert"}, {GL_GEOMETRY_SHADER, "src/shaders/depth_cube.geom"}, {GL_FRAGMENT_SHADER, "src/shaders/depth_cube.frag"}}, material::feature_defines};
+    shader_program capture_program{{GL_VERTEX_SHADER, "src/shaders/main.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/main.frag"}};
+    shader_program capture_sky{{GL_VERTEX_SHADER, "src/shaders/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/sky.frag"}};
+    shader_program capture_lamp{{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}};
+
+    // render_shadows() times the maps and report_shadow_times() prints them once the GPU is done, so neither waits
+    gpu_timer dir_shadow_timer, omni_shadow_timer;
+    size_t dir_shadow_casters{0}, omni_shadow_casters{0};
+    bool shadow_times_pending{false};
+
+    // one probe per magicube
+    reflection_probe_set reflection_probes{{glm::vec3{10.0f, 25.0f, 0.0f}, glm::vec3{-60.0f, 25.0f, 0.0f}}, env_map_size(env_map_use::reflection)};
+
+    // light probes through the hall, day and night lighting are baked separately
+    static constexpr size_t probe_capture_size{64};
+    glm::vec3 const probe_grid_min{-120.0f, 10.0f, -40.0f};
+    glm::vec3 const probe_grid_max{110.0f, 100.0f, 35.0f};
+    glm::ivec3 const probe_grid_dims{8, 3, 3};
+    probe_grid day_probes{probe_grid_min, probe_grid_max, probe_grid_dims, probe_capture_size};
+    probe_grid night_probes{probe_grid_min, probe_grid_max, probe_grid_dims, probe_capture_size};
 
     float ev;
 
+    probe_grid& probes(bool day) {
+        return day ? day_probes : night_probes;
+    }
+
+    // bake artifact of a probe grid, stale once the scene's files, its shaders or the grid layout change
+    texture_cache probe_cache(bool day) const {
+        return {std::string("cache/sponza_") + (day ? "day" : "night") + ".probes", hash_values(
+            hash_shader("src/shaders/main.vert"),
+            hash_shader("src/shaders/main.frag"),
+            hash_shader("src/shaders/sky.frag"),
+            day, probe_capture_size,
+            probe_grid_min.x, probe_grid_min.y, probe_grid_min.z,
+            probe_grid_max.x, probe_grid_max.y, probe_grid_max.z,
+            probe_grid_dims.x, probe_grid_dims.y, probe_grid_dims.z
+        ), gltf_files("res/sponza_gltf/sponza.gltf")};
+    }
+
     void update(bool is_day, cubemap* skybox) {
         // set up day/night colors and skybox
         glm::vec3 point_light_color{warm_orange};
@@ -273,51 +358,62 @@ struct environment {
         glm::vec3 spot_light_strength{0.0f, 1.0f, 1.0f};
 
         // set up lights
-        dir_light = light{"dir_light", glm::vec3(0.0f), sunlight_dir, sunlight_color, sunlight_strength, 0.0f, 0.0f, 0.0f};
+        dir_light = light{glm::vec3(0.0f), sunlight_dir, sunlight_color, sunlight_strength, 0.0f, 0.0f, 0.0f};
 
         for (size_t i = 0; i < point_light_count; ++i) {
-            point_lights[i] = light{"point_lights[" + std::to_string(i) + "]", point_light_pos[i], glm::vec3(0.0f), point_light_color, point_light_strength, 0.0f, 0.0f, point_falloff};
+            point_lights[i] = light{point_light_pos[i], glm::vec3(0.0f), point_light_color, point_light_strength, 0.0f, 0.0f, point_falloff};
         }
 
-        spot_light = light{"spot_light", camera_pos, camera_front, spot_light_color, spot_light_strength, 0.0f, 0.0f, 0.03f};
+        spot_light = light{camera_pos, camera_front, spot_light_color, spot_light_strength, 0.0f, 0.0f, 0.03f,
+                           glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(15.0f))};
+
+        upload_lights();
     }
 
-    void setup(shader_program const& program) const {
-        dir_light.setup(program);
-        for (auto& point_light : point_lights) point_light.setup(program);
-        spot_light.setup(program);
-        program.set_uniforms("spot_light.cutoff", glm::cos(glm::radians(12.5f)), "spot_light.outer_cutoff", glm::cos(glm::radians(15.0f)));
+    // only the lights that changed are uploaded, usually just the spot light following the camera
+    void upload_lights() {
+        light_block.data.dir_light = dir_light.std140();
+        for (size_t i = 0; i < point_light_count; ++i) light_block.data.point_lights[i] = point_lights[i].std140();
+        light_block.data.spot_light = spot_light.std140();
+        light_block.update();
+        light_block.bind();
     }
 
-    void render_maps(shader_program const& program, GLuint vp_ubo, std::vector<std::pair<model*, glm::mat4>> geometry) const;
+    void render_shadows(constant_ring & constants, scene_graph const& scene);
+
+    void report_shadow_times(size_t object_count) {
+        if (!shadow_times_pending || !omni_shadow_timer.ready()) return;
+        std::cout << "shadow maps took " << dir_shadow_timer.latest_ms() << " ms for the " << dir_shadow.size << "^2 directional map with " << dir_shadow_casters
+                  << " of " << object_count << " objects, " << omni_shadow_timer.latest_ms() << " ms for " << point_light_count << " omni maps with "
+                  << omni_shadow_casters << " casters" << std::endl;
+        shadow_times_pending = false;
+    }
+
+    void update_reflections(constant_ring & constants, glm::vec3 camera_pos, std::vector<std::pair<model*, glm::mat4>> const& geometry, bool all_faces);
+    void bake_probes(constant_ring & constants, bool day, std::vector<std::pair<model*, glm::mat4>> const& geometry, size_t face_count);
 };
 
-void render_scene(environment const & env, glm::vec3 view_pos) {
-    static const shader_program program({{GL_VERTEX_SHADER, "src/shaders/main.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/main.frag"}});
-    static const shader_program sky({{GL_VERTEX_SHADER, "src/shaders/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/sky.frag"}});
-    static const shader_program lamp({{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}});
+void render_scene(environment const & env, constant_ring & constants, glm::vec3 view_pos, std::vector<std::pair<model*, glm::mat4>> const& geometry) {
+    shader_program const& program = env.capture_program;
+    shader_program const& sky = env.capture_sky;
+    shader_program const& lamp = env.capture_lamp;
 
-    static const model sponza{"res/sponza/sponza.obj"};
     static const vao sky_vao(vertices, 8, {{3, 0}});
     static const vao lamp_vao(vertices, 8, {{3, 0}});
 
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-
     // draw room
     program.use();
-    env.setup(program);
-    program.set_uniforms("use_spotlight", use_spotlight, "far", far, "light_space", env.light_space, "view_pos", view_pos, "model", model);
-    env.dir_shadow.activate(program, "dir_light.shadow_map", 6);
+    program.set_uniforms("use_spotlight", use_spotlight, "far", far, "light_space", env.light_space, "view_pos", view_pos);
+    env.dir_shadow.activate(program, "dir_shadow_map", 6);
     for (size_t i = 0; i < env.point_light_count; ++i) {
-        env.omni_shadows[i].activate(program, "point_lights[" + std::to_string(i) + "].shadow_cube", static_cast<int>(7 + i));
+        env.omni_shadows[i].activate(program, "point_shadow_cubes[" + std::to_string(i) + "]", static_cast<int>(7 + i));
     }
-    sponza.draw(program);
+    push_transforms(constants, geometry);
+    draw_geometry(program, geometry);
 
     // draw skybox
     sky.use();
-    model = glm::translate(glm::mat4(1.0f), view_pos);
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), view_pos);
     sky.set_uniforms("model", model, "tex", 0, "is_day", true);
     env.skybox->activate(GL_TEXTURE0);
     sky_vao.use();
@@ -351,35 +447,64 @@ void render_scene(environment const & env, glm::vec3 view_pos) {
     }
 }
 
-void environment::render_maps(shader_program const& program, GLuint vp_ubo, std::vector<std::pair<model*, glm::mat4>> geometry) const {
-    static const shader_program depth({{GL_VERTEX_SHADER, "src/shaders/depth.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/depth.frag"}});
-    static const shader_program depth_cube({{GL_VERTEX_SHADER, "src/shaders/depth_cube.vert"}, {GL_GEOMETRY_SHADER, "src/shaders/depth_cube.geom"}, {GL_FRAGMENT_SHADER, "src/shaders/depth_cube.frag"}});
-
-    glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-    glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(float), &ev);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
+// the lights never move, so the shadow maps only depend on the geometry, only the objects inside a light's
+// frustum or reach are drawn
+void environment::render_shadows(constant_ring & constants, scene_graph const& scene) {
     // draw directional shadow map
-    dir_shadow.render(depth, light_space, geometry);
+    std::vector<uint32_t> dir_casters = scene.query_frustum(light_space);
+    dir_shadow_casters = dir_casters.size();
+    dir_shadow_timer.begin();
+    dir_shadow.render(depth, light_space, [&]() { scene.draw_depth(depth, constants, dir_casters); });
+    dir_shadow_timer.end();
 
     // draw omni-directional shadow map
+    omni_shadow_casters = 0;
+    omni_shadow_timer.begin();
     for (size_t i =0; i < point_light_count; ++i) {
-        omni_shadows[i].render(depth_cube, point_light_pos[i], far, geometry);
+        std::vector<uint32_t> casters = scene.query_sphere(point_light_pos[i], omni_shadow_map::projection_far);
+        omni_shadow_casters += casters.size();
+        omni_shadows[i].render(depth_cube, point_light_pos[i], far, [&]() { scene.draw_depth(depth_cube, constants, casters); });
     }
+    omni_shadow_timer.end();
+    shadow_times_pending = true;
 
-    // draw reflection map
-    program.use();
-    program.set_uniforms("use_spotlight", false, "far", far, "light_space", light_space, "model", geometry[0].second);
-    dir_shadow.activate(program, "dir_light.shadow_map", 6);
-    for (size_t i =0; i < point_light_count; ++i) {
-        omni_shadows[i].activate(program, "point_lights[" + std::to_string(i) + "].shadow_cube", 7 + i);
+    glViewport(0, 0, width, height);
+}
+
+// refresh the reflection probes, all at once or within the per-frame face budget
+void environment::update_reflections(constant_ring & constants, glm::vec3 camera_pos, std::vector<std::pair<model*, glm::mat4>> const& geometry, bool all_faces) {
+    auto render_func = [this, &constants, &geometry](glm::vec3 pos) { render_scene(*this, constants, pos, geometry); };
+    if (all_faces) {
+        reflection_probes.render_all(constants, ev, render_func);
+    } else {
+        reflection_probes.update(camera_pos, constants, ev, render_func);
     }
-    reflect_map.render(glm::vec3{10.0f, 25.0f, 0.0f}, vp_ubo, [this](glm::vec3 pos) { render_scene(*this, pos); });
     glViewport(0, 0, width, height);
 }
 
-int main(int, char * []) {
-    sdl_window window(width, height, "LearnOpenGL");
+// bake up to face_count probe faces of the grid for the lighting that is currently set up
+void environment::bake_probes(constant_ring & constants, bool day, std::vector<std::pair<model*, glm::mat4>> const& geometry, size_t face_count) {
+    probes(day).bake(constants, ev, face_count, [this, &constants, &geometry](glm::vec3 pos) { render_scene(*this, constants, pos, geometry); });
+    glViewport(0, 0, width, height);
+}
+
+int main(int argc, char * argv[]) {
+    // --bake-probes writes the probe grids of both lighting setups to cache/ and exits without showing a window
+    bool const bake_only = argc > 1 && std::string(argv[1]) == "--bake-probes";
+    // --compact-vertices or --half-vertices load sponza with 20 byte vertices, see vertex_format
+    // --meshlets culls sponza's meshlets on the CPU for the g-pass, see mesh::draw_culled()
+    // --occlusion-bench flies camera_path without and with occlusion culling, prints g-pass times and exits
+    vertex_format sponza_format = vertex_format::full;
+    bool sponza_meshlets{false};
+    bool occlusion_bench{false};
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--compact-vertices") sponza_format = vertex_format::compact;
+        if (std::string(argv[i]) == "--half-vertices") sponza_format = vertex_format::compact_half;
+        if (std::string(argv[i]) == "--meshlets") sponza_meshlets = true;
+        if (std::string(argv[i]) == "--occlusion-bench") occlusion_bench = true;
+    }
+
+    sdl_window window(width, height, "LearnOpenGL", bake_only);
 
     if (!gladLoadGLLoader((GLADloadproc) SDL_GL_GetProcAddress)) {
         std::cerr << "Failed to initialize GLAD" << std::endl;
@@ -399,28 +524,48 @@ int main(int, char * []) {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glEnable(GL_CULL_FACE);
-    glEnable(GL_MULTISAMPLE);
 
-    static const shader_program program({{GL_VERTEX_SHADER, "src/shaders/main.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/main.frag"}});
-    static const shader_program lamp({{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}});
-    static const shader_program post({{GL_VERTEX_SHADER, "src/shaders/post.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/post.frag"}});
-    static const shader_program pre_post({{GL_VERTEX_SHADER, "src/shaders/pre_post.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pre_post.frag"}});
-    static const shader_program reflect({{GL_VERTEX_SHADER, "src/shaders/reflect.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/reflect.frag"}});
+    static shader_program program({{GL_VERTEX_SHADER, "src/shaders/main.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/main.frag"}});
+    static shader_program lamp({{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}});
+    static shader_program post({{GL_VERTEX_SHADER, "src/shaders/post.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/post.frag"}});
+    static shader_program pre_post({{GL_VERTEX_SHADER, "src/shaders/pre_post.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pre_post.frag"}});
+    static shader_program reflect({{GL_VERTEX_SHADER, "src/shaders/reflect.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/reflect.frag"}});
+
+    static shader_program sky({{GL_VERTEX_SHADER, "src/shaders/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/sky.frag"}});
 
-    static const shader_program depth({{GL_VERTEX_SHADER, "src/shaders/depth.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/depth.frag"}});
-    static const shader_program depth_cube({{GL_VERTEX_SHADER, "src/shaders/depth_cube.vert"}, {GL_GEOMETRY_SHADER, "src/shaders/depth_cube.geom"}, {GL_FRAGMENT_SHADER, "src/shaders/depth_cube.frag"}});
-    static const shader_program sky({{GL_VERTEX_SHADER, "src/shaders/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/sky.frag"}});
+    static shader_permutations g_pass({{GL_VERTEX_SHADER, "src/shaders/g_pass.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/g_pass.frag"}}, material::feature_defines);
+    static shader_program lit_pass({{GL_VERTEX_SHADER, "src/shaders/lit_pass.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lit_pass.frag"}});
+    static shader_program ssao({{GL_VERTEX_SHADER, "src/shaders/ssao.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/ssao.frag"}});
+    static shader_program blend({{GL_VERTEX_SHADER, "src/shaders/blend.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/blend.frag"}});
+    static shader_program taa({{GL_VERTEX_SHADER, "src/shaders/taa.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/taa.frag"}});
 
-    static const shader_program g_pass({{GL_VERTEX_SHADER, "src/shaders/g_pass.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/g_pass.frag"}});
-    static const shader_program lit_pass({{GL_VERTEX_SHADER, "src/shaders/lit_pass.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lit_pass.frag"}});
-    static const shader_program ssao({{GL_VERTEX_SHADER, "src/shaders/ssao.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/ssao.frag"}});
-    static const shader_program blur({{GL_VERTEX_SHADER, "src/shaders/blur.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/blur.frag"}});
-    static const shader_program blend({{GL_VERTEX_SHADER, "src/shaders/blend.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/blend.frag"}});
+    shader_watcher shader_watch;
+    for (auto program_ptr : {&program, &lamp, &post, &pre_post, &reflect, &sky, &lit_pass, &ssao, &blend, &taa}) {
+        shader_watch.add(*program_ptr);
+    }
+    shader_watch.add(g_pass);
 
     //model sponza{"res/sponza/sponza.obj"};
-    model sponza{"res/sponza_gltf/sponza.gltf"};
+    model sponza{"res/sponza_gltf/sponza.gltf", sponza_format, sponza_meshlets};
+    // the culled camera passes and the captures draw sponza's mesh list under the room transform while the scene graph
+    // below applies node transforms, the two only agree as long as those are all identity
+    if (!sponza.has_flat_nodes()) {
+        std::cerr << "ERROR sponza has node transforms, the culled and capture passes would ignore them" << std::endl;
+        std::exit(1);
+    }
     model nanosuit{"res/nanosuit/nanosuit.obj"};
 
+    // sponza's meshes with their node transforms, for culling, shadow casters and picking
+    scene_graph scene;
+    scene.add_model(sponza, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.75f, 0.0f)), -1, "sponza");
+    scene.update();
+
+    // every pass fetches each vertex at least once, the omni shadow maps amplify in the geometry shader
+    size_t const sponza_vertex_bytes = sponza.vertex_bytes();
+    std::cout << "sponza has " << sponza.vertex_count() << " vertices in " << sponza_vertex_bytes / 1024 << " KB of vertex buffers, "
+              << "the g-pass fetches at least " << sponza_vertex_bytes / 1024 << " KB per frame and a shadow update "
+              << (1 + environment::point_light_count) * sponza.depth_stream_bytes() / 1024 << " KB from the depth streams" << std::endl;
+
     cubemap sky_map{{"res/skybox/right.jpg", "res/skybox/left.jpg", "res/skybox/top.jpg", "res/skybox/bottom.jpg", "res/skybox/front.jpg", "res/skybox/back.jpg"}};
     cubemap star_map{{"res/starbox/right.png", "res/starbox/left.png", "res/starbox/top.png", "res/starbox/bottom.png", "res/starbox/front.png", "res/starbox/back.png"}};
 
@@ -431,7 +576,7 @@ int main(int, char * []) {
     glGenFramebuffers(1, &g_fb);
     glBindFramebuffer(GL_FRAMEBUFFER, g_fb);
     std::array<GLuint, 6> g_color_bufs;
-    std::array<GLenum, g_color_bufs.size()> g_color_attachments;
+    std::array<GLenum, g_color_bufs.size() + 1> g_color_attachments;
     glGenTextures(g_color_bufs.size(), g_color_bufs.data());
     for (size_t i = 0; i < g_color_bufs.size(); ++i) {
         glBindTexture(GL_TEXTURE_2D, g_color_bufs[i]);
@@ -443,14 +588,28 @@ int main(int, char * []) {
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, g_color_bufs[i], 0);
         g_color_attachments[i] = GL_COLOR_ATTACHMENT0 + i;
     }
+    // screen-space motion for temporal AA, kept out of g_color_bufs since only the TAA resolve reads it
+    GLuint g_velocity_buf;
+    glGenTextures(1, &g_velocity_buf);
+    glBindTexture(GL_TEXTURE_2D, g_velocity_buf);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + g_color_bufs.size(), GL_TEXTURE_2D, g_velocity_buf, 0);
+    g_color_attachments[g_color_bufs.size()] = GL_COLOR_ATTACHMENT0 + g_color_bufs.size();
     glDrawBuffers(g_color_attachments.size(), g_color_attachments.data());
     glBindTexture(GL_TEXTURE_2D, 0);
-    GLuint g_rbo;
-    glGenRenderbuffers(1, &g_rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, g_rbo);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, 8, GL_DEPTH24_STENCIL8, width, height);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, g_rbo);
+    // a texture rather than a renderbuffer so the occlusion culler can build its depth pyramid from it
+    GLuint g_depth_buf;
+    glGenTextures(1, &g_depth_buf);
+    glBindTexture(GL_TEXTURE_2D, g_depth_buf);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, g_depth_buf, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cerr << "ERROR: g_fb lacking completeness" << std::endl;
     }
@@ -478,15 +637,65 @@ int main(int, char * []) {
     };
 
     framebuffer pp_fb(width, height);
+    // the forward passes drawn over the lit g-pass write their own motion into the velocity buffer
+    glBindFramebuffer(GL_FRAMEBUFFER, pp_fb.id);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, g_velocity_buf, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // ping-pong history for temporal AA
+    std::array<framebuffer, 2> taa_fbs{
+        framebuffer(width, height, false),
+        framebuffer(width, height, false)
+    };
+    size_t taa_idx{0};
+    bool taa_history_valid{false};
+    int taa_frame{0};
+    static constexpr int taa_sample_count = 8;
+    glm::mat4 prev_view_projection{1.0f};
 
     environment env;
+    for (auto program_ptr : {&env.capture_program, &env.capture_sky, &env.capture_lamp}) {
+        shader_watch.add(*program_ptr);
+    }
+    shader_watch.add(env.depth);
+    shader_watch.add(env.depth_cube);
+    std::cout << "reflection probes use " << env.reflection_probes.vram_bytes() / 1024 << " KB of VRAM" << std::endl;
+
+    // camera blocks of every view rendered in a frame
+    constant_ring constants;
+
+    if (bake_only) {
+        glm::mat4 room = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.75f, 0.0f));
+        constants.begin_frame();
+        env.render_shadows(constants, scene);
+        constants.end_frame();
+        for (bool day : {false, true}) {
+            auto bake_start = std::chrono::steady_clock::now();
+            is_day = day;
+            env.update(is_day, is_day ? &sky_map : &star_map);
+            env.probes(day).invalidate();
+            // a probe per ring frame, the whole grid wouldn't fit in one
+            while (!env.probes(day).complete()) {
+                constants.begin_frame();
+                env.bake_probes(constants, day, {{&sponza, room}}, 6);
+                constants.end_frame();
+            }
+            texture_cache cache = env.probe_cache(day);
+            env.probes(day).save(cache);
+            std::cout << "baked " << env.probes(day).probe_count() << " probes into " << cache.path << " in "
+                      << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - bake_start).count() << " ms" << std::endl;
+        }
+        env.report_shadow_times(scene.objects.size());
+        return 0;
+    }
 
-    GLuint vp_ubo;
-    glGenBuffers(1, &vp_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4) + sizeof(float), NULL, GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, vp_ubo);
+    for (bool day : {false, true}) {
+        texture_cache cache = env.probe_cache(day);
+        if (env.probes(day).load(cache)) {
+            std::cout << "probe grid loaded from " << cache.path << std::endl;
+        }
+    }
+    std::cout << "probe grids use " << (env.day_probes.vram_bytes() + env.night_probes.vram_bytes()) / 1024 << " KB of VRAM" << std::endl;
 
     std::uniform_real_distribution<float> random_float(0.0f, 1.0f);
     std::default_random_engine gen;
@@ -526,15 +735,40 @@ int main(int, char * []) {
     glBindTexture(GL_TEXTURE_2D, 0);
 
     framebuffer ssao_fb{width, height, false};
-    ssao_fb.filter(GL_NEAREST);
 
-    framebuffer ssao_blur_fb{width, height, false};
+    // RGBA16F so the compute blur can write it directly
+    framebuffer ssao_blur_fb{width, height, false, GL_RGBA16F};
     ssao_blur_fb.filter(GL_NEAREST);
 
+    // radius 4 covers the 4x4 noise tile, at full resolution the compute variant shares every fetch between the
+    // taps of a work group, the linear variant needs filtered sources
+    gaussian_blur ssao_blur{blur_type::compute, 4};
+    gaussian_blur bloom_blur{blur_type::linear, 2};
+    shader_watch.add(ssao_blur.program);
+    shader_watch.add(bloom_blur.program);
+
+    occlusion_culler occlusion{sponza, width, height};
+    shader_watch.add(occlusion.program);
+    shader_watch.add(occlusion.pyramid.program);
+
+    camera_path const bench_path;
+    static constexpr size_t bench_frames = 600; // per run, the path is flown without and then with occlusion culling
+    size_t bench_frame{0};
+    double bench_g_pass_ms[2]{0.0, 0.0};
+    double bench_culled_percent{0.0};
+    static gpu_timer g_pass_timer;
+
     bool first = true;
 
     while (window.running) {
         window.handle_events();
+        shader_watch.update();
+        constants.begin_frame();
+
+        if (occlusion_bench) {
+            std::tie(camera_pos, camera_front) = bench_path.at(static_cast<float>(bench_frame % bench_frames) / (bench_frames - 1));
+            use_occlusion_culling = bench_frame >= bench_frames;
+        }
 
         //static float prev_time = window.get_time();
         //float cur_time = window.get_time();
@@ -549,7 +783,6 @@ int main(int, char * []) {
         program.use();
 
         env.update(is_day, is_day ? &sky_map : &star_map);
-        env.setup(program);
 
         // set up matrices
         glm::mat4 light_projection = glm::ortho(-350.0f, 420.0f, -230.0f, 250.0f, 10.0f, 600.0f);
@@ -560,35 +793,107 @@ int main(int, char * []) {
         glm::mat4 view = glm::lookAt(camera_pos, camera_pos + camera_front, camera_up);
         glm::mat4 model;
 
+        // velocities are computed from unjittered matrices, the jitter only offsets the rasterized samples
+        glm::mat4 view_projection = projection * view;
+        if (first || !taa_history_valid) prev_view_projection = view_projection;
+        if (use_taa) {
+            taa_frame = (taa_frame + 1) % taa_sample_count;
+            projection[2][0] += (2.0f * halton(taa_frame + 1, 2) - 1.0f) / width;
+            projection[2][1] += (2.0f * halton(taa_frame + 1, 3) - 1.0f) / height;
+        }
+
         // prepare room
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f));
         //model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
 
         program.use();
-        program.set_uniforms("use_spotlight", use_spotlight, "far", far, "light_space", light_space, "view_pos", camera_pos, "model", model);
-
-        // TODO find a better place/way to render these cubemaps
-        if (first || light_changed) {
-            env.render_maps(program, vp_ubo, {{&sponza, model}});
+        program.set_uniforms("use_spotlight", use_spotlight, "far", far, "light_space", light_space, "view_pos", camera_pos);
 
+        // probe captures are spread over frames, only the first one happens at once
+        // R redraws them, for timing with warm caches
+        if (first || redraw_shadows) {
+            env.render_shadows(constants, scene);
+            redraw_shadows = false;
+        }
+        if (light_changed) {
+            env.reflection_probes.invalidate();
             light_changed = false;
         }
+        env.update_reflections(constants, camera_pos, {{&sponza, model}}, first);
 
-        glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(view));
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projection));
-        glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(float), &env.ev);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        // without a bake artifact the probes of the current lighting are baked a few faces per frame
+        if (!env.probes(is_day).complete()) {
+            env.bake_probes(constants, is_day, {{&sponza, model}}, 2);
+            if (env.probes(is_day).complete()) env.probes(is_day).save(env.probe_cache(is_day));
+        }
+
+        push_vp(constants, view, projection, env.ev);
+        push_transforms(constants, {model});
+
+        // I reports the triangle under the crosshair and which lamps light it
+        if (pick_requested) {
+            float distance = far;
+            int64_t picked = scene.pick(camera_pos, camera_front, distance);
+            if (picked >= 0) {
+                scene_graph::object const& o = scene.objects[picked];
+                ray_hit hit = scene.intersect(o, {camera_pos, camera_front, distance * 1.001f});
+                // pulled back towards the camera so the surface itself doesn't block the lamps
+                glm::vec3 point = camera_pos + camera_front * (distance - 0.01f);
+                std::cout << "picked triangle " << hit.triangle << " of mesh " << o.mesh << " of node " << scene.nodes[o.node].name << " at " << distance
+                          << ", seen by lamps";
+                for (size_t i = 0; i < env.point_light_count; ++i) {
+                    if (!scene.occluded(env.point_light_pos[i], point)) std::cout << " " << i;
+                }
+                std::cout << std::endl;
+            } else {
+                std::cout << "picked nothing" << std::endl;
+            }
+            pick_requested = false;
+        }
 
         // draw room (g-pass)
         glViewport(0, 0, width, height);
         glBindFramebuffer(GL_FRAMEBUFFER, g_fb);
-        g_pass.use();
-        g_pass.set_uniforms("model", model, "use_frag_tbn", use_frag_tbn);
+        g_pass.set_shared_uniforms([=](shader_program const& program) {
+            program.set_uniform("use_frag_tbn", use_frag_tbn);
+            program.set_uniforms("view_projection", view_projection, "prev_view_projection", prev_view_projection);
+        });
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        static float const zero_velocity[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, g_color_bufs.size(), zero_velocity);
         glDisable(GL_BLEND);
-        sponza.draw(g_pass);
+        // only the camera's passes use simplified levels, shadows and probes keep full detail
+        if (use_lods) sponza.select_lods(lod_view::perspective(camera_pos, glm::radians(fov), height, lod_pixel_error), model);
+        g_pass_timer.begin();
+        if (use_occlusion_culling) {
+            occlusion.draw(g_pass, g_depth_buf, model, projection * view, camera_pos);
+        } else {
+            occlusion.invalidate();
+            // K swaps in the CPU rasterised occluders, for when the GPU culling is off
+            if (use_cpu_occlusion) {
+                static auto const sponza_occluders = sponza.occluders(model);
+                static occlusion_rasterizer rasterizer;
+                static double raster_ms{0.0};
+                static size_t raster_frames{0};
+                auto raster_start = std::chrono::steady_clock::now();
+                rasterizer.render(sponza_occluders, projection * view);
+                depth_pyramid cpu_hi_z = rasterizer.pyramid();
+                raster_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - raster_start).count();
+                if (++raster_frames == 256) {
+                    std::cout << "software occlusion: " << sponza_occluders.size() << " occluders in " << raster_ms / raster_frames << " ms per frame" << std::endl;
+                    raster_ms = 0.0;
+                    raster_frames = 0;
+                }
+                sponza.draw_culled(g_pass, constants, cull_view::perspective(projection * view, camera_pos, &cpu_hi_z), model);
+            } else if (sponza_meshlets) {
+                sponza.draw_culled(g_pass, constants, cull_view::perspective(projection * view, camera_pos), model);
+            } else {
+                scene.draw(g_pass, constants, scene.query_frustum(projection * view));
+            }
+        }
+        g_pass_timer.end();
+        sponza.reset_lods();
         glEnable(GL_BLEND);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -607,13 +912,10 @@ int main(int, char * []) {
         render_to_buffer(ssao, ssao_fb, ssao_textures);
 
         // blur ssao
-        blur.use();
-        blur.set_uniform("tex", 0);
-        render_to_buffer(blur, ssao_blur_fb, {ssao_fb.color_buf});
+        ssao_blur.apply(ssao_fb, ssao_blur_fb);
 
         // light g-pass
         lit_pass.use();
-        env.setup(lit_pass);
         lit_pass.set_uniforms("light_space", light_space, "far", far, "use_spotlight", use_spotlight, "use_ao", use_ao, "view_pos", camera_pos);
         std::vector<GLuint> lit_textures;
         for (size_t i = 0; i < g_color_bufs.size(); ++i) {
@@ -623,10 +925,12 @@ int main(int, char * []) {
         lit_textures.push_back(ssao_blur_fb.color_buf);
         lit_pass.set_uniform("ssao", static_cast<int>(g_color_bufs.size()));
         static constexpr int shadow_tex_idx = g_color_bufs.size() + 1;
-        env.dir_shadow.activate(lit_pass, "dir_light.shadow_map", shadow_tex_idx);
+        env.dir_shadow.activate(lit_pass, "dir_shadow_map", shadow_tex_idx);
         for (size_t i = 0; i < env.point_light_count; ++i) {
-            env.omni_shadows[i].activate(lit_pass, "point_lights[" + std::to_string(i) + "].shadow_cube", static_cast<int>(shadow_tex_idx + 1 + i));
+            env.omni_shadows[i].activate(lit_pass, "point_shadow_cubes[" + std::to_string(i) + "]", static_cast<int>(shadow_tex_idx + 1 + i));
         }
+        env.probes(is_day).activate(lit_pass, static_cast<int>(shadow_tex_idx + 1 + env.point_light_count));
+        lit_pass.set_uniform("use_probes", use_probes && env.probes(is_day).complete());
         render_to_buffer(lit_pass, pp_fb, lit_textures);
 
         // blit g-pass depth and stencil buffer
@@ -635,6 +939,16 @@ int main(int, char * []) {
         glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
         glBindFramebuffer(GL_FRAMEBUFFER, pp_fb.id);
 
+        // sky, lamps, the suit and the magicubes also write velocity, unblended, so TAA doesn't reproject them
+        // with the g-pass's cleared zero motion
+        static GLenum const forward_attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, forward_attachments);
+        glDisablei(GL_BLEND, 1);
+        for (auto forward_program : {&sky, &lamp, &program, &reflect}) {
+            forward_program->use();
+            forward_program->set_uniforms("view_projection", view_projection, "prev_view_projection", prev_view_projection);
+        }
+
         // draw skybox
         static const vao sky_vao(vertices, 8, {{3, 0}});
         sky.use();
@@ -679,30 +993,45 @@ int main(int, char * []) {
             model = glm::translate(model, glm::vec3(120.0f, -1.75f, 20.0f));
             model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
             model = glm::scale(model, glm::vec3(2.0f, 2.0f, 2.0f));
-            program.use();
-            program.set_uniform("model", model);
+            push_transforms(constants, {model});
             lamp.use();
             lamp.set_uniforms("model", model, "color", warm_orange);
             nanosuit.draw_outlined(program, lamp);
             nanosuit.draw(program);
         }
 
-        // draw magicube
+        // draw magicubes
         if (draw_magicube) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(10.0f, 25.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(5.0f));
             reflect.use();
-            reflect.set_uniforms("model", model, "camera_pos", camera_pos);
-            env.reflect_map.activate(reflect, "tex", 0);
             cube_vao.use();
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            for (auto& probe : env.reflection_probes.probes) {
+                model = glm::mat4(1.0f);
+                model = glm::translate(model, probe.pos);
+                model = glm::scale(model, glm::vec3(5.0f));
+                reflect.set_uniforms("model", model, "camera_pos", camera_pos);
+                probe.activate(reflect, "tex", "prev_tex", "blend", 0);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            }
+        }
+        glDrawBuffers(1, forward_attachments);
+        glEnablei(GL_BLEND, 1);
+
+        // resolve temporal AA before bloom so the bright-pass sees a stable image
+        framebuffer resolved_fb = pp_fb;
+        if (use_taa) {
+            taa.use();
+            taa.set_uniforms("tex", 0, "history", 1, "velocity", 2, "use_history", taa_history_valid, "feedback", 0.9f);
+            render_to_buffer(taa, taa_fbs[taa_idx], {pp_fb.color_buf, taa_fbs[1 - taa_idx].color_buf, g_velocity_buf});
+            resolved_fb = taa_fbs[taa_idx];
+            taa_idx = 1 - taa_idx;
         }
+        taa_history_valid = use_taa;
+        prev_view_projection = view_projection;
 
         // extract and downscale bloom
         pre_post.use();
         pre_post.set_uniforms("user_ev", env.ev, "tex", 0);
-        render_to_buffer(pre_post, bloom_fbs[0], {pp_fb.color_buf});
+        render_to_buffer(pre_post, bloom_fbs[0], {resolved_fb.color_buf});
         for (size_t i = 1; i < bloom_fbs.size(); ++i) {
             blit_buffer(bloom_fbs[i - 1], bloom_fbs[i], GL_COLOR_ATTACHMENT0);
         }
@@ -710,20 +1039,47 @@ int main(int, char * []) {
         // blur and upscale bloom
         constexpr static int bloom_levels = 4;
         for (int i = bloom_levels; i >= 0; --i) {
+            framebuffer const& small_fb = i == bloom_levels ? bloom_fbs[i + 1] : blend_fbs[i + 1];
+            bloom_blur.apply(small_fb, small_fb);
             blend.use();
             blend.set_uniforms("large", 0, "small", 1);
-            render_to_buffer(blend, blend_fbs[i], {bloom_fbs[i].color_buf, (i == bloom_levels ? bloom_fbs[i + 1] : blend_fbs[i + 1]).color_buf});
+            render_to_buffer(blend, blend_fbs[i], {bloom_fbs[i].color_buf, small_fb.color_buf});
         }
+        if (use_bloom) bloom_blur.apply(blend_fbs[0], blend_fbs[0]);
 
         // render to screen FB
-        // TODO look into temporal AA to reduce bloom shimmer
         post.use();
         post.set_uniforms("width", static_cast<float>(width), "height", static_cast<float>(height), "gamma", gamma_strength, "exposure", 1.0f);
         post.set_uniforms("user_ev", env.ev, "tex", 0, "bloom", 1, "use_bloom", use_bloom, "DEBUG", false);
-        render_to_buffer(post, 0, width, height, {pp_fb.color_buf, blend_fbs[0].color_buf});
+        render_to_buffer(post, 0, width, height, {resolved_fb.color_buf, blend_fbs[0].color_buf});
 
+        constants.end_frame();
         window.swap_buffer();
 
+        // U prints the set_uniform() calls of the frame it was pressed in
+        if (uniform_count_requested) {
+            std::cout << shader_program::uniform_calls << " uniform calls this frame" << std::endl;
+            uniform_count_requested = false;
+        }
+        shader_program::uniform_calls = 0;
+
+        env.report_shadow_times(scene.objects.size());
+
+        // the g-pass timer has the previous frame's time, the last frame's is waited for, reading the culling stats
+        // stalls on the GPU every frame, fine for comparing the two runs
+        if (occlusion_bench) {
+            bool culled = bench_frame >= bench_frames;
+            if (bench_frame > 0) bench_g_pass_ms[bench_frame - 1 >= bench_frames] += g_pass_timer.elapsed_ms();
+            if (bench_frame + 1 == 2 * bench_frames) bench_g_pass_ms[1] += g_pass_timer.latest_ms();
+            if (culled) bench_culled_percent += occlusion.read_stats().culled_percent();
+            if (++bench_frame == 2 * bench_frames) {
+                std::cout << "g-pass over " << bench_frames << " frames of the camera path: " << bench_g_pass_ms[0] / bench_frames
+                          << " ms without and " << bench_g_pass_ms[1] / bench_frames << " ms with occlusion culling, which culled "
+                          << bench_culled_percent / bench_frames << "% of the triangles" << std::endl;
+                window.running = false;
+            }
+        }
+
         if (first) first = false;
     }
 
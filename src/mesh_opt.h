@@ -0,0 +1,360 @@
+#ifndef MESH_OPT_H
+#define MESH_OPT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// post-transform cache behaviour of an index order, acmr is cache misses per triangle (3 without any reuse, around 0.6
+// for well ordered regular meshes), atvr is misses per vertex (1 when every vertex is transformed exactly once)
+struct vertex_cache_stats {
+    float acmr;
+    float atvr;
+};
+
+// replays indices through a FIFO cache of cache_size vertices like the fixed function caches the metrics come from
+inline vertex_cache_stats simulate_vertex_cache(std::vector<GLuint> const& indices, size_t vertex_count, size_t cache_size = 16) {
+    // a vertex is cached if fewer than cache_size vertices entered after it
+    std::vector<size_t> entered(vertex_count, 0);
+    size_t misses{0};
+    for (GLuint v : indices) {
+        if (entered[v] == 0 || misses - entered[v] >= cache_size) entered[v] = ++misses;
+    }
+
+    size_t tri_count = indices.size() / 3;
+    return {tri_count ? static_cast<float>(misses) / tri_count : 0.0f, vertex_count ? static_cast<float>(misses) / vertex_count : 0.0f};
+}
+
+// drops triangles repeating an index, unlike aiProcess_FindDegenerates zero area triangles between distinct vertices stay
+inline void remove_degenerate_triangles(std::vector<GLuint>& indices) {
+    size_t out{0};
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        GLuint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a == b || b == c || c == a) continue;
+        indices[out++] = a;
+        indices[out++] = b;
+        indices[out++] = c;
+    }
+    indices.resize(out);
+}
+
+// vertex score of Forsyth's "Linear-Speed Vertex Cache Optimisation": vertices of the last triangle get a fixed score
+// so the next triangle doesn't just reuse its edge, older cache entries fall off smoothly, and vertices with few
+// triangles left get a boost so they are finished off instead of leaving isolated triangles behind
+inline float vertex_cache_score(int cache_pos, uint32_t remaining_tris, size_t cache_size) {
+    if (remaining_tris == 0) return -1.0f;
+
+    float score{0.0f};
+    if (cache_pos >= 0) {
+        if (cache_pos < 3) {
+            score = 0.75f;
+        } else {
+            score = std::pow(1.0f - (cache_pos - 3) / static_cast<float>(cache_size - 3), 1.5f);
+        }
+    }
+    return score + 2.0f / std::sqrt(static_cast<float>(remaining_tris));
+}
+
+// reorder a triangle list so consecutive triangles share vertices while they are still in the post-transform cache,
+// greedily emits the best scoring triangle next to the modelled LRU cache of cache_size entries
+inline void optimize_vertex_cache(std::vector<GLuint>& indices, size_t vertex_count, size_t cache_size = 32) {
+    size_t tri_count = indices.size() / 3;
+    if (tri_count == 0) return;
+
+    // active triangles of vertex v are vertex_tris[offsets[v], offsets[v] + remaining[v])
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (GLuint idx : indices) ++offsets[idx + 1];
+    for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    std::vector<uint32_t> vertex_tris(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        GLuint v = indices[i];
+        vertex_tris[offsets[v] + remaining[v]++] = i / 3;
+    }
+
+    std::vector<int> cache_pos(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) vertex_score[v] = vertex_cache_score(-1, remaining[v], cache_size);
+
+    std::vector<float> tri_score(tri_count);
+    for (size_t t = 0; t < tri_count; ++t) {
+        tri_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+    }
+
+    std::vector<bool> emitted(tri_count, false);
+    std::vector<GLuint> cache, next_cache;
+    cache.reserve(cache_size + 3);
+    next_cache.reserve(cache_size + 3);
+
+    std::vector<GLuint> res;
+    res.reserve(indices.size());
+
+    size_t next_unemitted{0};
+    long best{-1};
+    while (res.size() < indices.size()) {
+        // nothing in the cache touches a triangle that's left, restart from the first triangle not emitted yet
+        if (best < 0) {
+            while (emitted[next_unemitted]) ++next_unemitted;
+            best = next_unemitted;
+        }
+
+        emitted[best] = true;
+        GLuint const * tri = &indices[3 * best];
+        next_cache.assign(tri, tri + 3);
+        for (size_t i = 0; i < 3; ++i) {
+            GLuint v = tri[i];
+            res.push_back(v);
+
+            uint32_t * begin = &vertex_tris[offsets[v]];
+            uint32_t * end = begin + remaining[v];
+            for (uint32_t * it = begin; it != end; ++it) {
+                if (*it == static_cast<uint32_t>(best)) {
+                    *it = *(end - 1);
+                    --remaining[v];
+                    break;
+                }
+            }
+        }
+        for (GLuint v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+        }
+
+        // vertices pushed out of the cache are rescored too, their triangles lose the cache bonus
+        for (size_t i = 0; i < next_cache.size(); ++i) {
+            GLuint v = next_cache[i];
+            cache_pos[v] = i < cache_size ? static_cast<int>(i) : -1;
+            vertex_score[v] = vertex_cache_score(cache_pos[v], remaining[v], cache_size);
+        }
+
+        best = -1;
+        float best_score{-1.0f};
+        for (GLuint v : next_cache) {
+            for (uint32_t k = 0; k < remaining[v]; ++k) {
+                uint32_t t = vertex_tris[offsets[v] + k];
+                tri_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+                if (tri_score[t] > best_score) {
+                    best_score = tri_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (next_cache.size() > cache_size) next_cache.resize(cache_size);
+        std::swap(cache, next_cache);
+    }
+
+    indices = std::move(res);
+}
+
+// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak): emits the fan
+// around a vertex, then continues at the neighbour that stays cached longest once its own triangles are emitted, returns
+// the first triangle after every jump to a vertex out of the cache, the hard cluster boundaries for optimize_overdraw()
+inline std::vector<size_t> optimize_vertex_cache_tipsify(std::vector<GLuint>& indices, size_t vertex_count, size_t cache_size = 16) {
+    std::vector<size_t> boundaries;
+    size_t tri_count = indices.size() / 3;
+    if (tri_count == 0) return boundaries;
+
+    // triangles of vertex v are vertex_tris[offsets[v], offsets[v + 1])
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (GLuint idx : indices) ++offsets[idx + 1];
+    for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> live(vertex_count, 0); // triangles not emitted yet
+    std::vector<uint32_t> vertex_tris(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        GLuint v = indices[i];
+        vertex_tris[offsets[v] + live[v]++] = i / 3;
+    }
+
+    std::vector<size_t> cached_at(vertex_count, 0);
+    std::vector<bool> emitted(tri_count, false);
+    std::vector<GLuint> dead_ends;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> res;
+    res.reserve(indices.size());
+
+    size_t time{cache_size + 1};
+    size_t cursor{0}; // restarts scan the vertices from here once the dead end stack is empty
+    long fan{0};
+    while (fan >= 0) {
+        candidates.clear();
+        for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; ++k) {
+            uint32_t t = vertex_tris[k];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+
+            for (size_t i = 0; i < 3; ++i) {
+                GLuint v = indices[3 * t + i];
+                res.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cached_at[v] > cache_size) cached_at[v] = time++;
+            }
+        }
+
+        // the oldest candidate that is still cached after its fan, else any candidate with triangles left
+        fan = -1;
+        long best_priority{-1};
+        for (GLuint v : candidates) {
+            if (live[v] == 0) continue;
+            size_t age = time - cached_at[v];
+            long priority = age + 2 * live[v] <= cache_size ? static_cast<long>(age) : 0;
+            if (priority > best_priority) {
+                best_priority = priority;
+                fan = v;
+            }
+        }
+
+        if (fan < 0) {
+            while (!dead_ends.empty() && fan < 0) {
+                GLuint v = dead_ends.back();
+                dead_ends.pop_back();
+                if (live[v] > 0) fan = v;
+            }
+            for (; fan < 0 && cursor < vertex_count; ++cursor) {
+                if (live[cursor] > 0) fan = cursor;
+            }
+        }
+        if (fan >= 0 && time - cached_at[fan] > cache_size) boundaries.push_back(res.size() / 3);
+    }
+
+    indices = std::move(res);
+    return boundaries;
+}
+
+// reorders clusters of consecutive triangles so those facing away from the mesh centre are drawn first, they tend to
+// occlude the rest, clusters end at the hard boundaries and wherever the running acmr of the cluster drops below
+// threshold times the acmr of the whole order, so splitting costs little cache efficiency
+template<typename Vertex>
+void optimize_overdraw(std::vector<GLuint>& indices, std::vector<Vertex> const& vertices, std::vector<size_t> const& hard_boundaries,
+                       float threshold = 1.05f, size_t cache_size = 16) {
+    size_t tri_count = indices.size() / 3;
+    if (tri_count == 0) return;
+
+    float limit = threshold * simulate_vertex_cache(indices, vertices.size(), cache_size).acmr;
+
+    // same FIFO as simulate_vertex_cache(), restarted for every cluster
+    std::vector<size_t> cluster_starts{0};
+    std::vector<size_t> entered(vertices.size(), 0);
+    size_t misses{0};
+    size_t cluster_misses_base{0};
+    auto next_hard = hard_boundaries.begin();
+    for (size_t t = 0; t < tri_count; ++t) {
+        if (next_hard != hard_boundaries.end() && *next_hard == t) {
+            ++next_hard;
+            if (t != cluster_starts.back()) {
+                cluster_starts.push_back(t);
+                cluster_misses_base = misses;
+            }
+        }
+
+        for (size_t i = 0; i < 3; ++i) {
+            GLuint v = indices[3 * t + i];
+            if (entered[v] <= cluster_misses_base || misses - entered[v] >= cache_size) entered[v] = ++misses;
+        }
+
+        size_t cluster_tris = t + 1 - cluster_starts.back();
+        if (t + 1 < tri_count && static_cast<float>(misses - cluster_misses_base) / cluster_tris < limit) {
+            cluster_starts.push_back(t + 1);
+            cluster_misses_base = misses;
+        }
+    }
+    cluster_starts.push_back(tri_count);
+
+    // area weighted centroid and normal of every cluster
+    size_t cluster_count = cluster_starts.size() - 1;
+    std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.0f));
+    std::vector<float> areas(cluster_count, 0.0f);
+    glm::vec3 mesh_centroid{0.0f};
+    float mesh_area{0.0f};
+    for (size_t c = 0; c < cluster_count; ++c) {
+        for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; ++t) {
+            glm::vec3 a = vertices[indices[3 * t]].pos, b = vertices[indices[3 * t + 1]].pos, d = vertices[indices[3 * t + 2]].pos;
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float area = glm::length(n);
+            normals[c] += n;
+            centroids[c] += area * (a + b + d) / 3.0f;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+        if (areas[c] > 0.0f) centroids[c] /= areas[c];
+    }
+    if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+    std::vector<float> keys(cluster_count, 0.0f);
+    for (size_t c = 0; c < cluster_count; ++c) {
+        float normal_length = glm::length(normals[c]);
+        if (normal_length > 0.0f) keys[c] = glm::dot(centroids[c] - mesh_centroid, normals[c] / normal_length);
+    }
+
+    std::vector<size_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<GLuint> res;
+    res.reserve(indices.size());
+    for (size_t c : order) {
+        res.insert(res.end(), indices.begin() + 3 * cluster_starts[c], indices.begin() + 3 * cluster_starts[c + 1]);
+    }
+    indices = std::move(res);
+}
+
+// renumbers vertices in order of first use so vertex fetches walk the buffer front to back, unreferenced vertices are dropped
+template<typename Vertex>
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+    static constexpr GLuint unused = ~0u;
+
+    std::vector<GLuint> remap(vertices.size(), unused);
+    std::vector<Vertex> res;
+    res.reserve(vertices.size());
+    for (GLuint& idx : indices) {
+        if (remap[idx] == unused) {
+            remap[idx] = res.size();
+            res.push_back(vertices[idx]);
+        }
+        idx = remap[idx];
+    }
+    vertices = std::move(res);
+}
+
+enum class cache_optimizer {
+    forsyth, // lowest acmr, no overdraw ordering
+    tipsify  // a little higher acmr, but its restarts give the clusters for overdraw ordering
+};
+
+struct mesh_opt_stats {
+    size_t triangle_count;
+    vertex_cache_stats before;
+    vertex_cache_stats after;
+};
+
+// full post-import pass on a triangle list, the stats are measured on a 16 entry FIFO either way
+template<typename Vertex>
+mesh_opt_stats optimize_mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, cache_optimizer optimizer = cache_optimizer::tipsify, float overdraw_threshold = 1.05f) {
+    static constexpr size_t stats_cache_size = 16;
+
+    remove_degenerate_triangles(indices);
+    vertex_cache_stats before = simulate_vertex_cache(indices, vertices.size(), stats_cache_size);
+
+    if (optimizer == cache_optimizer::tipsify) {
+        std::vector<size_t> boundaries = optimize_vertex_cache_tipsify(indices, vertices.size(), stats_cache_size);
+        optimize_overdraw(indices, vertices, boundaries, overdraw_threshold, stats_cache_size);
+    } else {
+        optimize_vertex_cache(indices, vertices.size());
+    }
+    optimize_vertex_fetch(vertices, indices);
+
+    return {indices.size() / 3, before, simulate_vertex_cache(indices, vertices.size(), stats_cache_size)};
+}
+
+#endif
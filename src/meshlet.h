@@ -0,0 +1,229 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "depth_pyramid.h"
+
+// a run of at most 64 vertices and 124 triangles of a mesh's element buffer, without mesh shaders meshlets are
+// drawn as index ranges, so they are cut from the cache optimised order instead of getting their own local indices
+struct meshlet {
+    GLuint first_index;
+    GLuint index_count;
+
+    glm::vec3 centre; // bounding sphere
+    float radius;
+
+    // every triangle faces away from cameras with dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff,
+    // a cutoff of 2 never culls
+    glm::vec3 cone_apex;
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+// layout of glMultiDrawElementsIndirect's commands
+struct draw_elements_indirect_command {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+template<typename Vertex>
+void compute_meshlet_bounds(meshlet& m, std::vector<Vertex> const& vertices, std::vector<GLuint> const& indices) {
+    glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+    for (GLuint i = m.first_index; i < m.first_index + m.index_count; ++i) {
+        lo = glm::min(lo, vertices[indices[i]].pos);
+        hi = glm::max(hi, vertices[indices[i]].pos);
+    }
+    m.centre = 0.5f * (lo + hi);
+    m.radius = 0.0f;
+    for (GLuint i = m.first_index; i < m.first_index + m.index_count; ++i) {
+        m.radius = std::max(m.radius, glm::length(vertices[indices[i]].pos - m.centre));
+    }
+
+    // the axis is the area weighted average normal, the cutoff comes from the widest angle to it
+    std::vector<std::pair<glm::vec3, glm::vec3>> tris; // a corner and the unit normal of every triangle with an area
+    glm::vec3 axis{0.0f};
+    for (GLuint i = m.first_index; i < m.first_index + m.index_count; i += 3) {
+        glm::vec3 p0 = vertices[indices[i]].pos, p1 = vertices[indices[i + 1]].pos, p2 = vertices[indices[i + 2]].pos;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length <= 0.0f) continue;
+        axis += n;
+        tris.push_back({p0, n / length});
+    }
+
+    m.cone_apex = m.centre;
+    m.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+    m.cone_cutoff = 2.0f;
+    float axis_length = glm::length(axis);
+    if (axis_length <= 0.0f) return;
+    axis /= axis_length;
+
+    float min_dot{1.0f};
+    for (auto const& tri : tris) min_dot = std::min(min_dot, glm::dot(tri.second, axis));
+    if (min_dot <= 0.0f) return;
+
+    // the apex moves back along the axis until it is behind every triangle's plane
+    float max_t{0.0f};
+    for (auto const& tri : tris) {
+        max_t = std::max(max_t, glm::dot(m.centre - tri.first, tri.second) / glm::dot(axis, tri.second));
+    }
+    m.cone_apex = m.centre - axis * max_t;
+    m.cone_axis = axis;
+    m.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+// splits the triangle list in order, a meshlet ends when the next triangle would exceed either limit, so meshlets keep
+// the vertex cache and overdraw order of the indices
+template<typename Vertex>
+std::vector<meshlet> build_meshlets(std::vector<Vertex> const& vertices, std::vector<GLuint> const& indices,
+                                    size_t max_vertices = 64, size_t max_triangles = 124) {
+    std::vector<meshlet> res;
+    std::vector<size_t> used_by(vertices.size(), SIZE_MAX); // last meshlet using each vertex
+    meshlet current{0, 0, {}, 0.0f, {}, {}, 2.0f};
+    size_t vertex_count{0};
+
+    auto finish = [&]() {
+        compute_meshlet_bounds(current, vertices, indices);
+        res.push_back(current);
+        current.first_index += current.index_count;
+        current.index_count = 0;
+        vertex_count = 0;
+    };
+
+    // vertices of triangle i the meshlet res.size() doesn't have yet
+    auto new_vertices = [&](size_t i) {
+        size_t count{0};
+        for (size_t k = 0; k < 3; ++k) {
+            GLuint v = indices[i + k];
+            bool repeated = (k > 0 && indices[i] == v) || (k > 1 && indices[i + 1] == v);
+            count += used_by[v] != res.size() && !repeated;
+        }
+        return count;
+    };
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        size_t added = new_vertices(i);
+        if (vertex_count + added > max_vertices || current.index_count / 3 + 1 > max_triangles) {
+            finish();
+            added = new_vertices(i);
+        }
+        for (size_t k = 0; k < 3; ++k) used_by[indices[i + k]] = res.size();
+        vertex_count += added;
+        current.index_count += 3;
+    }
+    if (current.index_count > 0) finish();
+    return res;
+}
+
+// what meshlets are culled against, the planes point inwards and are normalised
+struct cull_view {
+    std::array<glm::vec4, 6> planes;
+    glm::vec3 camera_pos;
+    glm::mat4 view_projection;
+    depth_pyramid const * hi_z{nullptr}; // optional occlusion culling against an earlier depth buffer of this view
+
+    // planes from the rows of view_projection, see Gribb and Hartmann's "Fast Extraction of Viewing Frustum Planes"
+    static cull_view perspective(glm::mat4 const& view_projection, glm::vec3 camera_pos, depth_pyramid const * hi_z = nullptr) {
+        cull_view res{{}, camera_pos, view_projection, hi_z};
+        auto row = [&view_projection](int r) { return glm::vec4(view_projection[0][r], view_projection[1][r], view_projection[2][r], view_projection[3][r]); };
+        for (int axis = 0; axis < 3; ++axis) {
+            res.planes[2 * axis] = row(3) + row(axis);
+            res.planes[2 * axis + 1] = row(3) - row(axis);
+        }
+        for (auto& plane : res.planes) plane /= glm::length(glm::vec3(plane));
+        return res;
+    }
+
+    bool outside(glm::vec3 centre, float radius) const {
+        for (auto const& plane : planes) {
+            if (glm::dot(glm::vec3(plane), centre) + plane.w < -radius) return true;
+        }
+        return false;
+    }
+};
+
+struct meshlet_cull_stats {
+    size_t frustum{0};
+    size_t backface{0};
+    size_t occluded{0};
+    size_t visible{0};
+
+    meshlet_cull_stats& operator+=(meshlet_cull_stats const& o) {
+        frustum += o.frustum;
+        backface += o.backface;
+        occluded += o.occluded;
+        visible += o.visible;
+        return *this;
+    }
+};
+
+// calls func(meshlet) for every meshlet of a mesh drawn with transform that survives frustum, cone and, with a
+// depth pyramid, occlusion culling, cones assume transform has no non-uniform scale
+template<typename Func>
+meshlet_cull_stats cull_meshlets(std::vector<meshlet> const& meshlets, glm::mat4 const& transform, cull_view const& view, Func const& func) {
+    glm::mat3 linear{transform};
+    float scale = std::max({glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2])});
+
+    meshlet_cull_stats stats;
+    for (auto const& m : meshlets) {
+        glm::vec3 centre = glm::vec3(transform * glm::vec4(m.centre, 1.0f));
+        float radius = m.radius * scale;
+        if (view.outside(centre, radius)) {
+            ++stats.frustum;
+            continue;
+        }
+
+        if (m.cone_cutoff <= 1.0f) {
+            glm::vec3 apex = glm::vec3(transform * glm::vec4(m.cone_apex, 1.0f));
+            glm::vec3 axis = glm::normalize(linear * m.cone_axis);
+            if (glm::dot(glm::normalize(apex - view.camera_pos), axis) >= m.cone_cutoff) {
+                ++stats.backface;
+                continue;
+            }
+        }
+
+        if (view.hi_z && view.hi_z->occludes(centre, radius, view.view_projection)) {
+            ++stats.occluded;
+            continue;
+        }
+
+        ++stats.visible;
+        func(m);
+    }
+    return stats;
+}
+
+// indirect draws of the visible meshlets, neighbouring meshlets in the element buffer merge into one command
+inline meshlet_cull_stats cull_meshlets(std::vector<meshlet> const& meshlets, glm::mat4 const& transform, cull_view const& view,
+                                        GLuint draw_id, std::vector<draw_elements_indirect_command>& commands) {
+    return cull_meshlets(meshlets, transform, view, [&commands, draw_id](meshlet const& m) {
+        if (!commands.empty() && commands.back().base_instance == draw_id && commands.back().first_index + commands.back().count == m.first_index) {
+            commands.back().count += m.index_count;
+        } else {
+            commands.push_back({m.index_count, 1, m.first_index, 0, draw_id});
+        }
+    });
+}
+
+// the visible meshlets' triangles as one compacted index list
+inline meshlet_cull_stats cull_meshlets(std::vector<meshlet> const& meshlets, glm::mat4 const& transform, cull_view const& view,
+                                        std::vector<GLuint> const& indices, std::vector<GLuint>& visible_indices) {
+    return cull_meshlets(meshlets, transform, view, [&indices, &visible_indices](meshlet const& m) {
+        visible_indices.insert(visible_indices.end(), indices.begin() + m.first_index, indices.begin() + m.first_index + m.index_count);
+    });
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "depth_pyramid.h"
+#include "meshlet.h"
+#include "shapes.h"
+
+// CPU only, random views of the generated shapes with and without a depth pyramid of a wall in front of part of
+// them, every triangle with a point that is front facing, inside the frustum and in front of the wall has to
+// survive cull_meshlets(), exits with 1 when the frustum, cone or hi-Z stage drops one
+
+static constexpr size_t width = 256;
+static constexpr size_t height = 144;
+
+struct test_view {
+    glm::mat4 view_projection;
+    glm::vec3 camera_pos;
+    std::vector<float> depth; // window space, bottom row first like depth_pyramid
+};
+
+// the depth buffer after drawing only a wall, a screen rectangle at one window depth
+std::vector<float> wall_depth(size_t x0, size_t y0, size_t x1, size_t y1, float wall) {
+    std::vector<float> res(width * height, 1.0f);
+    for (size_t y = y0; y < y1; ++y) {
+        for (size_t x = x0; x < x1; ++x) res[y * width + x] = wall;
+    }
+    return res;
+}
+
+// whether a point of the triangle can be seen, tested on a grid of barycentric samples with margins so points on
+// the frustum or wall boundaries don't decide the outcome either way
+bool triangle_visible(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, test_view const& view) {
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(normal);
+    if (area <= 1e-8f) return false;
+    if (glm::dot(normal / area, glm::normalize(view.camera_pos - p0)) < 1e-3f) return false;
+
+    static constexpr int steps = 6;
+    for (int i = 0; i <= steps; ++i) {
+        for (int j = 0; i + j <= steps; ++j) {
+            float u = static_cast<float>(i) / steps, v = static_cast<float>(j) / steps;
+            glm::vec4 clip = view.view_projection * glm::vec4(p0 + u * (p1 - p0) + v * (p2 - p0), 1.0f);
+            if (clip.w <= 1e-4f) continue;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            if (std::abs(ndc.x) > 0.999f || std::abs(ndc.y) > 0.999f || std::abs(ndc.z) > 0.999f) continue;
+            size_t x = std::min(static_cast<size_t>((ndc.x * 0.5f + 0.5f) * width), width - 1);
+            size_t y = std::min(static_cast<size_t>((ndc.y * 0.5f + 0.5f) * height), height - 1);
+            if (ndc.z * 0.5f + 0.5f < view.depth[y * width + x] - 1e-4f) return true;
+        }
+    }
+    return false;
+}
+
+int main() {
+    std::mt19937 rng{7};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+    std::uniform_real_distribution<float> fraction{0.0f, 1.0f};
+    glm::mat4 const projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / height, 0.1f, 100.0f);
+
+    static constexpr size_t views_per_shape = 200;
+    meshlet_cull_stats totals;
+    size_t meshlet_count{0}, visible_triangles{0}, dropped{0};
+    for (shape s : {shape::uv_sphere, shape::ico_sphere, shape::cube, shape::plane, shape::torus}) {
+        geometry_data data = generate_shape(s, 0);
+        std::vector<meshlet> meshlets = build_meshlets(data.vertices, data.indices);
+
+        for (size_t v = 0; v < views_per_shape; ++v) {
+            // a uniformly scaled, rotated and moved shape, with the camera looking near it from up close or afar
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f);
+            transform = glm::rotate(transform, unit(rng) * 3.14159265f, axis);
+            transform = glm::scale(transform, glm::vec3(0.5f + 1.5f * fraction(rng)));
+
+            glm::vec3 centre = glm::vec3(transform[3]);
+            glm::vec3 offset = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(1e-3f, 0.0f, 0.0f));
+            glm::vec3 camera_pos = centre + offset * (1.5f + 8.0f * fraction(rng));
+            glm::vec3 target = centre + glm::vec3(unit(rng), unit(rng), unit(rng)) * 3.0f;
+            glm::mat4 view_projection = projection * glm::lookAt(camera_pos, target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            // every other view has a wall over a random part of the screen around its middle, somewhere between the
+            // camera and the shape's centre
+            bool with_wall = v % 2 == 1;
+            size_t x0 = static_cast<size_t>(fraction(rng) * width / 2), x1 = width / 2 + static_cast<size_t>(fraction(rng) * width / 2);
+            size_t y0 = static_cast<size_t>(fraction(rng) * height / 2), y1 = height / 2 + static_cast<size_t>(fraction(rng) * height / 2);
+            glm::vec3 forward = glm::normalize(target - camera_pos);
+            float wall_distance = std::max(glm::dot(centre - camera_pos, forward) * (0.3f + 0.7f * fraction(rng)), 0.2f);
+            glm::vec4 wall_clip = view_projection * glm::vec4(camera_pos + forward * wall_distance, 1.0f);
+            float wall = glm::clamp(wall_clip.z / wall_clip.w * 0.5f + 0.5f, 0.0f, 1.0f);
+            test_view view{view_projection, camera_pos, with_wall ? wall_depth(x0, y0, x1, y1, wall) : std::vector<float>(width * height, 1.0f)};
+            depth_pyramid pyramid(view.depth, width, height);
+            cull_view cull = cull_view::perspective(view_projection, camera_pos, with_wall ? &pyramid : nullptr);
+
+            for (auto const& m : meshlets) {
+                meshlet_cull_stats stats = cull_meshlets(std::vector<meshlet>{m}, transform, cull, [](meshlet const&) {});
+                totals += stats;
+                ++meshlet_count;
+
+                size_t visible{0};
+                for (GLuint i = m.first_index; i < m.first_index + m.index_count; i += 3) {
+                    glm::vec3 p[3];
+                    for (int k = 0; k < 3; ++k) p[k] = glm::vec3(transform * glm::vec4(data.vertices[data.indices[i + k]].pos, 1.0f));
+                    visible += triangle_visible(p[0], p[1], p[2], view);
+                }
+                visible_triangles += visible;
+                if (visible == 0 || stats.visible == 1) continue;
+
+                ++dropped;
+                char const * stage = stats.frustum ? "frustum" : stats.backface ? "cone" : "hi-Z";
+                std::cout << "FAIL shape " << static_cast<int>(s) << " view " << v << ": the " << stage << " stage dropped a meshlet with " << visible
+                          << " visible triangles" << std::endl;
+            }
+        }
+    }
+
+    std::cout << meshlet_count << " meshlets tested, " << visible_triangles << " visible triangles, culled " << totals.frustum << " by the frustum, "
+              << totals.backface << " by cones, " << totals.occluded << " by hi-Z, " << totals.visible << " kept, " << dropped << " wrongly dropped" << std::endl;
+    return dropped == 0 ? 0 : 1;
+}
@@ -1,19 +1,37 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <regex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
 #include <SDL_opengl.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "constant_ring.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "ray_query.h"
+#include "occlusion_raster.h"
 #include "shader.h"
+#include "simplify.h"
 #include "texture.h"
+#include "util.h"
+#include "vertex.h"
 
 template<typename AiType, typename OurType>
 OurType ai_get(aiMaterial const * mat, char const * key, unsigned int type, unsigned int idx) {
@@ -36,15 +54,92 @@ glm::vec3 ai_get<aiColor3D, glm::vec3>(aiMaterial const * mat, char const * key,
     return glm::vec3{res.r, res.g, res.b};
 }
 
-struct vertex {
-    glm::vec3 pos;
-    glm::vec3 normal;
-    glm::vec2 tex_coords;
-    glm::vec3 tangent;
-    glm::vec3 bitangent;
+// layouts of a mesh's vertex buffer, the CPU copy in mesh::vertices is always full
+enum class vertex_format {
+    full,        // vertex as is, 56 bytes
+    compact,     // compact_vertex with snorm16 positions normalised to the mesh bounds
+    compact_half // compact_vertex with half positions relative to the centre of the bounds
 };
 
+// 20 byte vertex decoded by common/vertex.glsl: octahedral normal and tangent, the sign of the bitangent against
+// cross(normal, tangent) in w of the position, half uvs which get coarse on heavily tiled surfaces
+struct compact_vertex {
+    uint16_t pos[4];
+    int16_t normal[2];
+    uint16_t tex_coords[2];
+    int16_t tangent[2];
+};
+
+static_assert(sizeof(compact_vertex) == 20, "compact_vertex has to match the attribute formats of mesh::setup_gl_data");
+
+// maps the unit sphere onto [-1, 1]^2 via the octahedron, the lower half folded over the diagonals
+inline glm::vec2 oct_encode(glm::vec3 n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f) return glm::vec2(0.0f);
+    n /= l1;
+    if (n.z >= 0.0f) return glm::vec2(n.x, n.y);
+    return (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+inline int16_t snorm16(float v) {
+    return static_cast<int16_t>(glm::packSnorm1x16(v));
+}
+
+// layout of the vertex_dequant block in common/vertex.glsl
+struct vertex_dequant_std140 {
+    glm::vec3 pos_scale;
+    int32_t compact;
+    glm::vec3 pos_offset;
+    float pad;
+};
+
+static_assert(sizeof(vertex_dequant_std140) == 32, "vertex_dequant_std140 has to match the std140 layout of vertex_dequant");
+
+static constexpr GLuint vertex_dequant_binding = 4;
+
+// vertex attribute 5 holds 0, 1, 2, ... with a divisor of 1, so a draw with base instance i reads draw id i
+// and vertex shaders can index per-draw data with it, gl_DrawID would need GL 4.6
+static constexpr GLuint draw_id_location = 5;
+static constexpr GLuint max_draw_ids = 1 << 16;
+
+// sets up the draw id attribute on the bound vertex array
+inline void bind_draw_ids() {
+    static GLuint const vbo = [] {
+        std::vector<GLuint> ids(max_draw_ids);
+        for (GLuint i = 0; i < max_draw_ids; ++i) ids[i] = i;
+
+        GLuint res;
+        glGenBuffers(1, &res);
+        glBindBuffer(GL_ARRAY_BUFFER, res);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        return res;
+    }();
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribIPointer(draw_id_location, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void *) 0);
+    glEnableVertexAttribArray(draw_id_location);
+    glVertexAttribDivisor(draw_id_location, 1);
+}
+
 struct pbr_material {
+    // permutation bits of pbr.frag, the render toggles are not material properties but share the mask
+    static constexpr uint32_t has_albedo_map = 1 << 0;
+    static constexpr uint32_t has_metallic_map = 1 << 1;
+    static constexpr uint32_t has_roughness_map = 1 << 2;
+    static constexpr uint32_t has_ao_map = 1 << 3;
+    static constexpr uint32_t has_normal_map = 1 << 4;
+    static constexpr uint32_t has_height_map = 1 << 5;
+    static constexpr uint32_t use_ibl = 1 << 6;
+    static constexpr uint32_t use_disney_diffuse = 1 << 7;
+    static constexpr uint32_t use_parallax = 1 << 8;
+    static constexpr uint32_t use_vert_tbn = 1 << 9;
+    static constexpr uint32_t use_instance_material = 1 << 10; // albedo, metallic, roughness and ao per instance
+
+    static inline std::vector<std::string> const feature_defines{
+        "HAS_ALBEDO_MAP", "HAS_METALLIC_MAP", "HAS_ROUGHNESS_MAP", "HAS_AO_MAP", "HAS_NORMAL_MAP", "HAS_HEIGHT_MAP",
+        "USE_IBL", "USE_DISNEY_DIFFUSE", "USE_PARALLAX", "USE_VERT_TBN", "USE_INSTANCE_MATERIAL"
+    };
+
     std::string name;
 
     glm::vec3 color_albedo{0.0f, 0.0f, 0.0f};
@@ -78,8 +173,13 @@ struct pbr_material {
         return loader<texture>::load(path, true, type == "albedo");
     }
 
+    uint32_t features() const {
+        return (albedo ? has_albedo_map : 0) | (metallic ? has_metallic_map : 0) | (roughness ? has_roughness_map : 0)
+             | (ao ? has_ao_map : 0) | (normal ? has_normal_map : 0) | (height ? has_height_map : 0);
+    }
+
+    // whether a map exists is a HAS_*_MAP define of the permutation picked by features(), not a uniform
     void activate_map(std::string name, std::shared_ptr<texture> map, int unit, shader_program const& program) const {
-        program.set_uniform("material.has_" + name + "_map", static_cast<bool>(map));
         if (map) {
             glActiveTexture(GL_TEXTURE0 + unit);
             glBindTexture(GL_TEXTURE_2D, map->id);
@@ -97,7 +197,42 @@ struct pbr_material {
     }
 };
 
+// std140 layout of material_block in common/material.glsl, bools are 4 bytes there
+struct material_std140 {
+    glm::vec3 color_ambient;
+    float shininess;
+    glm::vec3 color_diffuse;
+    float refraction;
+    glm::vec3 color_specular;
+    float opacity_value;
+    glm::vec3 color_emissive;
+    int32_t has_diffuse_map;
+    glm::vec3 color_transport;
+    int32_t has_specular_map;
+    int32_t has_emissive_map;
+    int32_t has_bump_map;
+    int32_t has_normal_map;
+    int32_t has_opacity_map;
+};
+
+static_assert(sizeof(material_std140) == 96, "material_std140 has to match the std140 layout of material_block");
+
 struct material {
+    static constexpr GLuint block_binding = 3;
+    static constexpr GLuint opacity_map_unit = 5; // see common/material.glsl
+
+    // permutation bits of g_pass.frag
+    static constexpr uint32_t has_diffuse_map = 1 << 0;
+    static constexpr uint32_t has_specular_map = 1 << 1;
+    static constexpr uint32_t has_emissive_map = 1 << 2;
+    static constexpr uint32_t has_bump_map = 1 << 3;
+    static constexpr uint32_t has_normal_map = 1 << 4;
+    static constexpr uint32_t has_opacity_map = 1 << 5;
+
+    static inline std::vector<std::string> const feature_defines{
+        "HAS_DIFFUSE_MAP", "HAS_SPECULAR_MAP", "HAS_EMISSIVE_MAP", "HAS_BUMP_MAP", "HAS_NORMAL_MAP", "HAS_OPACITY_MAP"
+    };
+
     std::string name;
 
     float shininess;
@@ -117,6 +252,9 @@ struct material {
     std::shared_ptr<texture> normal;
     std::shared_ptr<texture> opacity;
 
+    // the values above, uploaded once so drawing a mesh only binds buffers and textures
+    uniform_block<material_std140> block{block_binding};
+
     material(aiMaterial const * ai_material, std::string tex_path_base) {
         name = ai_get<aiString, std::string>(ai_material, AI_MATKEY_NAME);
 
@@ -136,6 +274,31 @@ struct material {
         bump = load_texture(ai_material, aiTextureType_HEIGHT, tex_path_base);
         normal = load_texture(ai_material, aiTextureType_NORMALS, tex_path_base);
         opacity = load_texture(ai_material, aiTextureType_OPACITY, tex_path_base);
+
+        block.data = material_std140{
+            color_ambient, shininess,
+            color_diffuse, refraction,
+            color_specular, opacity_value,
+            color_emissive, diffuse != nullptr,
+            color_transport, specular != nullptr,
+            emissive != nullptr, bump != nullptr, normal != nullptr, opacity != nullptr
+        };
+        block.update();
+    }
+
+    material(material const & other) = delete;
+    material & operator=(material const & other) = delete;
+
+    // binds the block and the maps to the fixed units of common/material.glsl
+    void bind() const {
+        block.bind();
+        std::shared_ptr<texture> const maps[] = {diffuse, specular, emissive, bump, normal, opacity};
+        for (size_t unit = 0; unit < std::size(maps); ++unit) {
+            if (!maps[unit]) continue;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, maps[unit]->id);
+        }
+        glActiveTexture(GL_TEXTURE0);
     }
 
     std::shared_ptr<texture> load_texture(aiMaterial const * ai_material, aiTextureType ai_type, std::string tex_path_base) {
@@ -161,116 +324,440 @@ struct material {
 
         return loader<texture>::load(tex_path, true, ai_type == aiTextureType_DIFFUSE);
     }
+
+    uint32_t features() const {
+        return (diffuse ? has_diffuse_map : 0) | (specular ? has_specular_map : 0) | (emissive ? has_emissive_map : 0)
+             | (bump ? has_bump_map : 0) | (normal ? has_normal_map : 0) | (opacity ? has_opacity_map : 0);
+    }
+};
+
+// turns a LOD's error in world units into pixels for one view, pixels_per_unit is the projected size of one unit at
+// distance 1, the default view has no projection and always picks full detail
+struct lod_view {
+    glm::vec3 camera_pos{0.0f};
+    float pixels_per_unit{0.0f};
+    float max_pixel_error{1.0f};
+
+    static lod_view perspective(glm::vec3 camera_pos, float fov_y, float viewport_height, float max_pixel_error = 1.0f) {
+        return {camera_pos, viewport_height / (2.0f * std::tan(0.5f * fov_y)), max_pixel_error};
+    }
+
+    // the error at the closest point of a bounding sphere, inside the sphere nothing but full detail is good enough
+    bool acceptable(float error, glm::vec3 centre, float radius) const {
+        if (pixels_per_unit <= 0.0f) return false;
+        float distance = glm::length(centre - camera_pos) - radius;
+        return distance > 0.0f && error * pixels_per_unit <= max_pixel_error * distance;
+    }
+};
+
+// a range of the mesh's element buffer
+struct mesh_lod {
+    GLuint first_index;
+    GLuint index_count;
+    float error; // in object space units, see build_lod_chain()
 };
 
 struct mesh {
     std::vector<vertex> vertices;
     std::vector<GLuint> indices;
     std::shared_ptr<material> mat;
+    vertex_format format;
+    uniform_block<vertex_dequant_std140> dequant{vertex_dequant_binding};
 
     GLuint vao;
     GLuint vbo;
     GLuint ebo;
+    GLuint depth_vao;
+    GLuint depth_vbo; // positions, then uvs if alpha tested, see setup_depth_stream()
+
+    // lods[0] is indices, simplified levels share the vertex buffers and follow it in the element buffer
+    std::vector<mesh_lod> lods;
+    size_t lod{0}; // the level draws use, see select_lod()
+    glm::vec3 bounds_centre{0.0f};
+    float bounds_radius{0.0f};
+    glm::vec3 bounds_min{0.0f};
+    glm::vec3 bounds_max{0.0f};
+    std::vector<meshlet> meshlets; // partition of lods[0], empty unless the model was loaded with meshlets
+    triangle_bvh ray_tree;         // over lods[0] in object space, for picking and other CPU ray queries
+
+    static inline size_t draw_calls{0}; // over all meshes, for the per-frame stats
 
     // TODO figure out ownership semantics for members
-    mesh(std::vector<vertex> && vertices, std::vector<GLuint> && indices, std::shared_ptr<material> mat)
-        : vertices{std::move(vertices)}, indices{std::move(indices)}, mat{mat}
+    mesh(std::vector<vertex> && vertices, std::vector<GLuint> && indices, std::shared_ptr<material> mat, vertex_format format = vertex_format::full,
+         std::vector<lod_level> const& coarse_lods = {})
+        : vertices{std::move(vertices)}, indices{std::move(indices)}, mat{mat}, format{format}
     {
-        setup_gl_data();
+        compute_bounds();
+
+        lods.push_back({0, static_cast<GLuint>(this->indices.size()), 0.0f});
+        std::vector<GLuint> lod_indices;
+        for (auto const& level : coarse_lods) {
+            if (lod_indices.empty()) lod_indices = this->indices;
+            lods.push_back({static_cast<GLuint>(lod_indices.size()), static_cast<GLuint>(level.indices.size()), level.error});
+            lod_indices.insert(lod_indices.end(), level.indices.begin(), level.indices.end());
+        }
+        setup_gl_data(coarse_lods.empty() ? this->indices : lod_indices);
     }
 
-    void setup_gl_data() {
+    void compute_bounds() {
+        glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+        for (auto& v : vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        bounds_centre = vertices.empty() ? glm::vec3(0.0f) : 0.5f * (lo + hi);
+        bounds_min = vertices.empty() ? glm::vec3(0.0f) : lo;
+        bounds_max = vertices.empty() ? glm::vec3(0.0f) : hi;
+        bounds_radius = 0.0f;
+        for (auto& v : vertices) bounds_radius = std::max(bounds_radius, glm::length(v.pos - bounds_centre));
+    }
+
+    // the coarsest level whose error stays under the view's pixel error when drawn with transform
+    size_t select_lod(lod_view const& view, glm::mat4 const& transform) const {
+        float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+        glm::vec3 centre = glm::vec3(transform * glm::vec4(bounds_centre, 1.0f));
+        size_t res{0};
+        while (res + 1 < lods.size() && view.acceptable(lods[res + 1].error * scale, centre, bounds_radius * scale)) ++res;
+        return res;
+    }
+
+    bool alpha_tested() const {
+        return mat && mat->opacity;
+    }
+
+    size_t vertex_stride() const {
+        return format == vertex_format::full ? sizeof(vertex) : sizeof(compact_vertex);
+    }
+
+    // size of the vertex buffer, also the least a pass drawing the mesh once fetches
+    size_t vertex_bytes() const {
+        return vertices.size() * vertex_stride();
+    }
+
+    // quantises the vertices and sets the matching dequantisation
+    std::vector<compact_vertex> pack_vertices() {
+        glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+        for (auto& v : vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        glm::vec3 centre = vertices.empty() ? glm::vec3(0.0f) : 0.5f * (lo + hi);
+        glm::vec3 extent = vertices.empty() ? glm::vec3(1.0f) : glm::max(0.5f * (hi - lo), glm::vec3(1e-6f));
+
+        bool half_pos = format == vertex_format::compact_half;
+        dequant.data = {half_pos ? glm::vec3(1.0f) : extent, 1, centre, 0.0f};
+
+        std::vector<compact_vertex> res(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            vertex const& v = vertices[i];
+            compact_vertex& c = res[i];
+
+            float sign = glm::dot(glm::cross(v.tangent, v.bitangent), v.normal) > 0.0f ? 1.0f : -1.0f;
+            if (half_pos) {
+                glm::vec3 pos = v.pos - centre;
+                for (int k = 0; k < 3; ++k) c.pos[k] = glm::packHalf1x16(pos[k]);
+                c.pos[3] = glm::packHalf1x16(sign);
+            } else {
+                glm::vec3 pos = (v.pos - centre) / extent;
+                for (int k = 0; k < 3; ++k) c.pos[k] = static_cast<uint16_t>(snorm16(pos[k]));
+                c.pos[3] = static_cast<uint16_t>(snorm16(sign));
+            }
+
+            glm::vec2 normal = oct_encode(v.normal);
+            glm::vec2 tangent = oct_encode(v.tangent);
+            for (int k = 0; k < 2; ++k) {
+                c.normal[k] = snorm16(normal[k]);
+                c.tangent[k] = snorm16(tangent[k]);
+                c.tex_coords[k] = glm::packHalf1x16(v.tex_coords[k]);
+            }
+        }
+        return res;
+    }
+
+    void setup_gl_data(std::vector<GLuint> const& element_data) {
+        std::vector<compact_vertex> packed;
+
         glGenVertexArrays(1, &vao);
         glGenBuffers(1, &vbo);
         glGenBuffers(1, &ebo);
 
         glBindVertexArray(vao);
 
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, element_data.size() * sizeof(GLuint), element_data.data(), GL_STATIC_DRAW);
+
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(decltype(vertices)::value_type), vertices.data(), GL_STATIC_DRAW);
+        if (format == vertex_format::full) {
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(decltype(vertices)::value_type), vertices.data(), GL_STATIC_DRAW);
+            dequant.data = {glm::vec3(1.0f), 0, glm::vec3(0.0f), 0.0f};
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(decltype(indices)::value_type), indices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, pos));
+            glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, pos));
-        glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, normal));
+            glEnableVertexAttribArray(1);
+
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, tex_coords));
+            glEnableVertexAttribArray(2);
+
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, tangent));
+            glEnableVertexAttribArray(3);
+
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, bitangent));
+            glEnableVertexAttribArray(4);
+        } else {
+            packed = pack_vertices();
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(compact_vertex), packed.data(), GL_STATIC_DRAW);
+
+            // snorm16 maps -32767 and 32767 to -1 and 1 exactly since GL 4.2
+            GLenum pos_type = format == vertex_format::compact_half ? GL_HALF_FLOAT : GL_SHORT;
+            glVertexAttribPointer(0, 4, pos_type, pos_type == GL_SHORT, sizeof(compact_vertex), (void *) offsetof(compact_vertex, pos));
+            glEnableVertexAttribArray(0);
+
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(compact_vertex), (void *) offsetof(compact_vertex, normal));
+            glEnableVertexAttribArray(1);
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, normal));
-        glEnableVertexAttribArray(1);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(compact_vertex), (void *) offsetof(compact_vertex, tex_coords));
+            glEnableVertexAttribArray(2);
 
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, tex_coords));
-        glEnableVertexAttribArray(2);
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(compact_vertex), (void *) offsetof(compact_vertex, tangent));
+            glEnableVertexAttribArray(3);
 
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, tangent));
-        glEnableVertexAttribArray(3);
+            // the bitangent is rebuilt from the normal, the tangent and the sign
+            glDisableVertexAttribArray(4);
+        }
+        dequant.update();
 
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, bitangent));
-        glEnableVertexAttribArray(4);
+        bind_draw_ids();
 
         glBindVertexArray(0);
+
+        setup_depth_stream(packed);
     }
 
-    void activate_map(std::string name, std::shared_ptr<texture> tex, int unit, shader_program const & program) const {
-        program.set_uniform("material.has_" + name + "_map", static_cast<bool>(tex));
-        if (tex) {
-            glActiveTexture(GL_TEXTURE0 + unit);
-            glBindTexture(GL_TEXTURE_2D, tex->id);
-            program.set_uniform("material." + name, unit);
+    // depth passes only read positions and, for alpha testing, uvs, a separate tightly packed copy of just those
+    // keeps them from fetching whole vertices, positions use the same encoding and dequantisation as the main buffer
+    void setup_depth_stream(std::vector<compact_vertex> const& packed) {
+        glGenVertexArrays(1, &depth_vao);
+        glGenBuffers(1, &depth_vbo);
+
+        glBindVertexArray(depth_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBindBuffer(GL_ARRAY_BUFFER, depth_vbo);
+
+        size_t uv_count = alpha_tested() ? vertices.size() : 0;
+        if (format == vertex_format::full) {
+            std::vector<glm::vec3> positions(vertices.size());
+            std::vector<glm::vec2> uvs(uv_count);
+            for (size_t i = 0; i < vertices.size(); ++i) positions[i] = vertices[i].pos;
+            for (size_t i = 0; i < uv_count; ++i) uvs[i] = vertices[i].tex_coords;
+            upload_depth_stream(positions, uvs);
+
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *) 0);
+            if (uv_count) glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *) (positions.size() * sizeof(glm::vec3)));
+        } else {
+            std::vector<std::array<uint16_t, 4>> positions(vertices.size());
+            std::vector<std::array<uint16_t, 2>> uvs(uv_count);
+            for (size_t i = 0; i < vertices.size(); ++i) std::copy(std::begin(packed[i].pos), std::end(packed[i].pos), positions[i].begin());
+            for (size_t i = 0; i < uv_count; ++i) std::copy(std::begin(packed[i].tex_coords), std::end(packed[i].tex_coords), uvs[i].begin());
+            upload_depth_stream(positions, uvs);
+
+            GLenum pos_type = format == vertex_format::compact_half ? GL_HALF_FLOAT : GL_SHORT;
+            glVertexAttribPointer(0, 4, pos_type, pos_type == GL_SHORT, sizeof(positions[0]), (void *) 0);
+            if (uv_count) glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(uvs[0]), (void *) (positions.size() * sizeof(positions[0])));
         }
+        glEnableVertexAttribArray(0);
+        if (uv_count) glEnableVertexAttribArray(2);
+
+        bind_draw_ids();
+
+        glBindVertexArray(0);
     }
 
-    void draw(shader_program const & program) const {
-        program.use();
-        program.set_uniform("material.color_diffuse", mat->color_diffuse);
-        program.set_uniform("material.color_specular", mat->color_specular);
-        program.set_uniform("material.shininess", mat->shininess);
+    template<typename Pos, typename UV>
+    void upload_depth_stream(std::vector<Pos> const& positions, std::vector<UV> const& uvs) const {
+        size_t pos_size = positions.size() * sizeof(Pos);
+        glBufferData(GL_ARRAY_BUFFER, pos_size + uvs.size() * sizeof(UV), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, pos_size, positions.data());
+        if (!uvs.empty()) glBufferSubData(GL_ARRAY_BUFFER, pos_size, uvs.size() * sizeof(UV), uvs.data());
+    }
 
-        activate_map("diffuse", mat->diffuse, 0, program);
-        activate_map("specular", mat->specular, 1, program);
-        activate_map("emissive", mat->emissive, 2, program);
-        activate_map("bump", mat->bump, 3, program);
-        activate_map("normal", mat->normal, 4, program);
-        activate_map("opacity", mat->opacity, 5, program);
+    size_t depth_stream_bytes() const {
+        size_t pos_size = format == vertex_format::full ? sizeof(glm::vec3) : 4 * sizeof(uint16_t);
+        size_t uv_size = alpha_tested() ? (format == vertex_format::full ? sizeof(glm::vec2) : 2 * sizeof(uint16_t)) : 0;
+        return vertices.size() * (pos_size + uv_size);
+    }
 
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // count instances with draw ids draw_id, draw_id + 1, ..., a single draw with id 0 is a plain draw
+    // so GL 3.3 contexts keep working, base instances need GL 4.2
+    void draw_elements(GLuint draw_id, GLuint count = 1) const {
+        draw_vertex_array(vao, draw_id, count);
+    }
 
-        glActiveTexture(GL_TEXTURE0);
+    void draw_vertex_array(GLuint vertex_array, GLuint draw_id, GLuint count) const {
+        ++draw_calls;
+        dequant.bind();
+        glBindVertexArray(vertex_array);
+        mesh_lod const& level = lods[lod];
+        void const * offset = (void const *) (level.first_index * sizeof(GLuint));
+        if (draw_id == 0 && count == 1) {
+            glDrawElements(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT, offset);
+        } else {
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT, offset, count, draw_id);
+        }
+        glBindVertexArray(0);
     }
 
-    void draw_pbr(shader_program const & program, pbr_material const & mat, int start_unit) const {
+    void draw(shader_program const & program, GLuint draw_id = 0) const {
         program.use();
-        mat.activate(program, start_unit);
+        if (mat) mat->bind();
+        draw_elements(draw_id);
+    }
+
+    // draw with the permutation specialised for this mesh's material
+    void draw(shader_permutations & permutations, uint32_t extra_features = 0, GLuint draw_id = 0) const {
+        draw(permutations.use((mat ? mat->features() : 0) | extra_features), draw_id);
+    }
+
+    // depth only passes, picks the permutation with or without alpha testing and binds nothing of the material but the opacity map
+    void draw_depth(shader_permutations & permutations, GLuint draw_id = 0) const {
+        permutations.use(alpha_tested() ? material::has_opacity_map : 0);
+        if (alpha_tested()) {
+            glActiveTexture(GL_TEXTURE0 + material::opacity_map_unit);
+            glBindTexture(GL_TEXTURE_2D, mat->opacity->id);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        draw_vertex_array(depth_vao, draw_id, 1);
+    }
+
+    // draws only the meshlets surviving view's culling, one indirect draw whose commands come from constants,
+    // meshes without meshlets or drawn at a coarser level go through draw() unless view's depth pyramid hides their box
+    meshlet_cull_stats draw_culled(shader_permutations & permutations, constant_ring & constants, cull_view const & view, glm::mat4 const & transform,
+                                   uint32_t extra_features = 0, GLuint draw_id = 0) const {
+        if (meshlets.empty() || lod != 0) {
+            if (!view.hi_z || !view.hi_z->occludes_box(bounds_min, bounds_max, view.view_projection * transform)) draw(permutations, extra_features, draw_id);
+            return {};
+        }
+
+        std::vector<draw_elements_indirect_command> commands;
+        meshlet_cull_stats stats = cull_meshlets(meshlets, transform, view, draw_id, commands);
+        if (commands.empty()) return stats;
 
+        constant_ring::range range = constants.push(commands);
+        draw_indirect(permutations, extra_features, range.buffer, range.offset, commands.size());
+        return stats;
+    }
+
+    // count draw_elements_indirect_commands read from buffer at offset, e.g. written by a culling compute shader
+    void draw_indirect(shader_permutations & permutations, uint32_t extra_features, GLuint buffer, GLintptr offset, GLsizei count) const {
+        permutations.use((mat ? mat->features() : 0) | extra_features);
+        if (mat) mat->bind();
+
+        ++draw_calls;
+        dequant.bind();
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void const *) offset, count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
         glBindVertexArray(0);
+    }
 
+    void draw_pbr(shader_program const & program, pbr_material const & mat, int start_unit, GLuint draw_id = 0) const {
+        program.use();
+        mat.activate(program, start_unit);
+        draw_elements(draw_id);
         glActiveTexture(GL_TEXTURE0);
     }
+
+    void draw_pbr(shader_permutations & permutations, pbr_material const & mat, int start_unit, uint32_t extra_features = 0, GLuint draw_id = 0) const {
+        draw_pbr(permutations.use(mat.features() | extra_features), mat, start_unit, draw_id);
+    }
 };
 
+// CPU side of a mesh between import and upload
+struct imported_mesh {
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+    std::shared_ptr<material> mat;
+    std::vector<lod_level> lods;
+    std::vector<meshlet> meshlets;
+    triangle_bvh ray_tree;
+};
+
+// a node of the imported scene, aiProcess_OptimizeGraph already merges the nodes it can and bakes their transforms
+struct model_node {
+    std::string name;
+    int parent; // -1 for the root, parents come before their children
+    glm::mat4 local;
+    std::vector<size_t> meshes; // indices into model::meshes
+};
+
+// the files a .gltf is made of, the file itself followed by the buffers and images its uris point at, for keying
+// caches derived from the scene, embedded data: uris are skipped
+inline std::vector<std::string> gltf_files(std::string const& path) {
+    std::string directory = path.substr(0, path.find_last_of('/') + 1);
+    std::string json = load_string(path);
+    static const std::regex uri_entry{R"re("uri"\s*:\s*"([^"]*)")re"};
+
+    std::vector<std::string> res;
+    for (std::sregex_iterator it(json.begin(), json.end(), uri_entry), end; it != end; ++it) {
+        std::string uri = (*it)[1];
+        if (uri.rfind("data:", 0) == 0) continue;
+
+        // uris are percent encoded
+        std::string file;
+        for (size_t i = 0; i < uri.size(); ++i) {
+            if (uri[i] == '%' && i + 2 < uri.size()) {
+                file += static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                file += uri[i];
+            }
+        }
+        res.push_back(directory + file);
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    res.insert(res.begin(), path);
+    return res;
+}
+
 struct model {
     std::vector<mesh> meshes;
+    std::vector<model_node> nodes; // draws ignore their transforms, scene_graph applies them, see has_flat_nodes()
     std::string directory;
+    vertex_format format;
+    bool with_meshlets;
 
     using material_loader = shared_cache<material, aiMaterial const *, std::string>;
 
-    model(char const * path) {
+    model(char const * path, vertex_format format = vertex_format::full, bool with_meshlets = false) : format{format}, with_meshlets{with_meshlets} {
         load_model(path);
     }
 
+    size_t vertex_bytes() const {
+        size_t res{0};
+        for (auto& mesh : meshes) res += mesh.vertex_bytes();
+        return res;
+    }
+
+    size_t vertex_count() const {
+        size_t res{0};
+        for (auto& mesh : meshes) res += mesh.vertices.size();
+        return res;
+    }
+
     void load_model(std::string const path) {
         Assimp::Importer import;
         // Notes:
-        // aiProcess_FindDegenerates causes holes to appear on some models (e.g., the planet model from the learnopengl.com instancing tutorial)
+        // aiProcess_FindDegenerates causes holes to appear on some models (e.g., the planet model from the learnopengl.com instancing tutorial),
+        // optimize_mesh() only drops triangles repeating an index and replaces aiProcess_ImproveCacheLocality
         //
         // Original flags:
         //aiScene const * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals |
         //aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality | aiProcess_RemoveRedundantMaterials | aiProcess_FindDegenerates | aiProcess_FindInvalidData | aiProcess_OptimizeGraph);
         aiScene const * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals |
-        aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality | aiProcess_RemoveRedundantMaterials | aiProcess_FindInvalidData | aiProcess_OptimizeGraph);
+        aiProcess_JoinIdenticalVertices | aiProcess_RemoveRedundantMaterials | aiProcess_FindInvalidData | aiProcess_OptimizeGraph);
 
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             std::cerr << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
@@ -279,21 +766,51 @@ struct model {
 
        directory = path.substr(0, path.find_last_of('/') + 1);
 
-       process_node(scene->mRootNode, scene);
+       std::vector<imported_mesh> imported;
+       process_node(scene->mRootNode, scene, imported, -1, meshes.size());
+
+       // meshes are independent, the GL uploads stay on this thread, LOD chains, meshlets and ray trees are built on
+       // the optimised mesh so they follow the final vertex and index order
+       std::vector<mesh_opt_stats> stats(imported.size());
+       parallel_for(imported.size(), [this, &imported, &stats](size_t i) {
+           stats[i] = optimize_mesh(imported[i].vertices, imported[i].indices);
+           imported[i].lods = build_lod_chain(imported[i].vertices, imported[i].indices);
+           if (with_meshlets) imported[i].meshlets = build_meshlets(imported[i].vertices, imported[i].indices);
+           imported[i].ray_tree.build(imported[i].vertices, imported[i].indices);
+       });
+
+       meshes.reserve(meshes.size() + imported.size());
+       for (size_t i = 0; i < imported.size(); ++i) {
+           std::cout << path << " mesh " << i << ": " << stats[i].triangle_count << " triangles, ACMR " << stats[i].before.acmr << " -> " << stats[i].after.acmr
+                     << ", ATVR " << stats[i].before.atvr << " -> " << stats[i].after.atvr << ", LODs";
+           for (auto const& level : imported[i].lods) std::cout << " " << level.indices.size() / 3;
+           if (with_meshlets) std::cout << ", " << imported[i].meshlets.size() << " meshlets";
+           std::cout << std::endl;
+           meshes.emplace_back(std::move(imported[i].vertices), std::move(imported[i].indices), imported[i].mat, format, imported[i].lods);
+           meshes.back().meshlets = std::move(imported[i].meshlets);
+           meshes.back().ray_tree = std::move(imported[i].ray_tree);
+       }
     }
 
-    void process_node(aiNode const * node, aiScene const * scene) {
+    // first_mesh is where imported starts in meshes
+    void process_node(aiNode const * node, aiScene const * scene, std::vector<imported_mesh>& imported, int parent, size_t first_mesh) {
+        aiMatrix4x4 const& t = node->mTransformation; // row major
+        glm::mat4 local{t.a1, t.b1, t.c1, t.d1, t.a2, t.b2, t.c2, t.d2, t.a3, t.b3, t.c3, t.d3, t.a4, t.b4, t.c4, t.d4};
+        nodes.push_back({node->mName.C_Str(), parent, local, {}});
+        int index = static_cast<int>(nodes.size() - 1);
+
         for (size_t i = 0; i < node->mNumMeshes; ++i) {
             aiMesh const * mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(process_mesh(mesh, scene));
+            nodes[index].meshes.push_back(first_mesh + imported.size());
+            imported.push_back(process_mesh(mesh, scene));
         }
 
         for (size_t i = 0; i < node->mNumChildren; ++i) {
-            process_node(node->mChildren[i], scene);
+            process_node(node->mChildren[i], scene, imported, index, first_mesh);
         }
     }
 
-    mesh process_mesh(aiMesh const * ai_mesh, aiScene const * scene) {
+    imported_mesh process_mesh(aiMesh const * ai_mesh, aiScene const * scene) {
         std::vector<vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<texture> textures;
@@ -311,8 +828,9 @@ struct model {
             });
         }
 
-        // load indices
+        // load indices, points and lines left over by aiProcess_Triangulate would break up the triangle list
         for (size_t i = 0; i < ai_mesh->mNumFaces; ++i) {
+            if (ai_mesh->mFaces[i].mNumIndices != 3) continue;
             for (size_t j = 0; j < ai_mesh->mFaces[i].mNumIndices; ++j) {
                 indices.push_back(ai_mesh->mFaces[i].mIndices[j]);
             }
@@ -327,12 +845,81 @@ struct model {
             ai_material = scene->mMaterials[0];
         }
 
-        mesh m{std::move(vertices), std::move(indices), material_loader::load(ai_material, directory)};
-        return m;
+        return {std::move(vertices), std::move(indices), material_loader::load(ai_material, directory), {}, {}, {}};
+    }
+
+    // whether every node with meshes sits at the model's origin, the draws taking one transform for the whole model,
+    // draw_culled(), occluders(), occlusion_culler and draw_geometry(), ignore node transforms and only agree with
+    // scene_graph's draws for such models
+    bool has_flat_nodes() const {
+        std::vector<glm::mat4> world(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            world[i] = nodes[i].parent < 0 ? nodes[i].local : world[nodes[i].parent] * nodes[i].local;
+            if (nodes[i].meshes.empty()) continue;
+            for (int col = 0; col < 4; ++col) {
+                for (int row = 0; row < 4; ++row) {
+                    if (std::abs(world[i][col][row] - (col == row ? 1.0f : 0.0f)) > 1e-5f) return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // picks every mesh's level for the following draws, the model is drawn with transform
+    void select_lods(lod_view const& view, glm::mat4 const& transform) {
+        for (auto& mesh : meshes) mesh.lod = mesh.select_lod(view, transform);
+    }
+
+    void reset_lods() {
+        for (auto& mesh : meshes) mesh.lod = 0;
+    }
+
+    size_t triangle_count() const {
+        size_t res{0};
+        for (auto& mesh : meshes) res += mesh.lods[mesh.lod].index_count / 3;
+        return res;
+    }
+
+    // every mesh reads the model's transform at draw_id
+    void draw(shader_program const& program, GLuint draw_id = 0) const {
+        for (auto& mesh : meshes) mesh.draw(program, draw_id);
+    }
+
+    void draw(shader_permutations& permutations, uint32_t extra_features = 0, GLuint draw_id = 0) const {
+        for (auto& mesh : meshes) mesh.draw(permutations, extra_features, draw_id);
+    }
+
+    // see mesh::draw_culled(), the model is drawn with transform, its node transforms are ignored
+    meshlet_cull_stats draw_culled(shader_permutations& permutations, constant_ring& constants, cull_view const& view, glm::mat4 const& transform,
+                                   uint32_t extra_features = 0, GLuint draw_id = 0) const {
+        meshlet_cull_stats res;
+        for (auto& mesh : meshes) res += mesh.draw_culled(permutations, constants, view, transform, extra_features, draw_id);
+        return res;
+    }
+
+    // the meshes worth rendering into an occlusion_rasterizer when the model is drawn with transform, ignoring its node
+    // transforms, alpha tested meshes are left out since their holes would hide what is behind them
+    std::vector<occluder<vertex>> occluders(glm::mat4 const& transform, size_t triangle_budget = 16384) const {
+        std::vector<occluder<vertex>> res;
+        for (size_t i : pick_occluders(meshes, triangle_budget, [](mesh const& m) { return !m.alpha_tested(); })) {
+            res.push_back({&meshes[i].vertices, &meshes[i].indices, transform});
+        }
+        return res;
+    }
+
+    // opaque meshes first so the permutation only switches once
+    void draw_depth(shader_permutations& permutations, GLuint draw_id = 0) const {
+        for (bool alpha_tested : {false, true}) {
+            for (auto& mesh : meshes) {
+                if (mesh.alpha_tested() == alpha_tested) mesh.draw_depth(permutations, draw_id);
+            }
+        }
     }
 
-    void draw(shader_program const& program) const {
-        for (auto& mesh : meshes) mesh.draw(program);
+    size_t depth_stream_bytes() const {
+        size_t res{0};
+        for (auto& mesh : meshes) res += mesh.depth_stream_bytes();
+        return res;
     }
 
     void draw_outlined(shader_program const& draw_program, shader_program const& outline_program) const {
@@ -0,0 +1,246 @@
+#ifndef OCCLUSION_RASTER_H
+#define OCCLUSION_RASTER_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "depth_pyramid.h"
+#include "util.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define OCCLUSION_RASTER_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// a mesh rendered into the occlusion buffer, Vertex needs a pos like for build_meshlets()
+template<typename Vertex>
+struct occluder {
+    std::vector<Vertex> const * vertices;
+    std::vector<GLuint> const * indices;
+    glm::mat4 transform;
+};
+
+// indices of the meshes covering the most area per triangle, largest first until triangle_budget is spent,
+// only meshes with eligible(mesh) are considered, alpha tested or thin meshes make poor occluders
+template<typename Mesh, typename Pred>
+std::vector<size_t> pick_occluders(std::vector<Mesh> const& meshes, size_t triangle_budget, Pred const& eligible) {
+    std::vector<std::pair<float, size_t>> scored;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        if (meshes[i].indices.empty() || !eligible(meshes[i])) continue;
+        glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+        for (auto const& v : meshes[i].vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        // the box's two largest extents approximate the area it can hide
+        glm::vec3 extent = hi - lo;
+        float area = extent.x * extent.y + extent.y * extent.z + extent.z * extent.x - std::min({extent.x * extent.y, extent.y * extent.z, extent.z * extent.x});
+        scored.emplace_back(area / (meshes[i].indices.size() / 3), i);
+    }
+    std::sort(scored.begin(), scored.end(), [](auto const& a, auto const& b) { return a.first > b.first; });
+
+    std::vector<size_t> res;
+    size_t triangles{0};
+    for (auto const& [score, i] : scored) {
+        size_t count = meshes[i].indices.size() / 3;
+        if (triangles + count > triangle_budget) continue;
+        triangles += count;
+        res.push_back(i);
+    }
+    return res;
+}
+
+// CPU depth only rasteriser for occlusion culling without a GPU round trip, occluders are transformed, near
+// clipped and binned into screen tiles in parallel per occluder, then the tiles are rasterised in parallel four
+// pixels at a time, both on a pool of persistent threads, pixel centres are sampled like GL does and back faces
+// are culled like the g-pass does, the result goes into a depth_pyramid for the box and sphere tests
+struct occlusion_rasterizer {
+    static constexpr int width = 256;
+    static constexpr int height = 128;
+    static constexpr int tile_width = 64; // multiples of 4 so the 4 pixel steps never straddle tiles
+    static constexpr int tile_height = 32;
+    static constexpr int tiles_x = width / tile_width;
+    static constexpr int tiles_y = height / tile_height;
+    static constexpr int tile_count = tiles_x * tiles_y;
+
+    // in pixels, z is window space depth
+    struct screen_triangle {
+        std::array<glm::vec3, 3> v;
+    };
+
+    std::vector<float> depth = std::vector<float>(width * height, 1.0f); // bottom row first like depth_pyramid
+    std::vector<std::array<std::vector<screen_triangle>, tile_count>> bins; // per occluder, kept to reuse their memory
+    thread_pool workers; // render() runs every frame, so its threads are kept
+
+    // clears the buffer and renders the occluders seen through view_projection, returns how many triangles were binned
+    template<typename Vertex>
+    size_t render(std::vector<occluder<Vertex>> const& occluders, glm::mat4 const& view_projection) {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        if (bins.size() < occluders.size()) bins.resize(occluders.size());
+
+        std::vector<size_t> binned(occluders.size());
+        workers.parallel_for(occluders.size(), [&](size_t i) {
+            for (auto& bin : bins[i]) bin.clear();
+            binned[i] = bin_occluder(occluders[i], view_projection * occluders[i].transform, bins[i]);
+        });
+        workers.parallel_for(tile_count, [this, &occluders](size_t tile) {
+            for (size_t i = 0; i < occluders.size(); ++i) {
+                for (auto const& tri : bins[i][tile]) rasterize(tri, tile);
+            }
+        });
+
+        size_t res{0};
+        for (size_t count : binned) res += count;
+        return res;
+    }
+
+    depth_pyramid pyramid() const {
+        return depth_pyramid(depth, width, height);
+    }
+
+private:
+    template<typename Vertex>
+    static size_t bin_occluder(occluder<Vertex> const& o, glm::mat4 const& clip_from_object, std::array<std::vector<screen_triangle>, tile_count>& tile_bins) {
+        std::vector<glm::vec4> clip(o.vertices->size());
+        for (size_t i = 0; i < clip.size(); ++i) clip[i] = clip_from_object * glm::vec4((*o.vertices)[i].pos, 1.0f);
+
+        size_t res{0};
+        std::vector<GLuint> const& indices = *o.indices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            std::array<glm::vec4, 3> tri{clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]};
+
+            // trivially outside one frustum plane
+            bool outside{false};
+            for (int axis = 0; axis < 3 && !outside; ++axis) {
+                outside = (tri[0][axis] > tri[0].w && tri[1][axis] > tri[1].w && tri[2][axis] > tri[2].w)
+                       || (tri[0][axis] < -tri[0].w && tri[1][axis] < -tri[1].w && tri[2][axis] < -tri[2].w);
+            }
+            if (outside) continue;
+
+            // Sutherland-Hodgman against the near plane z = -w leaves at most a quad
+            std::array<glm::vec4, 4> poly;
+            size_t count{0};
+            for (size_t k = 0; k < 3; ++k) {
+                glm::vec4 const& a = tri[k];
+                glm::vec4 const& b = tri[(k + 1) % 3];
+                float da = a.z + a.w, db = b.z + b.w;
+                if (da >= 0.0f) poly[count++] = a;
+                if ((da >= 0.0f) == (db >= 0.0f)) continue;
+                // always from the inside vertex so the triangle on the other side of the edge gets the same point
+                poly[count++] = da >= 0.0f ? glm::mix(a, b, da / (da - db)) : glm::mix(b, a, db / (db - da));
+            }
+            if (count < 3) continue;
+
+            std::array<glm::vec3, 4> screen;
+            for (size_t k = 0; k < count; ++k) {
+                float w = std::max(poly[k].w, 1e-6f);
+                screen[k] = glm::vec3((poly[k].x / w * 0.5f + 0.5f) * width, (poly[k].y / w * 0.5f + 0.5f) * height, poly[k].z / w * 0.5f + 0.5f);
+            }
+            for (size_t k = 1; k + 1 < count; ++k) res += bin_triangle({screen[0], screen[k], screen[k + 1]}, tile_bins);
+        }
+        return res;
+    }
+
+    // inclusive range of the pixels in [x_begin, x_end) x [y_begin, y_end) whose centres the triangle's bounding box
+    // covers, clamped before converting since near clipped triangles can reach far outside the screen
+    static std::array<int, 4> pixel_bounds(screen_triangle const& tri, int x_begin, int y_begin, int x_end, int y_end) {
+        glm::vec3 const& a = tri.v[0];
+        glm::vec3 const& b = tri.v[1];
+        glm::vec3 const& c = tri.v[2];
+        auto first = [](float lo, int begin, int end) { return static_cast<int>(std::clamp(std::ceil(lo - 0.5f), static_cast<float>(begin), static_cast<float>(end))); };
+        auto last = [](float hi, int begin, int end) { return static_cast<int>(std::clamp(std::floor(hi - 0.5f), begin - 1.0f, end - 1.0f)); };
+        return {first(std::min({a.x, b.x, c.x}), x_begin, x_end), first(std::min({a.y, b.y, c.y}), y_begin, y_end),
+                last(std::max({a.x, b.x, c.x}), x_begin, x_end), last(std::max({a.y, b.y, c.y}), y_begin, y_end)};
+    }
+
+    static size_t bin_triangle(screen_triangle const& tri, std::array<std::vector<screen_triangle>, tile_count>& tile_bins) {
+        glm::vec3 a = tri.v[0], b = tri.v[1], c = tri.v[2];
+        if ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) <= 0.0f) return 0; // back facing or degenerate
+
+        auto [x0, y0, x1, y1] = pixel_bounds(tri, 0, 0, width, height);
+        if (x0 > x1 || y0 > y1) return 0;
+
+        for (int ty = y0 / tile_height; ty <= y1 / tile_height; ++ty) {
+            for (int tx = x0 / tile_width; tx <= x1 / tile_width; ++tx) tile_bins[ty * tiles_x + tx].push_back(tri);
+        }
+        return 1;
+    }
+
+    // keeps the nearest depth of the triangle's pixels inside tile, with edge functions e(x, y) = a x + b y + c that are
+    // non-negative inside the counter clockwise triangle, each edge is set up from its lower vertex and evaluated
+    // directly at every pixel so the two triangles sharing it get exactly negated values and leave no cracks, depth
+    // is interpolated relative to v0 which keeps distant triangles with close depths accurate
+    void rasterize(screen_triangle const& tri, size_t tile) {
+        glm::vec3 const& v0 = tri.v[0];
+        glm::vec3 const& v1 = tri.v[1];
+        glm::vec3 const& v2 = tri.v[2];
+
+        std::array<glm::vec3, 3> edges; // a, b, c of the edges opposite v0, v1 and v2
+        auto edge = [](glm::vec3 const& p, glm::vec3 const& q) {
+            bool flip = q.y < p.y || (q.y == p.y && q.x < p.x);
+            glm::vec3 const& lo = flip ? q : p;
+            glm::vec3 const& hi = flip ? p : q;
+            float a = lo.y - hi.y, b = hi.x - lo.x;
+            glm::vec3 res(a, b, -(a * lo.x + b * lo.y));
+            return flip ? -res : res;
+        };
+        edges[0] = edge(v1, v2);
+        edges[1] = edge(v2, v0);
+        edges[2] = edge(v0, v1);
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        float z_dx = (edges[1].x * (v1.z - v0.z) + edges[2].x * (v2.z - v0.z)) / area;
+        float z_dy = (edges[1].y * (v1.z - v0.z) + edges[2].y * (v2.z - v0.z)) / area;
+
+        int tile_x0 = static_cast<int>(tile % tiles_x) * tile_width, tile_y0 = static_cast<int>(tile / tiles_x) * tile_height;
+        auto [x0, y0, x1, y1] = pixel_bounds(tri, tile_x0, tile_y0, tile_x0 + tile_width, tile_y0 + tile_height);
+        x0 &= ~3;
+
+#ifdef OCCLUSION_RASTER_USE_SSE
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 edge_x[3];
+        for (int k = 0; k < 3; ++k) edge_x[k] = _mm_set1_ps(edges[k].x);
+        const __m128 z_x = _mm_set1_ps(z_dx);
+        const __m128 origin_x = _mm_set1_ps(v0.x);
+
+        for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            __m128 row_e[3];
+            for (int k = 0; k < 3; ++k) row_e[k] = _mm_set1_ps(edges[k].y * py + edges[k].z);
+            __m128 row_z = _mm_set1_ps(z_dy * (py - v0.y) + v0.z);
+
+            float * row = depth.data() + y * width;
+            for (int x = x0; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_x[0], px), row_e[0]), zero);
+                for (int k = 1; k < 3; ++k) inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_x[k], px), row_e[k]), zero));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 z = _mm_add_ps(_mm_mul_ps(z_x, _mm_sub_ps(px, origin_x)), row_z);
+                    __m128 old = _mm_loadu_ps(row + x);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+                }
+            }
+        }
+#else
+        for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            float * row = depth.data() + y * width;
+            for (int x = x0; x <= x1; ++x) {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (auto const& e : edges) inside = inside && e.x * px + (e.y * py + e.z) >= 0.0f;
+                if (inside) row[x] = std::min(row[x], z_dx * (px - v0.x) + (z_dy * (py - v0.y) + v0.z));
+            }
+        }
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "depth_pyramid.h"
+#include "occlusion_raster.h"
+
+// CPU only, renders test scenes with occlusion_rasterizer::render() and compares every pixel against a double
+// precision ray cast through its centre, then checks depth_pyramid::occludes_box() on the result, exits with 1
+// when a pixel is off, a shared edge leaves a crack or a box is wrongly occluded
+
+static constexpr int width = occlusion_rasterizer::width;
+static constexpr int height = occlusion_rasterizer::height;
+static constexpr double fov_y = 60.0 * 3.14159265358979 / 180.0;
+static constexpr double z_near = 0.1;
+static constexpr double z_far = 100.0;
+
+// pixel centres closer than this to an edge may go either way
+static constexpr double edge_slack = 1.0 / 64.0;
+static constexpr float depth_tolerance = 1e-5f;
+
+struct test_vertex {
+    glm::vec3 pos;
+};
+
+// a triangle soup in view space, the camera sits at the origin looking down -z
+struct test_scene {
+    std::vector<test_vertex> vertices;
+    std::vector<GLuint> indices;
+
+    void add(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+        GLuint first = static_cast<GLuint>(vertices.size());
+        vertices.insert(vertices.end(), {{a}, {b}, {c}});
+        indices.insert(indices.end(), {first, first + 1, first + 2});
+    }
+};
+
+glm::mat4 test_projection() {
+    return glm::perspective(static_cast<float>(fov_y), static_cast<float>(width) / height, static_cast<float>(z_near), static_cast<float>(z_far));
+}
+
+// the view space point that lands on window position x, y at view space depth distance
+glm::vec3 unproject(double x, double y, double distance) {
+    double tan_y = std::tan(fov_y / 2.0), tan_x = tan_y * width / height;
+    return glm::vec3(static_cast<float>((x / width * 2.0 - 1.0) * tan_x * distance), static_cast<float>((y / height * 2.0 - 1.0) * tan_y * distance),
+                     static_cast<float>(-distance));
+}
+
+// window depth of the nearest front face the ray through window position x, y hits between the clip planes, 1 on a miss
+double reference_depth(test_scene const& scene, double x, double y) {
+    double tan_y = std::tan(fov_y / 2.0), tan_x = tan_y * width / height;
+    double const dir[3] = {(x / width * 2.0 - 1.0) * tan_x, (y / height * 2.0 - 1.0) * tan_y, -1.0};
+    auto sub = [](double const * a, double const * b, double * res) { for (int k = 0; k < 3; ++k) res[k] = a[k] - b[k]; };
+    auto cross = [](double const * a, double const * b, double * res) {
+        res[0] = a[1] * b[2] - a[2] * b[1];
+        res[1] = a[2] * b[0] - a[0] * b[2];
+        res[2] = a[0] * b[1] - a[1] * b[0];
+    };
+    auto dot = [](double const * a, double const * b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+
+    double nearest = -z_far;
+    bool hit{false};
+    for (size_t i = 0; i < scene.indices.size(); i += 3) {
+        double p[3][3];
+        for (int k = 0; k < 3; ++k) {
+            glm::vec3 const& pos = scene.vertices[scene.indices[i + k]].pos;
+            for (int c = 0; c < 3; ++c) p[k][c] = pos[c];
+        }
+        double e1[3], e2[3], normal[3];
+        sub(p[1], p[0], e1);
+        sub(p[2], p[0], e2);
+        cross(e1, e2, normal);
+        double facing = dot(normal, dir);
+        if (facing >= 0.0) continue; // back facing, edge on or degenerate
+
+        // the ray is origin + t dir with dir.z = -1, so t is the view space distance
+        double t = dot(normal, p[0]) / facing;
+        if (t < z_near || -t <= nearest) continue;
+        double q[3] = {dir[0] * t, dir[1] * t, dir[2] * t}, c[3];
+        bool inside = true;
+        for (int k = 0; k < 3 && inside; ++k) {
+            double edge[3], to_q[3];
+            sub(p[(k + 1) % 3], p[k], edge);
+            sub(q, p[k], to_q);
+            cross(edge, to_q, c);
+            inside = dot(c, normal) >= 0.0;
+        }
+        if (!inside) continue;
+        nearest = -t;
+        hit = true;
+    }
+    if (!hit) return 1.0;
+
+    double ndc = ((z_far + z_near) * nearest + 2.0 * z_far * z_near) / ((z_far - z_near) * nearest);
+    return ndc * 0.5 + 0.5;
+}
+
+// every pixel has to fall within the reference depths at its centre and at points edge_slack away from it,
+// a crack is an uncovered pixel with all of those covered
+bool check_scene(std::string const& name, test_scene const& scene, occlusion_rasterizer& rasterizer, bool fully_covered = false) {
+    std::vector<occluder<test_vertex>> occluders{{&scene.vertices, &scene.indices, glm::mat4(1.0f)}};
+    rasterizer.render(occluders, test_projection());
+
+    size_t wrong{0}, cracks{0}, uncovered{0};
+    double max_error{0.0};
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double px = x + 0.5, py = y + 0.5;
+            double lo = reference_depth(scene, px, py), hi = lo;
+            for (auto [dx, dy] : {std::pair{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}}) {
+                double d = reference_depth(scene, px + dx * edge_slack, py + dy * edge_slack);
+                lo = std::min(lo, d);
+                hi = std::max(hi, d);
+            }
+
+            float got = rasterizer.depth[y * width + x];
+            uncovered += got == 1.0f;
+            double error = std::max({lo - got, got - hi, 0.0});
+            max_error = std::max(max_error, error);
+            if (error <= depth_tolerance) continue;
+            ++wrong;
+            cracks += got == 1.0f && hi < 1.0;
+        }
+    }
+
+    bool ok = wrong == 0 && (!fully_covered || uncovered == 0);
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": " << wrong << " wrong pixels, " << cracks << " cracks, " << uncovered
+              << " uncovered, max depth error " << max_error << std::endl;
+    return ok;
+}
+
+// flips the triangle to face the camera at the origin
+void add_facing(test_scene& scene, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    if (glm::dot(glm::cross(b - a, c - a), a) > 0.0f) std::swap(b, c);
+    scene.add(a, b, c);
+}
+
+bool check_box(std::string const& name, depth_pyramid const& pyramid, glm::vec3 lo, glm::vec3 hi, bool expected) {
+    bool occluded = pyramid.occludes_box(lo, hi, test_projection());
+    bool ok = occluded == expected;
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": " << (occluded ? "occluded" : "visible") << std::endl;
+    return ok;
+}
+
+int main() {
+    occlusion_rasterizer rasterizer;
+    std::mt19937 rng{11};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+    bool ok = true;
+
+    // two triangles well past the screen edges at one depth
+    test_scene quad;
+    quad.add({-50.0f, -50.0f, -5.0f}, {50.0f, -50.0f, -5.0f}, {50.0f, 50.0f, -5.0f});
+    quad.add({-50.0f, -50.0f, -5.0f}, {50.0f, 50.0f, -5.0f}, {-50.0f, 50.0f, -5.0f});
+    ok &= check_scene("full screen quad", quad, rasterizer, true);
+
+    depth_pyramid quad_pyramid = rasterizer.pyramid();
+    ok &= check_box("box behind the quad", quad_pyramid, {-0.5f, -0.5f, -8.0f}, {0.5f, 0.5f, -7.0f}, true);
+    ok &= check_box("box in front of the quad", quad_pyramid, {-0.5f, -0.5f, -4.0f}, {0.5f, 0.5f, -3.0f}, false);
+    ok &= check_box("box through the quad", quad_pyramid, {-0.5f, -0.5f, -6.0f}, {0.5f, 0.5f, -4.5f}, false);
+    ok &= check_box("box through the near plane", quad_pyramid, {-0.5f, -0.5f, -8.0f}, {0.5f, 0.5f, 1.0f}, false);
+    ok &= check_box("box outside the screen", quad_pyramid, {40.0f, -0.5f, -8.0f}, {41.0f, 0.5f, -7.0f}, false);
+
+    // a floor reaching behind the camera and a wall leaning over it with two corners behind the camera
+    test_scene clipped;
+    add_facing(clipped, {-4.0f, -1.0f, -20.0f}, {4.0f, -1.0f, -20.0f}, {0.0f, -1.0f, 3.0f});
+    add_facing(clipped, {-1.5f, 1.0f, 2.0f}, {1.0f, 1.2f, 1.0f}, {0.3f, -0.4f, -3.0f});
+    ok &= check_scene("near clipped triangles", clipped, rasterizer);
+
+    // half the screen covered, boxes behind either half
+    test_scene half;
+    half.add(unproject(0.0, -10.0, 5.0), unproject(width / 2.0, -10.0, 5.0), unproject(width / 2.0, height + 10.0, 5.0));
+    half.add(unproject(0.0, -10.0, 5.0), unproject(width / 2.0, height + 10.0, 5.0), unproject(0.0, height + 10.0, 5.0));
+    half.add(unproject(-10.0, -10.0, 5.0), unproject(0.0, -10.0, 5.0), unproject(0.0, height + 10.0, 5.0));
+    half.add(unproject(-10.0, -10.0, 5.0), unproject(0.0, height + 10.0, 5.0), unproject(-10.0, height + 10.0, 5.0));
+    ok &= check_scene("left half", half, rasterizer);
+    depth_pyramid half_pyramid = rasterizer.pyramid();
+    ok &= check_box("box behind the left half", half_pyramid, unproject(width * 0.2, height * 0.4, 7.0), unproject(width * 0.3, height * 0.6, 6.0), true);
+    ok &= check_box("box behind the right half", half_pyramid, unproject(width * 0.7, height * 0.4, 7.0), unproject(width * 0.8, height * 0.6, 6.0), false);
+    ok &= check_box("box across the edge", half_pyramid, unproject(width * 0.4, height * 0.4, 7.0), unproject(width * 0.6, height * 0.6, 6.0), false);
+
+    // a grid whose edges and diagonals run exactly through pixel centres, every centre on a shared edge has to be
+    // covered by one of its triangles
+    test_scene aligned;
+    for (int j = 0; j < 12; ++j) {
+        for (int i = 0; i < 24; ++i) {
+            double x0 = 24.5 + 8 * i, y0 = 12.5 + 8 * j, x1 = x0 + 8, y1 = y0 + 8;
+            aligned.add(unproject(x0, y0, 3.0), unproject(x1, y0, 3.0), unproject(x1, y1, 3.0));
+            aligned.add(unproject(x0, y0, 3.0), unproject(x1, y1, 3.0), unproject(x0, y1, 3.0));
+        }
+    }
+    ok &= check_scene("pixel aligned shared edges", aligned, rasterizer);
+
+    // a jittered grid on a slanted plane running from behind the camera far into the distance and off screen
+    test_scene jittered;
+    static constexpr int cells = 16;
+    std::vector<glm::vec3> points;
+    for (int j = 0; j <= cells; ++j) {
+        for (int i = 0; i <= cells; ++i) {
+            bool border = i == 0 || j == 0 || i == cells || j == cells;
+            float s = (i + (border ? 0.0f : 0.4f * unit(rng))) / cells, t = (j + (border ? 0.0f : 0.4f * unit(rng))) / cells;
+            points.push_back(glm::vec3(-6.0f, -2.5f, 1.0f) + s * glm::vec3(12.0f, 0.0f, 0.0f) + t * glm::vec3(-2.0f, 5.0f, -30.0f));
+        }
+    }
+    for (int j = 0; j < cells; ++j) {
+        for (int i = 0; i < cells; ++i) {
+            glm::vec3 a = points[j * (cells + 1) + i], b = points[j * (cells + 1) + i + 1];
+            glm::vec3 c = points[(j + 1) * (cells + 1) + i + 1], d = points[(j + 1) * (cells + 1) + i];
+            add_facing(jittered, a, b, c);
+            add_facing(jittered, a, c, d);
+        }
+    }
+    ok &= check_scene("jittered shared edges", jittered, rasterizer);
+
+    // random triangles of both windings crossing each other and the frustum planes
+    test_scene random;
+    for (int i = 0; i < 300; ++i) {
+        glm::vec3 centre{unit(rng) * 6.0f, unit(rng) * 3.0f, -6.0f + unit(rng) * 5.5f};
+        random.add(centre + glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f, centre + glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f,
+                   centre + glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f);
+    }
+    ok &= check_scene("random triangles", random, rasterizer);
+
+    return ok ? 0 : 1;
+}
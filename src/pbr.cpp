@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <string>
 #include <vector>
 
 #include <glad/glad.h>
@@ -18,9 +21,13 @@
 
 #include "vertices.h"
 #include "shader.h"
+#include "shader_watcher.h"
 #include "model.h"
+#include "geometry.h"
 #include "texture.h"
 #include "gl_util.h"
+#include "texture_cache.h"
+#include "sh.h"
 
 static unsigned int width = 1920;
 static unsigned int height = 1080;
@@ -35,6 +42,7 @@ glm::vec3 light_pos(1.2f, 1.0f, 2.0f);
 static bool use_ibl = true;
 static bool use_lamb = false;
 static bool use_par = true;
+static bool use_instancing = true;
 
 struct sdl_window {
     SDL_Window * window;
@@ -54,7 +62,7 @@ struct sdl_window {
             std::exit(1);
         }
 
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
         SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
@@ -89,6 +97,7 @@ struct sdl_window {
                         case SDL_SCANCODE_I: use_ibl = !use_ibl; break;
                         case SDL_SCANCODE_P: use_par = !use_par; break;
                         case SDL_SCANCODE_L: use_lamb = !use_lamb; break;
+                        case SDL_SCANCODE_G: use_instancing = !use_instancing; break;
                         default: break;
                     }
                     break;
@@ -152,91 +161,90 @@ struct sdl_window {
     }
 };
 
-void render_sphere() {
-    static GLuint sphere_vao = 0;
-    static unsigned int index_count;
-
-    if (sphere_vao == 0) {
-        glGenVertexArrays(1, &sphere_vao);
-
-        unsigned int vbo, ebo;
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
-
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> normals;
-        std::vector<unsigned int> indices;
-
-        const unsigned int X_SEGMENTS = 64;
-        const unsigned int Y_SEGMENTS = 64;
-        const float PI = 3.14159265359;
-        for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
-            for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-                float x_segment = (float)x / (float)X_SEGMENTS;
-                float y_segment = (float)y / (float)Y_SEGMENTS;
-                float x_pos = std::cos(x_segment * 2.0f * PI) * std::sin(y_segment * PI);
-                float y_pos = std::cos(y_segment * PI);
-                float z_pos = std::sin(x_segment * 2.0f * PI) * std::sin(y_segment * PI);
-
-                positions.push_back(glm::vec3(x_pos, y_pos, z_pos));
-                uv.push_back(glm::vec2(x_segment, y_segment));
-                normals.push_back(glm::vec3(x_pos, y_pos, z_pos));
-            }
-        }
+// count instances with draw ids first_id, first_id + 1, ...
+void render_sphere(GLuint first_id, GLuint count = 1) {
+    static auto const sphere = geometry_cache::load(shape::uv_sphere, 0);
+    sphere->draw_elements(first_id, count);
+}
 
-        bool odd_row = false;
-        for (size_t y = 0; y < Y_SEGMENTS; ++y) {
-            if (!odd_row) {
-                for (size_t x = 0; x <= X_SEGMENTS; ++x) {
-                    indices.push_back(y       * (X_SEGMENTS + 1) + x);
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                }
-            } else {
-                for (int x = X_SEGMENTS; x >= 0; --x) {
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                    indices.push_back(y       * (X_SEGMENTS + 1) + x);
-                }
-            }
-            odd_row = !odd_row;
-        }
-        index_count = indices.size();
-
-        std::vector<float> data;
-        for (size_t i = 0; i < positions.size(); ++i) {
-            data.push_back(positions[i].x);
-            data.push_back(positions[i].y);
-            data.push_back(positions[i].z);
-            if (normals.size() > 0) {
-                data.push_back(normals[i].x);
-                data.push_back(normals[i].y);
-                data.push_back(normals[i].z);
-            }
-            if (uv.size() > 0) {
-                data.push_back(uv[i].x);
-                data.push_back(uv[i].y);
+static constexpr GLuint instance_materials_binding = 1;
+
+// std430 layout of instance_material in pbr.frag
+struct instance_material_std430 {
+    glm::vec3 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+    float pad[2];
+};
+
+static_assert(sizeof(instance_material_std430) == 32, "instance_material_std430 has to match the std430 layout of instance_material");
+
+// metallic / roughness sphere grid, metallic increases along the rows and roughness along the columns,
+// the transforms and materials never change so they are uploaded once and the grid is a single instanced draw
+struct sphere_grid {
+    int rows;
+    int cols;
+    GLuint transform_ssbo;
+    GLuint material_ssbo;
+
+    sphere_grid(int rows, int cols, float spacing, glm::vec3 albedo) : rows{rows}, cols{cols} {
+        std::vector<glm::mat4> transforms;
+        std::vector<instance_material_std430> materials;
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                transforms.push_back(glm::translate(glm::mat4(1.0f), glm::vec3{
+                    (col - (cols / 2)) * spacing,
+                    (row - (rows / 2)) * spacing,
+                    0.0f
+                }));
+                materials.push_back({albedo, (float) row / (float) rows, glm::clamp((float) col / (float) cols, 0.05f, 1.0f), 1.0f, {}});
             }
         }
 
-        glBindVertexArray(sphere_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        float stride = (3 + 2 + 3) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glGenBuffers(1, &transform_ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, transform_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &material_ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, material_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(instance_material_std430), materials.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
 
-    glBindVertexArray(sphere_vao);
-    glDrawElements(GL_TRIANGLE_STRIP, index_count, GL_UNSIGNED_INT, 0);
-}
+    sphere_grid(sphere_grid const & other) = delete;
+    sphere_grid & operator=(sphere_grid const & other) = delete;
+
+    ~sphere_grid() {
+        glDeleteBuffers(1, &material_ssbo);
+        glDeleteBuffers(1, &transform_ssbo);
+    }
+
+    GLuint count() const {
+        return rows * cols;
+    }
+
+    // with a program built with USE_INSTANCE_MATERIAL, replaces the transforms bound to transforms_binding
+    void draw(bool instanced) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, transforms_binding, transform_ssbo);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, instance_materials_binding, material_ssbo);
+        if (instanced) {
+            render_sphere(0, count());
+        } else {
+            for (GLuint i = 0; i < count(); ++i) render_sphere(i);
+        }
+    }
+};
+
+int main(int argc, char * argv[]) {
+    // --grid n draws an n x n sphere grid for shading benchmarks
+    int grid_size = 7;
+    if (argc > 2 && std::string(argv[1]) == "--grid") grid_size = std::max(std::atoi(argv[2]), 1);
+    if (static_cast<size_t>(grid_size) * grid_size > max_draw_ids) {
+        std::cerr << "ERROR sphere grid larger than " << max_draw_ids << " draw ids" << std::endl;
+        return 1;
+    }
 
-int main(int, char * []) {
     sdl_window window(width, height, "LearnOpenGL");
 
     if (!gladLoadGLLoader((GLADloadproc) SDL_GL_GetProcAddress)) {
@@ -244,17 +252,21 @@ int main(int, char * []) {
         return -1;
     }
 
-    static const shader_program program{{GL_VERTEX_SHADER, "src/shaders/pbr/pbr.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/pbr.frag"}};
+    static shader_permutations program{{{GL_VERTEX_SHADER, "src/shaders/pbr/pbr.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/pbr.frag"}}, pbr_material::feature_defines};
     static const shader_program equi{{GL_VERTEX_SHADER, "src/shaders/pbr/equi.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/equi.frag"}};
-    static const shader_program conv{{GL_VERTEX_SHADER, "src/shaders/pbr/conv.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/conv.frag"}};
     static const shader_program spec_conv{{GL_VERTEX_SHADER, "src/shaders/pbr/spec_conv.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/spec_conv.frag"}};
     static const shader_program int_brdf{{GL_VERTEX_SHADER, "src/shaders/pbr/int_brdf.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/int_brdf.frag"}};
-    static const shader_program sky{{GL_VERTEX_SHADER, "src/shaders/pbr/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/sky.frag"}};
-    static const shader_program lamp{{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}};
+    static shader_program sky{{GL_VERTEX_SHADER, "src/shaders/pbr/sky.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/pbr/sky.frag"}};
+    static shader_program lamp{{GL_VERTEX_SHADER, "src/shaders/lamp.vert"}, {GL_FRAGMENT_SHADER, "src/shaders/lamp.frag"}};
 
-    static const model quad{"res/models/quad.obj"};
-    static const model cube{"res/models/cube.obj"};
-    static const model sphere{"res/models/sphere.obj"};
+    shader_watcher shader_watch;
+    shader_watch.add(program);
+    shader_watch.add(sky);
+    shader_watch.add(lamp);
+
+    auto const quad = geometry_cache::load(shape::plane, 0);
+    auto const cube = geometry_cache::load(shape::cube, 0);
+    auto const sphere = geometry_cache::load(shape::uv_sphere, 0);
 
     static const glm::vec3 sphere_color = glm::pow(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.2f));
     //static const glm::vec3 sphere_color = glm::pow(glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(2.2f));
@@ -271,64 +283,110 @@ int main(int, char * []) {
         glm::vec3(300.0f, 000.0f, 300.0f)
     };
 
-    hdr loft_hdr{"res/Newport_Loft/Newport_Loft_Ref.hdr"};
-    env_map loft_cube{2048};
-    env_map loft_conv{2048};
-    reflection_map loft_spec{512};
+    static const std::string loft_path{"res/Newport_Loft/Newport_Loft_Ref.hdr"};
+    reflection_map loft_spec{env_map_size(env_map_use::prefilter)};
 
     static const vao sky_vao(vertices, 8, {{3, 0}});
     cubemap sky_map{{"res/skybox/right.jpg", "res/skybox/left.jpg", "res/skybox/top.jpg", "res/skybox/bottom.jpg", "res/skybox/front.jpg", "res/skybox/back.jpg"}};
 
     framebuffer brdf_lut_fb{512, 512};
 
-    GLuint vp_ubo;
-    glGenBuffers(1, &vp_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4) + sizeof(float), NULL, GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, vp_ubo);
-
-    auto loft_render_func = [&](shader_program const& program, glm::vec3 pos) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, pos);
-        program.use();
-        program.set_uniforms("model", model);
-        activate_texture(loft_hdr, program, "tex", 0);
-        sky_vao.use();
-        glDepthMask(GL_FALSE);
-        glCullFace(GL_FRONT);
-        glDepthFunc(GL_LEQUAL);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthFunc(GL_LESS);
-        glCullFace(GL_BACK);
-        glDepthMask(GL_TRUE);
-    };
+    constant_ring constants;
 
-    auto spec_render_func = [&](shader_program const& program, glm::vec3 pos, float roughness) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, pos);
-        program.use();
-        program.set_uniforms("model", model, "roughness", roughness, "src_size", static_cast<int>(loft_cube.size));
-        glBindTexture(GL_TEXTURE_CUBE_MAP, loft_cube.tex);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-        loft_cube.activate(program, "tex", 0);
-        sky_vao.use();
-        glDepthMask(GL_FALSE);
-        glCullFace(GL_FRONT);
-        glDepthFunc(GL_LEQUAL);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthFunc(GL_LESS);
-        glCullFace(GL_BACK);
-        glDepthMask(GL_TRUE);
-    };
+    GLuint sh_ubo;
+    glGenBuffers(1, &sh_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, sh_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sh9::coeff_count * sizeof(glm::vec4), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, sh_ubo);
+
+    // the IBL maps only depend on the source image, the map sizes and the shaders generating them,
+    // diffuse irradiance is kept as L2 spherical harmonics instead of a cube map
+    std::vector<texture_slot> ibl_slots;
+    std::vector<float> ibl_values(sh9::coeff_count * 3);
+    for (size_t mip = 0; mip < loft_spec.mip_levels; ++mip) {
+        for (size_t face_idx = 0; face_idx < 6; ++face_idx) {
+            ibl_slots.push_back({loft_spec.tex, GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(face_idx), static_cast<GLint>(mip), GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV});
+        }
+    }
+    ibl_slots.push_back({brdf_lut_fb.color_buf, GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT});
+
+    texture_cache ibl_cache{"cache/newport_loft.ibl", hash_values(
+        hash_shader("src/shaders/pbr/equi.frag"),
+        hash_file("src/sh.h"),
+        hash_shader("src/shaders/pbr/spec_conv.frag"),
+        hash_shader("src/shaders/pbr/int_brdf.frag"),
+        env_map_size(env_map_use::source), loft_spec.size, brdf_lut_fb.width
+    ), {loft_path}};
+
+    auto ibl_start = std::chrono::steady_clock::now();
+    sh9 loft_sh;
+    if (ibl_cache.load(ibl_slots, ibl_values)) {
+        std::copy(ibl_values.begin(), ibl_values.end(), glm::value_ptr(loft_sh.coeffs[0]));
+        std::cout << "IBL maps loaded from " << ibl_cache.path;
+    } else {
+        hdr_image loft_image{loft_path};
+        hdr loft_hdr{loft_image};
+        env_map loft_cube{env_map_use::source, GL_R11F_G11F_B10F, false, true};
+
+        auto sh_start = std::chrono::steady_clock::now();
+        loft_sh = sh_project_equirect(loft_image.data.data(), loft_image.width, loft_image.height).irradiance();
+        std::cout << "SH irradiance projected in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sh_start).count() << " ms" << std::endl;
+        std::copy(glm::value_ptr(loft_sh.coeffs[0]), glm::value_ptr(loft_sh.coeffs[0]) + ibl_values.size(), ibl_values.begin());
+
+        auto loft_render_func = [&](shader_program const& program, glm::vec3 pos) {
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, pos);
+            program.use();
+            program.set_uniforms("model", model);
+            activate_texture(loft_hdr, program, "tex", 0);
+            sky_vao.use();
+            glDepthMask(GL_FALSE);
+            glCullFace(GL_FRONT);
+            glDepthFunc(GL_LEQUAL);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glDepthFunc(GL_LESS);
+            glCullFace(GL_BACK);
+            glDepthMask(GL_TRUE);
+        };
+
+        auto spec_render_func = [&](shader_program const& program, glm::vec3 pos, float roughness) {
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, pos);
+            program.use();
+            program.set_uniforms("model", model, "roughness", roughness, "src_size", static_cast<int>(loft_cube.size));
+            loft_cube.activate(program, "tex", 0);
+            sky_vao.use();
+            glDepthMask(GL_FALSE);
+            glCullFace(GL_FRONT);
+            glDepthFunc(GL_LEQUAL);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glDepthFunc(GL_LESS);
+            glCullFace(GL_BACK);
+            glDepthMask(GL_TRUE);
+        };
+
+        constants.begin_frame();
+        loft_cube.render(glm::vec3(0.0f), constants, 0.0f, [&](glm::vec3 pos) { loft_render_func(equi, pos); });
+        loft_cube.generate_mipmaps();
+        loft_spec.render(glm::vec3(0.0f), constants, 0.0f, [&](glm::vec3 pos, float roughness) { spec_render_func(spec_conv, pos, roughness); });
+        constants.end_frame();
+
+        int_brdf.use();
+        render_to_buffer(int_brdf, brdf_lut_fb, {});
+
+        ibl_cache.save(ibl_slots, ibl_values);
+        std::cout << "source cube map used " << loft_cube.vram_bytes() / (1024 * 1024) << " MB of VRAM until the IBL maps were generated" << std::endl;
+        std::cout << "IBL maps generated";
+    }
+    std::cout << " in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - ibl_start).count() << " ms" << std::endl;
 
-    loft_cube.render(glm::vec3(0.0f), vp_ubo, [&](glm::vec3 pos) { loft_render_func(equi, pos); });
-    loft_conv.render(glm::vec3(0.0f), vp_ubo, [&](glm::vec3 pos) { loft_render_func(conv, pos); });
-    loft_spec.render(glm::vec3(0.0f), vp_ubo, [&](glm::vec3 pos, float roughness) { spec_render_func(spec_conv, pos, roughness); });
+    std::cout << "prefiltered environment map uses " << loft_spec.vram_bytes() / 1024 << " KB of VRAM" << std::endl;
 
-    int_brdf.use();
-    render_to_buffer(int_brdf, brdf_lut_fb, {});
+    auto loft_sh_coeffs = loft_sh.std140();
+    glBindBuffer(GL_UNIFORM_BUFFER, sh_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(loft_sh_coeffs), loft_sh_coeffs.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     std::array<pbr_material, 7> materials{
         pbr_material{"rusted_iron", "res/pbr"},
@@ -346,8 +404,19 @@ int main(int, char * []) {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+    sphere_grid grid{grid_size, grid_size, 2.5f, sphere_color};
+
+    float cpu_ms_sum{0.0f};
+    size_t stat_frames{0};
+    auto stat_start = std::chrono::steady_clock::now();
+
     while (window.running) {
+        auto frame_start = std::chrono::steady_clock::now();
+        mesh::draw_calls = 0;
+
         window.handle_events();
+        shader_watch.update();
+        constants.begin_frame();
 
         //static float prev_time = window.get_time();
         //float cur_time = window.get_time();
@@ -361,12 +430,7 @@ int main(int, char * []) {
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        float ev = 0.0f;
-        glBindBuffer(GL_UNIFORM_BUFFER, vp_ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(view));
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projection));
-        glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(float), &ev);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        push_vp(constants, view, projection, 0.0f);
 
         // draw skybox
         sky.use();
@@ -383,75 +447,64 @@ int main(int, char * []) {
         glCullFace(GL_BACK);
         glDepthMask(GL_TRUE);
 
-        program.use();
-
-        program.set_uniforms("projection", projection, "view", view, "view_pos", camera_pos, "use_vert_tbn", false);
-        program.set_uniforms("use_ibl", use_ibl, "use_lamb", use_lamb, "use_par", use_par);
-        program.set_uniforms("material.albedo", sphere_color, "material.roughness", 40.0f, "material.ao", 1.0f);
-        loft_conv.activate(program, "irradiance_map", 0);
-        loft_spec.activate(program, "prefilter_map", 1);
-        brdf_lut_fb.activate_texture(program, "brdf_lut", 2);
-        for (size_t i = 0; i < 4; ++i) {
-            program.set_uniforms("point_lights[" + std::to_string(i) + "].pos", light_positions[i],
-                                 "point_lights[" + std::to_string(i) + "].color", light_colors[i]);
-
-        }
+        program.set_shared_uniforms([&, projection, view](shader_program const& variant) {
+            variant.set_uniforms("projection", projection, "view", view, "view_pos", camera_pos);
+            loft_spec.activate(variant, "prefilter_map", 1);
+            brdf_lut_fb.activate_texture(variant, "brdf_lut", 2);
+            for (size_t i = 0; i < 4; ++i) {
+                variant.set_uniforms("point_lights[" + std::to_string(i) + "].pos", light_positions[i],
+                                     "point_lights[" + std::to_string(i) + "].color", light_colors[i]);
+            }
+        });
+        uint32_t toggles = (use_ibl ? pbr_material::use_ibl : 0) | (use_lamb ? pbr_material::use_disney_diffuse : 0)
+                         | (use_par ? pbr_material::use_parallax : 0);
 
-        static constexpr int rows = 7;
-        static constexpr int cols = 7;
         static constexpr float spacing = 2.5;
-        pbr_material proc_mat{"proc", sphere_color, 1.0f, 0.05f, 1.0f};
-        proc_mat.activate(program, 3);
-        for (int row = 0; row < rows; ++row) {
-            program.set_uniform("material.metallic", (float) row / (float) rows);
-            for (int col = 0; col < cols; ++col) {
-                program.set_uniform("material.roughness", glm::clamp((float) col / (float) cols, 0.05f, 1.0f));
 
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3{
-                    (col - (cols / 2)) * spacing,
-                    (row - (rows / 2)) * spacing,
-                    0.0f
-                });
-                program.set_uniform("model", model);
-                render_sphere();
-            }
-        }
+        program.use(toggles | pbr_material::use_instance_material);
+        grid.draw(use_instancing);
 
+        // every other transform of the frame goes up as one block, draw id i reads transforms[i]
+        std::vector<glm::mat4> transforms;
         for (int mat_idx = 0; mat_idx < static_cast<int>(materials.size()); ++mat_idx) {
-            program.set_uniform("material.metallic", 1.0f);
-            program.set_uniform("material.roughness", glm::clamp((float) mat_idx / (float) 5, 0.05f, 1.0f));
-            program.set_uniforms("material.albedo", glm::vec3{1.0f, 0.5f, 0.0f}, "material.ao", 1.0f);
-            materials[mat_idx].activate(program, 3);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3{
+            transforms.push_back(glm::translate(glm::mat4(1.0f), glm::vec3{
                 (mat_idx - static_cast<int>(materials.size()) / 2) * spacing,
                 0.0f,
                 10.0f
-            });
-            program.set_uniform("model", model);
-            render_sphere();
+            }));
         }
-
-        program.set_uniforms("use_vert_tbn", true);
-        model = glm::mat4(1.0f);
-
-        model = glm::translate(model, glm::vec3{ -2 * spacing, 0.0f, 20.0f });
-        program.set_uniforms("model", model);
-        for (auto& mesh : quad.meshes) {
-            mesh.draw_pbr(program, materials[6], 3);
+        GLuint const mesh_first_id = transforms.size();
+        model = glm::translate(glm::mat4(1.0f), glm::vec3{ -2 * spacing, 0.0f, 20.0f });
+        for (size_t i = 0; i < 3; ++i) {
+            transforms.push_back(model);
+            model = glm::translate(model, glm::vec3{ spacing, 0.0f, 0.0f });
         }
+        push_transforms(constants, transforms);
 
-        model = glm::translate(model, glm::vec3{ spacing, 0.0f, 0.0f });
-        program.set_uniforms("model", model);
-        for (auto& mesh : cube.meshes) {
-            mesh.draw_pbr(program, materials[5], 3);
+        for (int mat_idx = 0; mat_idx < static_cast<int>(materials.size()); ++mat_idx) {
+            shader_program const& mat_program = program.use(materials[mat_idx].features() | toggles);
+            mat_program.set_uniform("material.metallic", 1.0f);
+            mat_program.set_uniform("material.roughness", glm::clamp((float) mat_idx / (float) 5, 0.05f, 1.0f));
+            mat_program.set_uniforms("material.albedo", glm::vec3{1.0f, 0.5f, 0.0f}, "material.ao", 1.0f);
+            materials[mat_idx].activate(mat_program, 3);
+            render_sphere(mat_idx);
         }
 
-        model = glm::translate(model, glm::vec3{ spacing, 0.0f, 0.0f });
-        program.set_uniforms("model", model);
-        for (auto& mesh : sphere.meshes) {
-            mesh.draw_pbr(program, materials[5], 3);
+        uint32_t mesh_toggles = toggles | pbr_material::use_vert_tbn;
+        quad->draw_pbr(program, materials[6], 3, mesh_toggles, mesh_first_id);
+        cube->draw_pbr(program, materials[5], 3, mesh_toggles, mesh_first_id + 1);
+        sphere->draw_pbr(program, materials[5], 3, mesh_toggles, mesh_first_id + 2);
+
+        constants.end_frame();
+
+        cpu_ms_sum += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        ++stat_frames;
+        if (std::chrono::steady_clock::now() - stat_start > std::chrono::seconds(1)) {
+            std::cout << grid.count() << " spheres " << (use_instancing ? "instanced" : "one draw each") << ": "
+                      << mesh::draw_calls << " draw calls, " << cpu_ms_sum / stat_frames << " ms CPU per frame" << std::endl;
+            cpu_ms_sum = 0.0f;
+            stat_frames = 0;
+            stat_start = std::chrono::steady_clock::now();
         }
 
         window.swap_buffer();
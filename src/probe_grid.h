@@ -0,0 +1,185 @@
+#ifndef PROBE_GRID_H
+#define PROBE_GRID_H
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gl_util.h"
+#include "sh.h"
+#include "texture_cache.h"
+
+// regular grid of light probes through a level: a cube map array of scene captures for glossy reflections
+// and the L2 spherical harmonics of every probe's irradiance for diffuse ambient
+struct probe_grid {
+    glm::vec3 grid_min;
+    glm::vec3 grid_max;
+    glm::ivec3 dims;
+    size_t capture_size;
+
+    GLuint cube_array;
+    GLuint sh_tex; // RGBA16F, one row of sh9::coeff_count texels per probe
+    env_map capture;
+    std::vector<float> sh_values; // irradiance / PI, sh9::coeff_count rgb triples per probe
+
+    size_t next_probe{0};
+    size_t next_face{0};
+
+    probe_grid(glm::vec3 grid_min, glm::vec3 grid_max, glm::ivec3 dims, size_t capture_size)
+        : grid_min{grid_min}, grid_max{grid_max}, dims{dims}, capture_size{capture_size},
+          capture{capture_size}, sh_values(probe_count() * sh9::coeff_count * 3, 0.0f) {
+        glActiveTexture(GL_TEXTURE0);
+
+        glGenTextures(1, &cube_array);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cube_array);
+        glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, mip_levels(), GL_R11F_G11F_B10F, capture_size, capture_size, 6 * probe_count());
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+        glGenTextures(1, &sh_tex);
+        glBindTexture(GL_TEXTURE_2D, sh_tex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, sh9::coeff_count, probe_count());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    probe_grid(probe_grid const & other) = delete;
+    probe_grid & operator=(probe_grid const & other) = delete;
+
+    ~probe_grid() {
+        glDeleteTextures(1, &sh_tex);
+        glDeleteTextures(1, &cube_array);
+    }
+
+    size_t probe_count() const {
+        return static_cast<size_t>(dims.x) * dims.y * dims.z;
+    }
+
+    GLsizei mip_levels() const {
+        return mip_count(capture_size);
+    }
+
+    glm::vec3 spacing() const {
+        return (grid_max - grid_min) / glm::vec3(glm::max(dims - 1, glm::ivec3(1)));
+    }
+
+    glm::vec3 probe_pos(size_t idx) const {
+        glm::ivec3 cell{
+            static_cast<int>(idx % dims.x),
+            static_cast<int>((idx / dims.x) % dims.y),
+            static_cast<int>(idx / (dims.x * dims.y))
+        };
+        return grid_min + spacing() * glm::vec3(cell);
+    }
+
+    bool complete() const {
+        return next_probe == probe_count();
+    }
+
+    void invalidate() {
+        next_probe = 0;
+        next_face = 0;
+    }
+
+    // render up to face_count probe faces, the SH of a probe are projected once its six faces are done
+    void bake(constant_ring & constants, float ev, size_t face_count, std::function<void(glm::vec3)> const& render_func) {
+        if (complete()) return;
+
+        for (; face_count > 0 && !complete(); --face_count) {
+            capture.render_face(probe_pos(next_probe), constants, ev, next_face, render_func);
+            if (++next_face == 6) {
+                finish_probe();
+                next_face = 0;
+                ++next_probe;
+            }
+        }
+
+        if (complete()) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cube_array);
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+            glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+            upload_sh();
+        }
+    }
+
+    // copy the capture into the probe's layer and project its irradiance, reads the capture back
+    void finish_probe() {
+        glCopyImageSubData(capture.tex, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+                           cube_array, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6 * next_probe,
+                           capture_size, capture_size, 6);
+
+        std::vector<float> faces(6 * capture_size * capture_size * 3);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, capture.tex);
+        for (size_t face_idx = 0; face_idx < 6; ++face_idx) {
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face_idx, 0, GL_RGB, GL_FLOAT, faces.data() + face_idx * capture_size * capture_size * 3);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        sh9 irradiance = sh_project_cube(faces.data(), capture_size).irradiance();
+        float const * coeffs = glm::value_ptr(irradiance.coeffs[0]);
+        std::copy(coeffs, coeffs + sh9::coeff_count * 3, sh_values.begin() + next_probe * sh9::coeff_count * 3);
+    }
+
+    void upload_sh() const {
+        std::vector<glm::vec4> texels(probe_count() * sh9::coeff_count);
+        for (size_t i = 0; i < texels.size(); ++i) {
+            texels[i] = glm::vec4(sh_values[3 * i], sh_values[3 * i + 1], sh_values[3 * i + 2], 0.0f);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, sh_tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sh9::coeff_count, probe_count(), GL_RGBA, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    std::vector<texture_slot> cache_slots() const {
+        std::vector<texture_slot> slots;
+        for (GLsizei level = 0; level < mip_levels(); ++level) {
+            slots.push_back({cube_array, GL_TEXTURE_CUBE_MAP_ARRAY, level, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV});
+        }
+        return slots;
+    }
+
+    bool load(texture_cache const& cache) {
+        std::vector<float> values(sh_values.size());
+        if (!cache.load(cache_slots(), values)) return false;
+
+        sh_values = values;
+        upload_sh();
+        next_probe = probe_count();
+        next_face = 0;
+        return true;
+    }
+
+    void save(texture_cache const& cache) const {
+        cache.save(cache_slots(), sh_values);
+    }
+
+    size_t vram_bytes() const {
+        size_t res{capture.vram_bytes() + probe_count() * sh9::coeff_count * texel_size(GL_RGBA16F)};
+        for (GLsizei level = 0; level < mip_levels(); ++level) {
+            size_t level_size = std::max<size_t>(capture_size >> level, 1);
+            res += 6 * probe_count() * level_size * level_size * texel_size(GL_R11F_G11F_B10F);
+        }
+        return res;
+    }
+
+    void activate(shader_program const& program, int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cube_array);
+        glActiveTexture(GL_TEXTURE0 + unit + 1);
+        glBindTexture(GL_TEXTURE_2D, sh_tex);
+        glActiveTexture(GL_TEXTURE0);
+
+        program.set_uniforms("probe_cubes", unit, "probe_sh", unit + 1);
+        program.set_uniforms("probe_grid_min", grid_min, "probe_grid_spacing", spacing(), "probe_max_lod", static_cast<float>(mip_levels() - 1));
+        program.set_uniform("probe_grid_dims", dims);
+    }
+};
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef RAY_QUERY_H
+#define RAY_QUERY_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "util.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RAY_QUERY_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// origin + t dir for t in [0, t_max), dir needn't be normalised, t is in units of its length
+struct ray {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    float t_max{FLT_MAX};
+};
+
+// u and v weight the triangle's second and third vertex
+struct ray_hit {
+    static constexpr uint32_t none = UINT32_MAX;
+
+    float t{FLT_MAX};
+    uint32_t triangle{none}; // first index / 3 of the triangle in the mesh's indices
+    float u{0.0f};
+    float v{0.0f};
+
+    bool hit() const {
+        return triangle != none;
+    }
+};
+
+// CPU ray queries against the triangles of one mesh, in the mesh's object space, a 4-wide bvh collapsed from the
+// binary SAH build of bvh.h so one ray tests four child boxes at once, with Woop, Benthin and Wald's
+// "Watertight Ray/Triangle Intersection" at the leaves so rays can't slip between triangles sharing an edge
+struct triangle_bvh {
+    static constexpr int max_depth = 48;               // deeper subtrees become one leaf, which bounds the stacks
+    static constexpr size_t stack_size = 3 * max_depth + 1;
+    static constexpr size_t max_packet = 32;           // rays per packet, one bit each in the traversal masks
+    static constexpr uint32_t no_child = UINT32_MAX;
+
+    // the boxes of four children side by side, slots past the last child have empty boxes no ray enters
+    struct node {
+        std::array<std::array<float, 4>, 6> bounds; // lo x, y, z then hi x, y, z of each child
+        std::array<uint32_t, 4> first;              // child node, or first triangle of a leaf
+        std::array<uint32_t, 4> count;              // triangles of a leaf, 0 for child nodes
+    };
+
+    struct triangle {
+        glm::vec3 v0, v1, v2;
+        uint32_t index; // see ray_hit::triangle
+    };
+
+    std::vector<node> nodes; // nodes[0] is the root
+    std::vector<triangle> triangles; // in leaf order, a leaf's triangles are contiguous
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    size_t bytes() const {
+        return nodes.size() * sizeof(node) + triangles.size() * sizeof(triangle);
+    }
+
+    // Vertex needs a pos like for build_meshlets()
+    template<typename Vertex>
+    void build(std::vector<Vertex> const& vertices, std::vector<GLuint> const& indices) {
+        nodes.clear();
+        triangles.clear();
+        size_t count = indices.size() / 3;
+        if (count == 0) return;
+
+        std::vector<aabb> boxes(count);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t k = 0; k < 3; ++k) boxes[i].grow(vertices[indices[3 * i + k]].pos);
+        }
+        bvh binary;
+        binary.build(boxes);
+
+        triangles.reserve(count);
+        for (uint32_t i : binary.items) {
+            triangles.push_back({vertices[indices[3 * i]].pos, vertices[indices[3 * i + 1]].pos, vertices[indices[3 * i + 2]].pos, i});
+        }
+        nodes.push_back({});
+        collapse(binary, 0, 0, 0);
+    }
+
+    // closest hit of r, a miss has no triangle
+    ray_hit intersect(ray const& r) const {
+        return trace<false>(r);
+    }
+
+    // whether anything lies on r, stops at the first hit found, for shadow and line of sight rays
+    bool occluded(ray const& r) const {
+        return trace<true>(r).hit();
+    }
+
+    // closest hits of count <= max_packet rays that traverse together, every node is fetched once for all rays
+    // still inside it, pays off for coherent rays like those of neighbouring pixels
+    void intersect(ray const* rays, size_t count, ray_hit* hits) const {
+        std::array<ray_setup, max_packet> setups;
+        std::array<float, max_packet> t_max;
+        uint32_t active{0};
+        for (size_t i = 0; i < count; ++i) {
+            hits[i] = {};
+            setups[i] = ray_setup(rays[i]);
+            t_max[i] = rays[i].t_max;
+            active |= 1u << i;
+        }
+        if (nodes.empty()) return;
+
+        struct {
+            uint32_t index;
+            uint32_t mask; // the rays still inside it
+        } stack[stack_size];
+        size_t top{0};
+        stack[top++] = {0, active};
+        while (top > 0) {
+            auto [index, mask] = stack[--top];
+            node const& n = nodes[index];
+
+            // children are ordered by the first ray's entries, the others mostly agree in a coherent packet
+            std::array<uint32_t, 4> child_masks{};
+            std::array<float, 4> order{FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+            bool first_ray{true};
+            for (size_t i = 0; i < count; ++i) {
+                if (!(mask >> i & 1u)) continue;
+                std::array<float, 4> entry;
+                int hit_mask = enter_children(n, setups[i], t_max[i], entry);
+                for (int k = 0; k < 4; ++k) {
+                    if (hit_mask >> k & 1) child_masks[k] |= 1u << i;
+                }
+                if (first_ray) {
+                    for (int k = 0; k < 4; ++k) order[k] = hit_mask >> k & 1 ? entry[k] : FLT_MAX;
+                    first_ray = false;
+                }
+            }
+
+            std::array<int, 4> sorted;
+            size_t child_count = sort_children(child_masks, order, sorted);
+            for (size_t j = 0; j < child_count; ++j) {
+                int k = sorted[j];
+                if (n.count[k] == 0) continue;
+                for (size_t i = 0; i < count; ++i) {
+                    if (!(child_masks[k] >> i & 1u)) continue;
+                    for (uint32_t t = n.first[k]; t < n.first[k] + n.count[k]; ++t) intersect_triangle(setups[i], triangles[t], t_max[i], hits[i]);
+                }
+            }
+            for (size_t j = child_count; j-- > 0;) {
+                int k = sorted[j];
+                if (n.count[k] == 0) stack[top++] = {n.first[k], child_masks[k]};
+            }
+        }
+    }
+
+    // closest hits of any number of rays on all hardware threads, runs of max_packet consecutive rays go through
+    // the packet path when packets is set, so callers should put coherent rays next to each other
+    std::vector<ray_hit> intersect(std::vector<ray> const& rays, bool packets = true) const {
+        std::vector<ray_hit> res(rays.size());
+        parallel_for((rays.size() + max_packet - 1) / max_packet, [this, &rays, &res, packets](size_t chunk) {
+            size_t first = chunk * max_packet;
+            size_t count = std::min(max_packet, rays.size() - first);
+            if (packets) {
+                intersect(rays.data() + first, count, res.data() + first);
+            } else {
+                for (size_t i = first; i < first + count; ++i) res[i] = intersect(rays[i]);
+            }
+        });
+        return res;
+    }
+
+    // occluded() of any number of rays on all hardware threads
+    std::vector<uint8_t> occluded(std::vector<ray> const& rays) const {
+        std::vector<uint8_t> res(rays.size());
+        parallel_for((rays.size() + max_packet - 1) / max_packet, [this, &rays, &res](size_t chunk) {
+            for (size_t i = chunk * max_packet; i < std::min((chunk + 1) * max_packet, rays.size()); ++i) res[i] = occluded(rays[i]);
+        });
+        return res;
+    }
+
+private:
+    // what the box and triangle tests need of a ray, computed once per ray
+    struct ray_setup {
+        glm::vec3 origin{0.0f};
+        glm::vec3 inv_dir{0.0f};
+        std::array<int, 3> enter_row{}; // rows of node::bounds with the entry planes, lo for positive directions
+        std::array<int, 3> exit_row{};
+        int kx{0}, ky{1}, kz{2}; // kz is the dominant direction axis
+        float sx{0.0f}, sy{0.0f}, sz{0.0f};
+
+        ray_setup() = default;
+
+        explicit ray_setup(ray const& r) : origin{r.origin} {
+            for (int axis = 0; axis < 3; ++axis) {
+                // a tiny instead of a zero component keeps 0 * inf out of the slab tests
+                inv_dir[axis] = 1.0f / (r.dir[axis] != 0.0f ? r.dir[axis] : 1e-30f);
+                enter_row[axis] = inv_dir[axis] >= 0.0f ? axis : axis + 3;
+                exit_row[axis] = inv_dir[axis] >= 0.0f ? axis + 3 : axis;
+            }
+
+            glm::vec3 d = glm::abs(r.dir);
+            kz = d.x >= d.y && d.x >= d.z ? 0 : d.y >= d.z ? 1 : 2;
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (r.dir[kz] < 0.0f) std::swap(kx, ky); // keeps the winding
+            sx = r.dir[kx] / r.dir[kz];
+            sy = r.dir[ky] / r.dir[kz];
+            sz = 1.0f / r.dir[kz];
+        }
+    };
+
+    template<bool any_hit>
+    ray_hit trace(ray const& r) const {
+        ray_hit res;
+        if (nodes.empty()) return res;
+        ray_setup s(r);
+        float t_max = r.t_max;
+
+        struct {
+            uint32_t index;
+            float entry;
+        } stack[stack_size];
+        size_t top{0};
+        stack[top++] = {0, 0.0f};
+        while (top > 0) {
+            auto [index, entry] = stack[--top];
+            if (entry >= t_max) continue;
+            node const& n = nodes[index];
+
+            std::array<float, 4> entries;
+            int hit_mask = enter_children(n, s, t_max, entries);
+            if (!hit_mask) continue;
+            std::array<uint32_t, 4> child_masks;
+            for (int k = 0; k < 4; ++k) child_masks[k] = hit_mask >> k & 1;
+            std::array<int, 4> sorted;
+            size_t child_count = sort_children(child_masks, entries, sorted);
+
+            // leaves first so the pushed children are compared against the lowered t_max when popped
+            for (size_t j = 0; j < child_count; ++j) {
+                int k = sorted[j];
+                for (uint32_t t = n.first[k]; t < n.first[k] + n.count[k]; ++t) {
+                    if (intersect_triangle(s, triangles[t], t_max, res) && any_hit) return res;
+                }
+            }
+            for (size_t j = child_count; j-- > 0;) {
+                int k = sorted[j];
+                if (n.count[k] == 0) stack[top++] = {n.first[k], entries[k]};
+            }
+        }
+        return res;
+    }
+
+    // exits are pushed out by the rounding error bound of Ize's "Robust BVH Ray Traversal", so a ray grazing a box
+    // edge still enters it and the triangle test alone decides
+    static constexpr float exit_scale = 1.0f + 2.0f * 3.0f * FLT_EPSILON;
+
+    // bit k is set when the ray enters child k's box before t_max, entry[k] is where
+    static int enter_children(node const& n, ray_setup const& s, float t_max, std::array<float, 4>& entry) {
+#ifdef RAY_QUERY_USE_SSE
+        __m128 enter = _mm_setzero_ps();
+        __m128 exit = _mm_set1_ps(t_max);
+        for (int axis = 0; axis < 3; ++axis) {
+            __m128 origin = _mm_set1_ps(s.origin[axis]);
+            __m128 inv_dir = _mm_set1_ps(s.inv_dir[axis]);
+            enter = _mm_max_ps(enter, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.bounds[s.enter_row[axis]].data()), origin), inv_dir));
+            exit = _mm_min_ps(exit, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.bounds[s.exit_row[axis]].data()), origin), inv_dir), _mm_set1_ps(exit_scale)));
+        }
+        _mm_storeu_ps(entry.data(), enter);
+        return _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+#else
+        int res{0};
+        for (int k = 0; k < 4; ++k) {
+            float enter{0.0f}, exit{t_max};
+            for (int axis = 0; axis < 3; ++axis) {
+                enter = std::max(enter, (n.bounds[s.enter_row[axis]][k] - s.origin[axis]) * s.inv_dir[axis]);
+                exit = std::min(exit, (n.bounds[s.exit_row[axis]][k] - s.origin[axis]) * s.inv_dir[axis] * exit_scale);
+            }
+            entry[k] = enter;
+            if (enter <= exit) res |= 1 << k;
+        }
+        return res;
+#endif
+    }
+
+    // the children with a non-zero mask nearest first, returns how many there are
+    static size_t sort_children(std::array<uint32_t, 4> const& masks, std::array<float, 4> const& entry, std::array<int, 4>& sorted) {
+        size_t res{0};
+        for (int k = 0; k < 4; ++k) {
+            if (!masks[k]) continue;
+            size_t j = res++;
+            for (; j > 0 && entry[sorted[j - 1]] > entry[k]; --j) sorted[j] = sorted[j - 1];
+            sorted[j] = k;
+        }
+        return res;
+    }
+
+    // the triangle is sheared and scaled so the ray runs along +z from the origin, then the edge functions of
+    // the projected triangle decide the hit, they're exact for shared edges up to rounding that both neighbours
+    // share, so a hit below t_max lowers it and fills hit
+    static bool intersect_triangle(ray_setup const& s, triangle const& tri, float& t_max, ray_hit& hit) {
+        glm::vec3 a = tri.v0 - s.origin;
+        glm::vec3 b = tri.v1 - s.origin;
+        glm::vec3 c = tri.v2 - s.origin;
+        float ax = a[s.kx] - s.sx * a[s.kz], ay = a[s.ky] - s.sy * a[s.kz];
+        float bx = b[s.kx] - s.sx * b[s.kz], by = b[s.ky] - s.sy * b[s.kz];
+        float cx = c[s.kx] - s.sx * c[s.kz], cy = c[s.ky] - s.sy * c[s.kz];
+
+        float u = cx * by - cy * bx;
+        float v = ax * cy - ay * cx;
+        float w = bx * ay - by * ax;
+        // a zero edge function may be rounding, the paper redoes those in double
+        if (u == 0.0f || v == 0.0f || w == 0.0f) {
+            u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+            v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+            w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+        }
+        if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) return false;
+        float det = u + v + w;
+        if (det == 0.0f) return false;
+
+        // t * det, compared without dividing so misses stay cheap
+        float t_det = u * s.sz * a[s.kz] + v * s.sz * b[s.kz] + w * s.sz * c[s.kz];
+        if (det > 0.0f ? t_det < 0.0f || t_det >= t_max * det : t_det > 0.0f || t_det <= t_max * det) return false;
+
+        float inv_det = 1.0f / det;
+        t_max = t_det * inv_det;
+        hit = {t_max, tri.index, v * inv_det, w * inv_det};
+        return true;
+    }
+
+    // first and one past the last triangle under the binary node, a subtree's triangles are contiguous
+    static std::pair<uint32_t, uint32_t> triangle_range(bvh const& binary, uint32_t index) {
+        uint32_t lo = index, hi = index;
+        while (!binary.nodes[lo].leaf()) lo = binary.nodes[lo].first;
+        while (!binary.nodes[hi].leaf()) hi = binary.nodes[hi].first + 1;
+        return {binary.nodes[lo].first, binary.nodes[hi].first + binary.nodes[hi].count};
+    }
+
+    // fills nodes[index] with up to four descendants of the binary node, opening the largest interior one first
+    void collapse(bvh const& binary, uint32_t binary_index, uint32_t index, int depth) {
+        std::array<uint32_t, 4> children{binary_index};
+        size_t child_count{1};
+        if (!binary.nodes[binary_index].leaf()) {
+            children = {binary.nodes[binary_index].first, binary.nodes[binary_index].first + 1};
+            child_count = 2;
+        }
+        while (child_count < 4) {
+            int largest{-1};
+            float largest_area{-1.0f};
+            for (size_t k = 0; k < child_count; ++k) {
+                bvh::node const& c = binary.nodes[children[k]];
+                if (!c.leaf() && c.bounds.half_area() > largest_area) {
+                    largest = static_cast<int>(k);
+                    largest_area = c.bounds.half_area();
+                }
+            }
+            if (largest < 0) break;
+            uint32_t opened = children[largest];
+            children[largest] = binary.nodes[opened].first;
+            children[child_count++] = binary.nodes[opened].first + 1;
+        }
+
+        node n;
+        for (size_t k = 0; k < 4; ++k) {
+            aabb box = k < child_count ? binary.nodes[children[k]].bounds : aabb{};
+            for (int axis = 0; axis < 3; ++axis) {
+                n.bounds[axis][k] = box.lo[axis];
+                n.bounds[axis + 3][k] = box.hi[axis];
+            }
+            n.first[k] = no_child;
+            n.count[k] = 0;
+        }
+        for (size_t k = 0; k < child_count; ++k) {
+            bvh::node const& c = binary.nodes[children[k]];
+            if (c.leaf() || depth + 1 >= max_depth) {
+                auto [first, end] = triangle_range(binary, children[k]);
+                n.first[k] = first;
+                n.count[k] = end - first;
+            } else {
+                n.first[k] = static_cast<uint32_t>(nodes.size());
+                nodes.push_back({});
+                collapse(binary, children[k], n.first[k], depth + 1);
+            }
+        }
+        nodes[index] = n;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef REFLECTION_PROBE_H
+#define REFLECTION_PROBE_H
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "gl_util.h"
+
+// scene capture around a point, refreshed a few faces per frame into a back map while the
+// front map stays visible, the new capture is blended in once all six faces are done
+struct reflection_probe {
+    glm::vec3 pos;
+    std::array<env_map, 2> maps;
+    size_t front{0};
+    size_t next_face{0};
+    bool dirty{true};
+    bool has_capture{false};
+    size_t stale_frames{0};
+    float blend{1.0f}; // weight of the front map against the previous capture
+
+    reflection_probe(glm::vec3 pos, size_t size) : pos{pos}, maps{env_map{size}, env_map{size}} { }
+
+    env_map const& back() const {
+        return maps[1 - front];
+    }
+
+    void invalidate() {
+        dirty = true;
+        next_face = 0;
+        stale_frames = 0;
+    }
+
+    // stale probes close to the camera first
+    float priority(glm::vec3 camera_pos) const {
+        return (1.0f + stale_frames) / (1.0f + glm::length(camera_pos - pos));
+    }
+
+    // returns the number of faces rendered
+    size_t render_faces(constant_ring & constants, float ev, size_t face_count, std::function<void(glm::vec3)> const& render_func) {
+        // the back map still holds the capture being blended out, finish the blend before overwriting it
+        if (next_face == 0) blend = 1.0f;
+
+        size_t rendered{0};
+        for (; rendered < face_count && next_face < 6; ++rendered, ++next_face) {
+            back().render_face(pos, constants, ev, next_face, render_func);
+        }
+
+        if (next_face == 6) {
+            front = 1 - front;
+            blend = has_capture ? 0.0f : 1.0f;
+            has_capture = true;
+            dirty = false;
+            next_face = 0;
+        }
+
+        return rendered;
+    }
+
+    void activate(shader_program const& program, std::string const& name, std::string const& prev_name, std::string const& blend_name, int unit) const {
+        maps[front].activate(program, name, unit);
+        (blend < 1.0f ? back() : maps[front]).activate(program, prev_name, unit + 1);
+        program.set_uniform(blend_name, blend);
+    }
+};
+
+// schedules probe captures so only a fixed number of cube faces is rendered per frame
+struct reflection_probe_set {
+    std::vector<reflection_probe> probes;
+    size_t faces_per_frame;
+    float blend_step; // blend progress per frame once a capture completes
+
+    reflection_probe_set(std::initializer_list<glm::vec3> positions, size_t size, size_t faces_per_frame = 1, float blend_step = 0.05f)
+        : faces_per_frame{faces_per_frame}, blend_step{blend_step} {
+        for (auto pos : positions) {
+            probes.emplace_back(pos, size);
+        }
+    }
+
+    void invalidate() {
+        for (auto& probe : probes) probe.invalidate();
+    }
+
+    // capture everything at once, for startup
+    void render_all(constant_ring & constants, float ev, std::function<void(glm::vec3)> const& render_func) {
+        for (auto& probe : probes) {
+            if (probe.dirty) probe.render_faces(constants, ev, 6 - probe.next_face, render_func);
+            probe.blend = 1.0f;
+        }
+    }
+
+    void update(glm::vec3 camera_pos, constant_ring & constants, float ev, std::function<void(glm::vec3)> const& render_func) {
+        for (auto& probe : probes) {
+            if (probe.dirty) ++probe.stale_frames;
+            probe.blend = std::min(probe.blend + blend_step, 1.0f);
+        }
+
+        size_t budget = faces_per_frame;
+        while (budget > 0) {
+            // a capture in progress is finished first so a probe never shows mixed faces for long
+            auto target = std::find_if(probes.begin(), probes.end(), [](reflection_probe const& probe) {
+                return probe.dirty && probe.next_face > 0;
+            });
+            if (target == probes.end()) {
+                target = probes.end();
+                for (auto it = probes.begin(); it != probes.end(); ++it) {
+                    if (it->dirty && (target == probes.end() || it->priority(camera_pos) > target->priority(camera_pos))) target = it;
+                }
+            }
+            if (target == probes.end()) break;
+
+            budget -= target->render_faces(constants, ev, budget, render_func);
+        }
+    }
+
+    size_t vram_bytes() const {
+        size_t res{0};
+        for (auto& probe : probes) {
+            for (auto& map : probe.maps) res += map.vram_bytes();
+        }
+        return res;
+    }
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "constant_ring.h"
+#include "gl_util.h"
+#include "meshlet.h"
+#include "model.h"
+#include "ray_query.h"
+#include "shader.h"
+
+// transform hierarchy over the meshes of any number of models, every mesh instance is an object with world space
+// bounds kept in a bvh for frustum, light and pick queries, moving nodes only refits the bvh until it has degraded
+// by rebuild_ratio, Model needs nodes like model's and meshes with bounds_min, bounds_max and a ray_tree, the draws
+// need model itself
+template<typename Model>
+struct basic_scene_graph {
+    static constexpr float rebuild_ratio = 1.5f;
+
+    struct node {
+        std::string name;
+        int parent; // -1 for roots, parents come before their children
+        glm::mat4 local;
+        glm::mat4 world;
+        glm::mat4 object_from_world; // inverse of world for the ray queries, kept by update()
+    };
+
+    struct object {
+        size_t node;
+        Model const * source;
+        size_t mesh; // index into source->meshes
+        aabb bounds; // world space
+
+        auto const& get_mesh() const {
+            return source->meshes[mesh];
+        }
+    };
+
+    std::vector<node> nodes;
+    std::vector<object> objects;
+    bvh tree;
+
+    std::vector<bool> dirty_nodes; // local changed since the last update()
+    bool structure_changed{true};  // nodes or objects were added, update() rebuilds
+    float built_cost{0.0f};        // tree.sah_cost() right after the last build
+
+    size_t add_node(std::string name, int parent, glm::mat4 const& local) {
+        glm::mat4 world = parent < 0 ? local : nodes[parent].world * local;
+        nodes.push_back({std::move(name), parent, local, world, glm::inverse(world)});
+        dirty_nodes.push_back(false);
+        structure_changed = true;
+        return nodes.size() - 1;
+    }
+
+    // instantiates m's node hierarchy under a new node with transform, m has to outlive the scene, returns that node
+    size_t add_model(Model const& m, glm::mat4 const& transform, int parent = -1, std::string name = "model") {
+        size_t root = add_node(std::move(name), parent, transform);
+        std::vector<size_t> mapped(m.nodes.size());
+        for (size_t i = 0; i < m.nodes.size(); ++i) {
+            model_node const& n = m.nodes[i];
+            mapped[i] = add_node(n.name, n.parent < 0 ? static_cast<int>(root) : static_cast<int>(mapped[n.parent]), n.local);
+            for (size_t mesh : n.meshes) objects.push_back({mapped[i], &m, mesh, {}});
+        }
+        return root;
+    }
+
+    void set_local(size_t index, glm::mat4 const& local) {
+        nodes[index].local = local;
+        dirty_nodes[index] = true;
+    }
+
+    // propagates transforms, recomputes the bounds of the objects below changed nodes and refits or rebuilds the bvh
+    void update() {
+        std::vector<bool> moved(nodes.size(), false);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            node& n = nodes[i];
+            moved[i] = dirty_nodes[i] || (n.parent >= 0 && moved[n.parent]) || structure_changed;
+            if (moved[i]) {
+                n.world = n.parent < 0 ? n.local : nodes[n.parent].world * n.local;
+                n.object_from_world = glm::inverse(n.world);
+            }
+            dirty_nodes[i] = false;
+        }
+
+        std::vector<uint32_t> changed;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            object& o = objects[i];
+            if (!moved[o.node]) continue;
+            auto const& m = o.get_mesh();
+            o.bounds = aabb{m.bounds_min, m.bounds_max}.transformed(nodes[o.node].world);
+            changed.push_back(static_cast<uint32_t>(i));
+        }
+
+        if (structure_changed) {
+            rebuild();
+            structure_changed = false;
+        } else if (!changed.empty()) {
+            std::vector<aabb> boxes = bounds();
+            // a full sweep is cheaper than walking up from most of the leaves
+            if (changed.size() * 8 > objects.size()) {
+                tree.refit(boxes);
+            } else {
+                tree.refit(boxes, changed);
+            }
+            if (tree.sah_cost() > rebuild_ratio * built_cost) rebuild();
+        }
+    }
+
+    void rebuild() {
+        tree.build(bounds());
+        built_cost = tree.sah_cost();
+    }
+
+    std::vector<aabb> bounds() const {
+        std::vector<aabb> res;
+        res.reserve(objects.size());
+        for (auto const& o : objects) res.push_back(o.bounds);
+        return res;
+    }
+
+    // objects whose bounds intersect the frustum of view_projection, which may also be orthographic like a light's
+    std::vector<uint32_t> query_frustum(glm::mat4 const& view_projection) const {
+        cull_view view = cull_view::perspective(view_projection, glm::vec3(0.0f));
+        std::vector<uint32_t> res;
+        tree.traverse([&view](aabb const& box) { return !box.outside(view.planes); }, [&res](uint32_t i) { res.push_back(i); });
+        return res;
+    }
+
+    // objects whose bounds intersect the sphere, e.g. the reach of a point light
+    std::vector<uint32_t> query_sphere(glm::vec3 centre, float radius) const {
+        auto touches = [centre, radius](aabb const& box) {
+            glm::vec3 d = glm::max(glm::max(box.lo - centre, centre - box.hi), glm::vec3(0.0f));
+            return glm::dot(d, d) <= radius * radius;
+        };
+        std::vector<uint32_t> res;
+        tree.traverse(touches, [this, &touches, &res](uint32_t i) {
+            if (touches(objects[i].bounds)) res.push_back(i);
+        });
+        return res;
+    }
+
+    // the object whose triangles origin + t dir hits first, t_max is lowered to the hit distance, returns -1 on a miss
+    int64_t pick(glm::vec3 origin, glm::vec3 dir, float& t_max) const {
+        return pick(origin, dir, t_max, [this, origin, dir](object const& o, float t) { return intersect(o, {origin, dir, t}).t; });
+    }
+
+    // the same with hit(object, t_max) returning the distance along the ray to the object or FLT_MAX
+    template<typename Hit>
+    int64_t pick(glm::vec3 origin, glm::vec3 dir, float& t_max, Hit const& hit) const {
+        return tree.raycast(origin, dir, t_max, [this, &hit](uint32_t i, float t) { return hit(objects[i], t); });
+    }
+
+    // whether any object's triangles lie between from and to, e.g. between a light and a surface
+    bool occluded(glm::vec3 from, glm::vec3 to) const {
+        float t_max{1.0f};
+        auto blocks = [this, from, to](object const& o, float t) {
+            return o.get_mesh().ray_tree.occluded(object_space(o, {from, to - from, t})) ? 0.0f : FLT_MAX;
+        };
+        return pick(from, to - from, t_max, blocks) >= 0;
+    }
+
+    // closest hit of the world space r on the object's triangles, its triangle indexes the object's mesh
+    ray_hit intersect(object const& o, ray const& r) const {
+        return o.get_mesh().ray_tree.intersect(object_space(o, r));
+    }
+
+    // draw id i of these draws reads the world transform of selected[i], see push_transforms()
+    void push_transforms(constant_ring & constants, std::vector<uint32_t> const& selected) const {
+        std::vector<glm::mat4> transforms;
+        transforms.reserve(selected.size());
+        for (uint32_t i : selected) transforms.push_back(nodes[objects[i].node].world);
+        ::push_transforms(constants, transforms);
+    }
+
+    void draw(shader_permutations & permutations, constant_ring & constants, std::vector<uint32_t> const& selected, uint32_t extra_features = 0) const {
+        push_transforms(constants, selected);
+        for (size_t i = 0; i < selected.size(); ++i) objects[selected[i]].get_mesh().draw(permutations, extra_features, static_cast<GLuint>(i));
+    }
+
+    // see model::draw_depth()
+    void draw_depth(shader_permutations & permutations, constant_ring & constants, std::vector<uint32_t> const& selected) const {
+        push_transforms(constants, selected);
+        for (bool alpha_tested : {false, true}) {
+            for (size_t i = 0; i < selected.size(); ++i) {
+                auto const& m = objects[selected[i]].get_mesh();
+                if (m.alpha_tested() == alpha_tested) m.draw_depth(permutations, static_cast<GLuint>(i));
+            }
+        }
+    }
+
+private:
+    // r moved into the object's space, dir isn't normalised there so t means the same in both
+    ray object_space(object const& o, ray const& r) const {
+        glm::mat4 const& object_from_world = nodes[o.node].object_from_world;
+        return {glm::vec3(object_from_world * glm::vec4(r.origin, 1.0f)), glm::vec3(object_from_world * glm::vec4(r.dir, 0.0f)), r.t_max};
+    }
+};
+
+using scene_graph = basic_scene_graph<model>;
+
+#endif
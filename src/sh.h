@@ -0,0 +1,246 @@
+#ifndef SH_H
+#define SH_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SH_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// order 2 (L2) real spherical harmonics with rgb coefficients
+struct sh9 {
+    static constexpr size_t coeff_count = 9;
+
+    std::array<glm::vec3, coeff_count> coeffs{};
+
+    static std::array<float, coeff_count> basis(glm::vec3 n) {
+        return {
+            0.282095f,
+            0.488603f * n.y,
+            0.488603f * n.z,
+            0.488603f * n.x,
+            1.092548f * n.x * n.y,
+            1.092548f * n.y * n.z,
+            0.315392f * (3.0f * n.z * n.z - 1.0f),
+            1.092548f * n.x * n.z,
+            0.546274f * (n.x * n.x - n.y * n.y)
+        };
+    }
+
+    glm::vec3 eval(glm::vec3 n) const {
+        auto b = basis(n);
+        glm::vec3 res{0.0f};
+        for (size_t i = 0; i < coeff_count; ++i) {
+            res += coeffs[i] * b[i];
+        }
+        return res;
+    }
+
+    // convolve with the clamped cosine lobe, scaled by 1 / PI since pbr.frag multiplies irradiance by albedo directly
+    sh9 irradiance() const {
+        static constexpr std::array<float, coeff_count> band_factors{
+            1.0f,
+            2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+            0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+        };
+
+        sh9 res;
+        for (size_t i = 0; i < coeff_count; ++i) {
+            res.coeffs[i] = coeffs[i] * band_factors[i];
+        }
+        return res;
+    }
+
+    // layout of a std140 vec4[9] array
+    std::array<glm::vec4, coeff_count> std140() const {
+        std::array<glm::vec4, coeff_count> res;
+        for (size_t i = 0; i < coeff_count; ++i) {
+            res[i] = glm::vec4(coeffs[i], 0.0f);
+        }
+        return res;
+    }
+
+    sh9& operator+=(sh9 const& other) {
+        for (size_t i = 0; i < coeff_count; ++i) {
+            coeffs[i] += other.coeffs[i];
+        }
+        return *this;
+    }
+};
+
+#ifdef SH_USE_SSE
+inline float sh_horizontal_sum(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+#endif
+
+// project rows [row_begin, row_end) of an equirectangular rgb image, the columns' cos(phi) and sin(phi) are precomputed
+inline sh9 sh_project_rows(float const * rgb, int width, int height, int row_begin, int row_end,
+                           std::vector<float> const& cos_phi, std::vector<float> const& sin_phi) {
+    static constexpr float PI = 3.14159265359f;
+    const float pixel_angle = (2.0f * PI / width) * (PI / height);
+
+    sh9 res;
+    for (int row = row_begin; row < row_end; ++row) {
+        // row 0 is the bottom of the image, matching spherical_uv() in the shaders with a flipped load
+        float lat = ((row + 0.5f) / height - 0.5f) * PI;
+        float y = std::sin(lat);
+        float r = std::cos(lat);
+        float weight = pixel_angle * r;
+        float const * row_data = rgb + static_cast<size_t>(row) * width * 3;
+
+        sh9 row_res;
+        int col = 0;
+
+#ifdef SH_USE_SSE
+        const __m128 r4 = _mm_set1_ps(r);
+        const __m128 y4 = _mm_set1_ps(y);
+        const __m128 w4 = _mm_set1_ps(weight);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 three = _mm_set1_ps(3.0f);
+        const __m128 c0 = _mm_set1_ps(0.282095f);
+        const __m128 c1 = _mm_set1_ps(0.488603f);
+        const __m128 c2 = _mm_set1_ps(1.092548f);
+        const __m128 c3 = _mm_set1_ps(0.315392f);
+        const __m128 c4 = _mm_set1_ps(0.546274f);
+
+        __m128 acc[sh9::coeff_count][3];
+        for (auto& coeff_acc : acc) {
+            for (auto& channel_acc : coeff_acc) channel_acc = _mm_setzero_ps();
+        }
+
+        for (; col + 4 <= width; col += 4) {
+            __m128 x = _mm_mul_ps(r4, _mm_loadu_ps(&cos_phi[col]));
+            __m128 z = _mm_mul_ps(r4, _mm_loadu_ps(&sin_phi[col]));
+
+            __m128 b[sh9::coeff_count] = {
+                c0,
+                _mm_mul_ps(c1, y4),
+                _mm_mul_ps(c1, z),
+                _mm_mul_ps(c1, x),
+                _mm_mul_ps(c2, _mm_mul_ps(x, y4)),
+                _mm_mul_ps(c2, _mm_mul_ps(y4, z)),
+                _mm_mul_ps(c3, _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(z, z)), one)),
+                _mm_mul_ps(c2, _mm_mul_ps(x, z)),
+                _mm_mul_ps(c4, _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y4, y4)))
+            };
+
+            float const * px = row_data + col * 3;
+            __m128 color[3] = {
+                _mm_mul_ps(w4, _mm_set_ps(px[9], px[6], px[3], px[0])),
+                _mm_mul_ps(w4, _mm_set_ps(px[10], px[7], px[4], px[1])),
+                _mm_mul_ps(w4, _mm_set_ps(px[11], px[8], px[5], px[2]))
+            };
+
+            for (size_t i = 0; i < sh9::coeff_count; ++i) {
+                for (size_t c = 0; c < 3; ++c) {
+                    acc[i][c] = _mm_add_ps(acc[i][c], _mm_mul_ps(b[i], color[c]));
+                }
+            }
+        }
+
+        for (size_t i = 0; i < sh9::coeff_count; ++i) {
+            for (size_t c = 0; c < 3; ++c) {
+                row_res.coeffs[i][c] = sh_horizontal_sum(acc[i][c]);
+            }
+        }
+#endif
+
+        for (; col < width; ++col) {
+            glm::vec3 dir{r * cos_phi[col], y, r * sin_phi[col]};
+            float const * px = row_data + col * 3;
+            glm::vec3 color = weight * glm::vec3{px[0], px[1], px[2]};
+            auto b = sh9::basis(dir);
+            for (size_t i = 0; i < sh9::coeff_count; ++i) {
+                row_res.coeffs[i] += b[i] * color;
+            }
+        }
+
+        res += row_res;
+    }
+
+    return res;
+}
+
+// project an equirectangular rgb float image (as loaded for hdr) into L2 spherical harmonics of radiance
+inline sh9 sh_project_equirect(float const * rgb, int width, int height) {
+    static constexpr float PI = 3.14159265359f;
+
+    // u = atan(z, x) / 2PI + 0.5, see spherical_uv() in the shaders
+    std::vector<float> cos_phi(width), sin_phi(width);
+    for (int col = 0; col < width; ++col) {
+        float phi = ((col + 0.5f) / width - 0.5f) * 2.0f * PI;
+        cos_phi[col] = std::cos(phi);
+        sin_phi[col] = std::sin(phi);
+    }
+
+    int thread_count = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, height);
+    int rows_per_thread = (height + thread_count - 1) / thread_count;
+
+    std::vector<sh9> partials(thread_count);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        int row_begin = std::min(t * rows_per_thread, height);
+        int row_end = std::min(row_begin + rows_per_thread, height);
+        threads.emplace_back([&, t, row_begin, row_end]() {
+            partials[t] = sh_project_rows(rgb, width, height, row_begin, row_end, cos_phi, sin_phi);
+        });
+    }
+
+    sh9 res;
+    for (int t = 0; t < thread_count; ++t) {
+        threads[t].join();
+        res += partials[t];
+    }
+    return res;
+}
+
+// direction through texel coordinates s, t in [-1, 1] of a cube map face, see the cube map face table of the GL spec
+inline glm::vec3 cube_face_dir(size_t face_idx, float s, float t) {
+    switch (face_idx) {
+        case 0: return glm::vec3( 1.0f, -t, -s);
+        case 1: return glm::vec3(-1.0f, -t,  s);
+        case 2: return glm::vec3( s,  1.0f,  t);
+        case 3: return glm::vec3( s, -1.0f, -t);
+        case 4: return glm::vec3( s, -t,  1.0f);
+        default: return glm::vec3(-s, -t, -1.0f);
+    }
+}
+
+// project six rgb float cube map faces of size x size texels (as read back by glGetTexImage) into L2 spherical harmonics of radiance,
+// probe captures are small so this stays on the calling thread
+inline sh9 sh_project_cube(float const * rgb, size_t size) {
+    sh9 res;
+    for (size_t face_idx = 0; face_idx < 6; ++face_idx) {
+        for (size_t y = 0; y < size; ++y) {
+            float t = (y + 0.5f) / size * 2.0f - 1.0f;
+            for (size_t x = 0; x < size; ++x) {
+                float s = (x + 0.5f) / size * 2.0f - 1.0f;
+
+                // solid angle of the texel
+                float r2 = 1.0f + s * s + t * t;
+                float weight = 4.0f / (size * size * r2 * std::sqrt(r2));
+
+                float const * px = rgb + ((face_idx * size + y) * size + x) * 3;
+                glm::vec3 color = weight * glm::vec3{px[0], px[1], px[2]};
+                auto b = sh9::basis(glm::normalize(cube_face_dir(face_idx, s, t)));
+                for (size_t i = 0; i < sh9::coeff_count; ++i) {
+                    res.coeffs[i] += b[i] * color;
+                }
+            }
+        }
+    }
+    return res;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "sh.h"
+
+// CPU only, checks sh_project_equirect() followed by sh9::irradiance() against a brute force cosine weighted
+// integral of the same equirectangular image, exits with 1 when any environment is off by more than its tolerance
+
+static constexpr float PI = 3.14159265359f;
+static constexpr int width = 256;
+static constexpr int height = 128;
+
+// direction through the centre of texel col, row, the same mapping as sh_project_rows()
+glm::vec3 texel_dir(int col, int row) {
+    float phi = ((col + 0.5f) / width - 0.5f) * 2.0f * PI;
+    float lat = ((row + 0.5f) / height - 0.5f) * PI;
+    return {std::cos(lat) * std::cos(phi), std::sin(lat), std::cos(lat) * std::sin(phi)};
+}
+
+std::vector<float> make_image(std::function<glm::vec3(glm::vec3)> const& radiance) {
+    std::vector<float> res(width * height * 3);
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            glm::vec3 color = radiance(texel_dir(col, row));
+            for (int c = 0; c < 3; ++c) res[(row * width + col) * 3 + c] = color[c];
+        }
+    }
+    return res;
+}
+
+// irradiance / PI like sh9::irradiance(), summed over every texel's solid angle
+glm::vec3 brute_force_irradiance(std::vector<float> const& image, glm::vec3 n) {
+    float const pixel_angle = (2.0f * PI / width) * (PI / height);
+    glm::vec3 res{0.0f};
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            glm::vec3 dir = texel_dir(col, row);
+            float cosine = std::max(glm::dot(n, dir), 0.0f);
+            float const * px = image.data() + (row * width + col) * 3;
+            res += glm::vec3(px[0], px[1], px[2]) * (cosine * pixel_angle * std::cos(((row + 0.5f) / height - 0.5f) * PI));
+        }
+    }
+    return res / PI;
+}
+
+// normals spread over the sphere by the golden angle
+std::vector<glm::vec3> test_normals(size_t count) {
+    std::vector<glm::vec3> res;
+    for (size_t i = 0; i < count; ++i) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / count;
+        float r = std::sqrt(1.0f - y * y);
+        float phi = i * PI * (3.0f - std::sqrt(5.0f));
+        res.push_back({r * std::cos(phi), y, r * std::sin(phi)});
+    }
+    return res;
+}
+
+// the largest error over the normals relative to the brightest brute force irradiance, L2 can't represent
+// sharp lighting exactly so each environment gets its own tolerance
+bool check(std::string const& name, std::function<glm::vec3(glm::vec3)> const& radiance, float tolerance) {
+    std::vector<float> image = make_image(radiance);
+    sh9 irradiance = sh_project_equirect(image.data(), width, height).irradiance();
+
+    float max_error{0.0f}, max_value{0.0f};
+    for (glm::vec3 n : test_normals(64)) {
+        glm::vec3 reference = brute_force_irradiance(image, n);
+        glm::vec3 error = glm::abs(irradiance.eval(n) - reference);
+        max_error = std::max({max_error, error.x, error.y, error.z});
+        max_value = std::max({max_value, reference.x, reference.y, reference.z});
+    }
+    float relative = max_error / max_value;
+    bool ok = relative <= tolerance;
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": max error " << 100.0f * relative << "% of the peak irradiance, tolerance "
+              << 100.0f * tolerance << "%" << std::endl;
+    return ok;
+}
+
+int main() {
+    glm::vec3 const lobe_dir = glm::normalize(glm::vec3(0.3f, 0.8f, -0.5f));
+    glm::vec3 const spot_dir = glm::normalize(glm::vec3(-0.6f, 0.2f, 0.7f));
+
+    bool ok = true;
+    ok &= check("constant", [](glm::vec3) { return glm::vec3(0.8f, 1.0f, 1.2f); }, 0.005f);
+    ok &= check("one lobe", [lobe_dir](glm::vec3 d) { return glm::vec3(2.0f, 1.5f, 1.0f) * std::max(glm::dot(d, lobe_dir), 0.0f); }, 0.02f);
+    ok &= check("hot spot", [spot_dir](glm::vec3 d) {
+        return glm::vec3(0.1f) + (glm::dot(d, spot_dir) > std::cos(0.1f) ? glm::vec3(500.0f, 400.0f, 300.0f) : glm::vec3(0.0f));
+    }, 0.1f);
+    return ok ? 0 : 1;
+}
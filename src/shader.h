@@ -1,8 +1,16 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
@@ -12,88 +20,433 @@
 
 #include "util.h"
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// GLSL source with #include "file" resolved relative to the including file, each file is included once,
+// #line directives use the index into files as source string number so messages can be traced back
+struct glsl_source {
+    std::string text;
+    std::vector<std::string> files; // files[0] is the shader itself
+
+    struct cache_entry {
+        std::string text;
+        std::vector<std::string> files;
+        std::vector<size_t> file_hashes;
+    };
+    static inline std::unordered_map<std::string, cache_entry> cache;
+
+    // reuses the previous resolution of path while none of the files it pulled in changed
+    static glsl_source load(std::string const& path) {
+        auto it = cache.find(path);
+        if (it != cache.end()) {
+            auto& entry = it->second;
+            bool unchanged = true;
+            for (size_t i = 0; i < entry.files.size() && unchanged; ++i) {
+                unchanged = hash_file(entry.files[i]) == entry.file_hashes[i];
+            }
+            if (unchanged) return {entry.text, entry.files};
+        }
+
+        glsl_source res;
+        res.append_file(path);
+
+        cache_entry entry{res.text, res.files, {}};
+        for (auto& file : res.files) entry.file_hashes.push_back(hash_file(file));
+        cache.insert_or_assign(path, std::move(entry));
+        return res;
+    }
+
+    void append_file(std::string const& path) {
+        size_t file_idx = files.size();
+        files.push_back(path);
+        if (file_idx > 0) text += "#line 1 " + std::to_string(file_idx) + "\n";
+
+        std::istringstream lines(load_string(path));
+        std::string line;
+        for (size_t line_no = 1; std::getline(lines, line); ++line_no) {
+            size_t directive = line.find_first_not_of(" \t");
+            if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+                text += line + "\n";
+                continue;
+            }
+
+            size_t name_begin = line.find('"', directive);
+            size_t name_end = name_begin == std::string::npos ? std::string::npos : line.find('"', name_begin + 1);
+            if (name_end == std::string::npos) {
+                std::cerr << "ERROR malformed #include in " << path << ":" << line_no << std::endl;
+                text += "\n";
+                continue;
+            }
+
+            std::string name = line.substr(name_begin + 1, name_end - name_begin - 1);
+            std::string include_path = (std::filesystem::path(path).parent_path() / name).lexically_normal().string();
+            if (std::find(files.begin(), files.end(), include_path) == files.end()) {
+                append_file(include_path);
+                text += "#line " + std::to_string(line_no + 1) + " " + std::to_string(file_idx) + "\n";
+            } else {
+                text += "\n";
+            }
+        }
+    }
+};
+
+// like hash_file() but covering the included files too
+inline size_t hash_shader(std::string const& path) {
+    return std::hash<std::string>()(glsl_source::load(path).text);
+}
+
+// a shader stage's source, shader_program only compiles it when the program binary is not cached
 struct shader {
-    GLuint id;
+    GLenum type;
+    std::string path;
+    std::string src;
+    std::vector<std::string> files; // path and everything it includes
 
     template<typename PathType>
-    shader(GLenum type, PathType path) {
-        id = glCreateShader(type);
+    shader(GLenum type, PathType path) : type{type}, path{std::filesystem::path(path).string()} {
+        reload();
+    }
 
-        std::string src = load_string(path);
-        char const * src_str = src.c_str();
+    void reload() {
+        glsl_source source = glsl_source::load(path);
+        src = std::move(source.text);
+        files = std::move(source.files);
+    }
+
+    // files whose changes require a rebuild
+    std::vector<std::string> dependencies() const {
+        return files;
+    }
+
+    // the defines go right after the #version line, #line keeps compiler messages pointing at the file's own lines
+    std::string specialise(std::vector<std::string> const& defines) const {
+        if (defines.empty()) return src;
+
+        size_t version_end = src.rfind("#version", 0) == 0 ? src.find('\n') : std::string::npos;
+        size_t insert_pos = version_end == std::string::npos ? 0 : version_end + 1;
+        size_t first_line = version_end == std::string::npos ? 1 : 2;
+
+        std::string res = src.substr(0, insert_pos);
+        for (auto& define : defines) res += "#define " + define + "\n";
+        res += "#line " + std::to_string(first_line) + " 0\n";
+        res += src.substr(insert_pos);
+        return res;
+    }
+
+    // doesn't wait for the result, see print_log()
+    GLuint compile(std::vector<std::string> const& defines) const {
+        GLuint id = glCreateShader(type);
+
+        std::string specialised = specialise(defines);
+        char const * src_str = specialised.c_str();
         glShaderSource(id, 1, &src_str, NULL);
         glCompileShader(id);
 
+        return id;
+    }
+
+    void print_log(GLuint id) const {
         GLint info_log_len;
         glGetShaderiv(id, GL_INFO_LOG_LENGTH, &info_log_len);
 
         if (info_log_len > 0) {
-            std::vector<char> msg;
-            msg.reserve(info_log_len);
+            std::vector<char> msg(info_log_len);
             glGetShaderInfoLog(id, info_log_len, NULL, msg.data());
             std::cout << "SHADER info log for " << path << ":" << std::endl;
+            for (size_t i = 1; i < files.size(); ++i) std::cout << "source string " << i << ": " << files[i] << std::endl;
             std::cout << msg.data() << std::endl;
         }
     }
+};
+
+struct shader_program {
+    static constexpr uint32_t binary_magic = 0x42475250; // "PRGB"
+    static inline std::string const binary_cache_dir{"cache/shaders"};
+
+    GLuint id;
+    std::string name; // stage file names and defines, for messages
+    std::vector<shader> shaders;
+    std::vector<std::string> defines;
+
+    // replacement being linked by reload(), swapped in by poll_reload() once it links
+    GLuint pending{0};
+    std::vector<GLuint> pending_stages;
+    std::chrono::steady_clock::time_point reload_start;
+    size_t generation{0}; // bumped whenever id changes, uniforms set on the old program are gone
+
+    static inline size_t uniform_calls{0}; // set_uniform() calls over all programs, for the per-frame count
+
+    shader_program(std::initializer_list<shader> shaders, std::vector<std::string> const& defines = {})
+        : shader_program(std::vector<shader>(shaders), defines) { }
+
+    shader_program(std::vector<shader> const& shaders, std::vector<std::string> const& defines) : shaders{shaders}, defines{defines} {
+        auto start = std::chrono::steady_clock::now();
+
+        id = glCreateProgram();
+
+        for (auto && s : shaders) {
+            name += (name.empty() ? "" : "+") + std::filesystem::path(s.path).filename().string();
+        }
+        for (auto& define : defines) {
+            name += " " + define;
+        }
+
+        float source_ms;
+        if (load_binary(binary_path(), source_ms)) {
+            float binary_ms = elapsed_ms(start);
+            std::cout << "PROGRAM " << name << " loaded from binary in " << binary_ms << " ms, saving " << source_ms - binary_ms << " ms" << std::endl;
+            return;
+        }
+
+        // nothing to fall back to on startup
+        if (!finish_link(id, start_link(id))) std::exit(1);
+
+        source_ms = elapsed_ms(start);
+        std::cout << "PROGRAM " << name << " compiled from source in " << source_ms << " ms" << std::endl;
+        save_binary(binary_path(), source_ms);
+    }
 
-    shader(shader && other) {
+    shader_program(shader_program && other)
+        : name{std::move(other.name)}, shaders{std::move(other.shaders)}, defines{std::move(other.defines)},
+          pending_stages{std::move(other.pending_stages)}, reload_start{other.reload_start}, generation{other.generation} {
         id = other.id;
         other.id = 0;
+        pending = other.pending;
+        other.pending = 0;
     }
 
-    shader & operator=(shader && other) {
+    shader_program & operator=(shader_program && other) {
         std::swap(id, other.id);
+        std::swap(name, other.name);
+        std::swap(shaders, other.shaders);
+        std::swap(defines, other.defines);
+        std::swap(pending, other.pending);
+        std::swap(pending_stages, other.pending_stages);
+        std::swap(reload_start, other.reload_start);
+        ++generation;
         return *this;
     }
 
-    shader(shader const & other) = delete;
-    shader & operator=(shader const & other) = delete;
+    shader_program(shader_program const & other) = delete;
+    shader_program & operator=(shader_program const & other) = delete;
 
-    ~shader() {
-        glDeleteShader(id);
+    ~shader_program() {
+        cancel_reload();
+        glDeleteProgram(id);
     }
-};
 
-struct shader_program {
-    GLuint id;
+    static float elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
 
-    shader_program(std::initializer_list<shader> shaders) {
-        id = glCreateProgram();
+    std::string binary_path() const {
+        size_t key = driver_hash();
+        for (auto && s : shaders) hash_combine(key, s.type, s.src);
+        for (auto& define : defines) hash_combine(key, define);
+        return binary_cache_dir + "/" + std::to_string(key) + ".bin";
+    }
 
+    // compile and link without querying any status, so a driver with parallel compilation doesn't block
+    std::vector<GLuint> start_link(GLuint program) const {
+        std::vector<GLuint> stage_ids;
         for (auto && s : shaders) {
-            glAttachShader(id, s.id);
+            stage_ids.push_back(s.compile(defines));
+            glAttachShader(program, stage_ids.back());
+        }
+        if (binaries_supported()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        return stage_ids;
+    }
+
+    // prints the logs and releases the stages, warnings are printed but only a failed link is an error
+    bool finish_link(GLuint program, std::vector<GLuint> const& stage_ids) const {
+        for (size_t i = 0; i < stage_ids.size(); ++i) {
+            shaders[i].print_log(stage_ids[i]);
+            glDetachShader(program, stage_ids[i]);
+            glDeleteShader(stage_ids[i]);
         }
-        glLinkProgram(id);
 
         GLint info_log_len;
-        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &info_log_len);
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_len);
 
         if (info_log_len > 0) {
-            std::vector<char> msg;
-            msg.reserve(info_log_len);
-            glGetProgramInfoLog(id, info_log_len, NULL, msg.data());
-            std::cout << "PROGRAM info log:" << std::endl;
+            std::vector<char> msg(info_log_len);
+            glGetProgramInfoLog(program, info_log_len, NULL, msg.data());
+            std::cout << "PROGRAM info log for " << name << ":" << std::endl;
             std::cout << msg.data() << std::endl;
+        }
 
-            std::exit(1);
+        GLint link_status;
+        glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+        if (!link_status) std::cerr << "ERROR linking program " << name << std::endl;
+        return link_status;
+    }
+
+    static bool parallel_compile_supported() {
+        static bool const supported = []() {
+            GLint extension_count{0};
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+            for (GLint i = 0; i < extension_count; ++i) {
+                std::string extension = reinterpret_cast<char const *>(glGetStringi(GL_EXTENSIONS, i));
+                if (extension == "GL_KHR_parallel_shader_compile" || extension == "GL_ARB_parallel_shader_compile") return true;
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    // re-read the sources and start building a replacement, the current program stays in use meanwhile
+    void reload() {
+        cancel_reload();
+        for (auto& s : shaders) s.reload();
+
+        reload_start = std::chrono::steady_clock::now();
+        pending = glCreateProgram();
+        pending_stages = start_link(pending);
+    }
+
+    void cancel_reload() {
+        if (!pending) return;
+
+        for (auto stage_id : pending_stages) glDeleteShader(stage_id);
+        pending_stages.clear();
+        glDeleteProgram(pending);
+        pending = 0;
+    }
+
+    // swaps in a finished reload, without parallel compilation this waits for the driver,
+    // returns true while a reload is still in progress
+    bool poll_reload() {
+        if (!pending) return false;
+
+        if (parallel_compile_supported()) {
+            GLint done{GL_FALSE};
+            glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) return true;
+        }
+
+        if (finish_link(pending, pending_stages)) {
+            std::swap(id, pending);
+            ++generation;
+            float source_ms = elapsed_ms(reload_start);
+            std::cout << "PROGRAM " << name << " reloaded in " << source_ms << " ms" << std::endl;
+            save_binary(binary_path(), source_ms);
+        } else {
+            std::cout << "PROGRAM " << name << " keeps its previous version" << std::endl;
         }
+
+        pending_stages.clear();
+        glDeleteProgram(pending);
+        pending = 0;
+        return false;
     }
 
-    shader_program(shader_program && other) {
-        id = other.id;
-        other.id = 0;
+    // program binaries need GL 4.1 and at least one binary format from the driver
+    static bool binaries_supported() {
+        if (!GLAD_GL_VERSION_4_1) return false;
+
+        GLint format_count{0};
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        return format_count > 0;
     }
 
-    shader_program & operator=(shader_program && other) {
-        std::swap(id, other.id);
-        return *this;
+    // binaries are only valid for the driver that produced them
+    static size_t driver_hash() {
+        auto gl_string = [](GLenum name) {
+            char const * str = reinterpret_cast<char const *>(glGetString(name));
+            return std::string(str ? str : "");
+        };
+        return hash_values(gl_string(GL_VENDOR), gl_string(GL_RENDERER), gl_string(GL_VERSION));
     }
 
-    shader_program(shader_program const & other) = delete;
-    shader_program & operator=(shader_program const & other) = delete;
+    bool load_binary(std::string const& path, float& source_ms) const {
+        if (!binaries_supported()) return false;
 
-    ~shader_program() {
-        glDeleteProgram(id);
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) return false;
+
+        uint32_t file_magic;
+        GLenum format;
+        GLint length;
+        ifs.read(reinterpret_cast<char *>(&file_magic), sizeof(file_magic));
+        ifs.read(reinterpret_cast<char *>(&format), sizeof(format));
+        ifs.read(reinterpret_cast<char *>(&source_ms), sizeof(source_ms));
+        ifs.read(reinterpret_cast<char *>(&length), sizeof(length));
+        if (!ifs || file_magic != binary_magic || length <= 0) return false;
+
+        std::vector<char> binary(length);
+        ifs.read(binary.data(), binary.size());
+        if (!ifs) return false;
+
+        // drivers reject binaries after updates, the program is then built from source as usual
+        glProgramBinary(id, format, binary.data(), length);
+        GLint link_status;
+        glGetProgramiv(id, GL_LINK_STATUS, &link_status);
+        if (!link_status) {
+            std::cout << "PROGRAM binary " << path << " was rejected, compiling from source" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void save_binary(std::string const& path, float source_ms) const {
+        if (!binaries_supported()) return;
+
+        GLint length{0};
+        glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(id, length, NULL, &format, binary.data());
+
+        std::filesystem::create_directories(binary_cache_dir);
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs) {
+            std::cerr << "ERROR writing program binary " << path << std::endl;
+            return;
+        }
+
+        ofs.write(reinterpret_cast<char const *>(&binary_magic), sizeof(binary_magic));
+        ofs.write(reinterpret_cast<char const *>(&format), sizeof(format));
+        ofs.write(reinterpret_cast<char const *>(&source_ms), sizeof(source_ms));
+        ofs.write(reinterpret_cast<char const *>(&length), sizeof(length));
+        ofs.write(binary.data(), binary.size());
+    }
+
+    static bool is_sampler_type(GLenum type) {
+        switch (type) {
+            case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW: case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_2D_ARRAY_SHADOW: case GL_SAMPLER_CUBE_MAP_ARRAY: case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+            case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // GL has no instruction counts, active samplers and uniforms plus the driver's binary size stand in for them
+    void print_stats() const {
+        GLint uniform_count{0};
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &uniform_count);
+
+        size_t sampler_count{0};
+        for (GLint i = 0; i < uniform_count; ++i) {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(id, i, 0, NULL, &size, &type, NULL);
+            if (is_sampler_type(type)) sampler_count += size;
+        }
+
+        GLint binary_length{0};
+        if (binaries_supported()) glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+
+        std::cout << "PROGRAM " << name << ": " << sampler_count << " samplers, " << uniform_count << " uniforms, "
+                  << binary_length / 1024.0f << " KiB binary" << std::endl;
     }
 
     void use() const {
@@ -102,6 +455,7 @@ struct shader_program {
 
     template<typename T>
     void set_uniform(GLchar const * name, T t) const {
+        ++uniform_calls;
         GLint uniform = glGetUniformLocation(id, name);
         if (uniform < 0) {
             //std::cerr << "ERROR finding uniform " << name << std::endl;
@@ -119,6 +473,8 @@ struct shader_program {
             glUniform2fv(uniform, 1, glm::value_ptr(t));
         } else if constexpr (std::is_same_v<T, glm::vec3>) {
             glUniform3fv(uniform, 1, glm::value_ptr(t));
+        } else if constexpr (std::is_same_v<T, glm::ivec3>) {
+            glUniform3iv(uniform, 1, glm::value_ptr(t));
         } else if constexpr (std::is_same_v<T, glm::mat4>) {
             glUniformMatrix4fv(uniform, 1, GL_FALSE, glm::value_ptr(t));
         } else {
@@ -141,4 +497,117 @@ struct shader_program {
     }
 };
 
+// specialisations of one set of shader sources, bit i of a feature mask adds #define feature_defines[i],
+// each permutation is compiled the first time it is used
+struct shader_permutations {
+    struct variant {
+        shader_program program;
+        bool needs_shared{true};
+        size_t shared_generation{0}; // program generation the shared uniforms were set on
+    };
+
+    std::vector<shader> shaders;
+    std::vector<std::string> feature_defines;
+    std::unordered_map<uint32_t, variant> variants;
+    std::function<void(shader_program const&)> shared_uniforms;
+
+    shader_permutations(std::initializer_list<shader> shaders, std::vector<std::string> feature_defines)
+        : shaders{shaders}, feature_defines{std::move(feature_defines)} { }
+
+    // binds the permutation and sets the shared uniforms on it if they changed since its last use, the only way to
+    // reach a permutation's program since set_uniform() writes to whichever program is bound
+    shader_program const& use(uint32_t features) {
+        variant& v = get_variant(features);
+        v.program.use();
+        if ((v.needs_shared || v.shared_generation != v.program.generation) && shared_uniforms) shared_uniforms(v.program);
+        v.needs_shared = false;
+        v.shared_generation = v.program.generation;
+        return v.program;
+    }
+
+    // uniforms common to all permutations (camera, lights, ...), typically set once per frame
+    void set_shared_uniforms(std::function<void(shader_program const&)> func) {
+        shared_uniforms = std::move(func);
+        for (auto& [features, v] : variants) v.needs_shared = true;
+    }
+
+    variant& get_variant(uint32_t features) {
+        auto it = variants.find(features);
+        if (it != variants.end()) return it->second;
+
+        std::vector<std::string> defines;
+        for (size_t bit = 0; bit < feature_defines.size(); ++bit) {
+            if (features & (1u << bit)) defines.push_back(feature_defines[bit]);
+        }
+
+        it = variants.emplace(features, variant{shader_program{shaders, defines}}).first;
+        it->second.program.print_stats();
+        return it->second;
+    }
+};
+
+// CPU copy of a std140 uniform block, T has to match the block byte for byte with explicit padding,
+// update() uploads only the range that changed since the last upload
+template<typename T>
+struct uniform_block {
+    GLuint binding;
+    GLuint ubo;
+    T data{};
+    T uploaded{};
+    bool valid{false};
+
+    explicit uniform_block(GLuint binding) : binding{binding} {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    uniform_block(uniform_block && other) : binding{other.binding}, ubo{other.ubo}, data{other.data}, uploaded{other.uploaded}, valid{other.valid} {
+        other.ubo = 0;
+    }
+
+    uniform_block & operator=(uniform_block && other) {
+        std::swap(binding, other.binding);
+        std::swap(ubo, other.ubo);
+        std::swap(data, other.data);
+        std::swap(uploaded, other.uploaded);
+        std::swap(valid, other.valid);
+        return *this;
+    }
+
+    uniform_block(uniform_block const & other) = delete;
+    uniform_block & operator=(uniform_block const & other) = delete;
+
+    ~uniform_block() {
+        glDeleteBuffers(1, &ubo);
+    }
+
+    // returns whether anything was uploaded
+    bool update() {
+        unsigned char const * src = reinterpret_cast<unsigned char const *>(&data);
+        unsigned char const * prev = reinterpret_cast<unsigned char const *>(&uploaded);
+
+        size_t first{0};
+        size_t last{sizeof(T)};
+        if (valid) {
+            while (first < last && src[first] == prev[first]) ++first;
+            while (last > first && src[last - 1] == prev[last - 1]) --last;
+            if (first == last) return false;
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, first, last - first, src + first);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        uploaded = data;
+        valid = true;
+        return true;
+    }
+
+    void bind() const {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+    }
+};
+
 #endif
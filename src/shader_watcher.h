@@ -0,0 +1,144 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "shader.h"
+
+// rebuilds registered programs when one of their source files changes, programs are swapped
+// only once the new version links so a typo never takes down the running demo
+// the file watching uses inotify, elsewhere nothing is reloaded
+struct shader_watcher {
+    std::vector<shader_program *> programs;
+    std::vector<shader_permutations *> permutation_sets;
+    std::vector<shader_program *> reloading;
+
+#ifdef __linux__
+    int fd;
+    std::unordered_map<int, std::filesystem::path> watched_dirs;
+#endif
+
+    shader_watcher() {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) std::cerr << "ERROR initialising inotify, shaders won't be reloaded" << std::endl;
+#endif
+    }
+
+    shader_watcher(shader_watcher const & other) = delete;
+    shader_watcher & operator=(shader_watcher const & other) = delete;
+
+    ~shader_watcher() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void add(shader_program & program) {
+        programs.push_back(&program);
+        watch(program.shaders);
+    }
+
+    void add(shader_permutations & permutations) {
+        permutation_sets.push_back(&permutations);
+        watch(permutations.shaders);
+    }
+
+    // directories rather than files are watched since editors often save by replacing the file
+    void watch(std::vector<shader> const& shaders) {
+#ifdef __linux__
+        if (fd < 0) return;
+
+        for (auto& s : shaders) {
+            for (auto& dependency : s.dependencies()) {
+                std::filesystem::path dir = std::filesystem::path(dependency).parent_path().lexically_normal();
+                if (dir.empty()) dir = ".";
+
+                bool watched = std::any_of(watched_dirs.begin(), watched_dirs.end(), [&dir](auto const& entry) {
+                    return entry.second == dir;
+                });
+                if (watched) continue;
+
+                int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if (wd < 0) {
+                    std::cerr << "ERROR watching " << dir << std::endl;
+                    continue;
+                }
+                watched_dirs[wd] = dir;
+            }
+        }
+#endif
+    }
+
+    // files changed since the last call, never blocks
+    std::set<std::filesystem::path> read_changes() {
+        std::set<std::filesystem::path> changed;
+
+#ifdef __linux__
+        if (fd < 0) return changed;
+
+        alignas(inotify_event) char buf[4096];
+        for (;;) {
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0) break;
+
+            for (char * ptr = buf; ptr < buf + len; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event *>(ptr)->len) {
+                inotify_event const * event = reinterpret_cast<inotify_event *>(ptr);
+                auto dir = watched_dirs.find(event->wd);
+                if (dir == watched_dirs.end() || event->len == 0) continue;
+                changed.insert((dir->second / event->name).lexically_normal());
+            }
+        }
+#endif
+
+        return changed;
+    }
+
+    static bool depends_on(std::vector<shader> const& shaders, std::set<std::filesystem::path> const& changed) {
+        for (auto& s : shaders) {
+            for (auto& dependency : s.dependencies()) {
+                if (changed.count(std::filesystem::path(dependency).lexically_normal())) return true;
+            }
+        }
+        return false;
+    }
+
+    void start_reload(shader_program & program) {
+        std::cout << "PROGRAM " << program.name << " changed, reloading" << std::endl;
+        program.reload();
+        if (std::find(reloading.begin(), reloading.end(), &program) == reloading.end()) reloading.push_back(&program);
+    }
+
+    // call once per frame
+    void update() {
+        auto changed = read_changes();
+        if (!changed.empty()) {
+            for (auto program : programs) {
+                if (depends_on(program->shaders, changed)) start_reload(*program);
+            }
+            for (auto permutations : permutation_sets) {
+                if (!depends_on(permutations->shaders, changed)) continue;
+
+                for (auto& s : permutations->shaders) s.reload();
+                for (auto& [features, v] : permutations->variants) start_reload(v.program);
+            }
+        }
+
+        reloading.erase(std::remove_if(reloading.begin(), reloading.end(), [](shader_program * program) {
+            return !program->poll_reload();
+        }), reloading.end());
+    }
+};
+
+#endif
@@ -6,16 +6,22 @@ out vec4 frag_color;
 
 uniform sampler2D tex;
 
+// one 1D pass of a symmetric kernel, offsets[0] is the center tap
+#define MAX_TAPS 16
+uniform int tap_count;
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+uniform vec2 dir;
+
 void main() {
-    vec2 texel_size = 1.0 / textureSize(tex, 0);
+    vec2 texel_step = dir / textureSize(tex, 0);
 
-    float result = 0.0;
-    for (int x = -2; x < 2; ++x) {
-        for (int y = -2; y < 2; ++y) {
-            vec2 offset = (0.5 + vec2(float(x), float(y))) * texel_size;
-            result += texture(tex, frag_tex_coords + offset).r;
-        }
+    vec3 result = weights[0] * texture(tex, frag_tex_coords).rgb;
+    for (int i = 1; i < tap_count; ++i) {
+        vec2 offset = offsets[i] * texel_step;
+        result += weights[i] * texture(tex, frag_tex_coords + offset).rgb;
+        result += weights[i] * texture(tex, frag_tex_coords - offset).rgb;
     }
 
-    frag_color = vec4(vec3(result / float(4 * 4)), 1.0);
-}
\ No newline at end of file
+    frag_color = vec4(result, 1.0);
+}
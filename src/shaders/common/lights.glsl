@@ -0,0 +1,26 @@
+#define POINT_LIGHT_COUNT 4
+
+// std140 mirror of light_std140 in gl_util.h, each kind of light ignores the members it doesn't use
+struct light_type {
+    vec3 pos;
+    float constant;
+    vec3 dir;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutoff;
+    vec3 specular;
+    float outer_cutoff;
+};
+
+// only uploaded when a light changes, see environment::upload_lights()
+layout (std140, binding = 2) uniform lights {
+    light_type dir_light;
+    light_type point_lights[POINT_LIGHT_COUNT];
+    light_type spot_light;
+};
+
+// samplers can't be part of a uniform block
+uniform sampler2DShadow dir_shadow_map;
+uniform samplerCubeShadow point_shadow_cubes[POINT_LIGHT_COUNT];
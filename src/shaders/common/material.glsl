@@ -0,0 +1,25 @@
+// std140 mirror of material_std140 in model.h, one buffer per material so drawing only binds it
+layout (std140, binding = 3) uniform material_block {
+    vec3 color_ambient;
+    float shininess;
+    vec3 color_diffuse;
+    float refraction;
+    vec3 color_specular;
+    float opacity_value;
+    vec3 color_emissive;
+    bool has_diffuse_map;
+    vec3 color_transport;
+    bool has_specular_map;
+    bool has_emissive_map;
+    bool has_bump_map;
+    bool has_normal_map;
+    bool has_opacity_map;
+} material;
+
+// fixed texture units, see mesh::draw()
+layout (binding = 0) uniform sampler2D diffuse_map;
+layout (binding = 1) uniform sampler2D specular_map;
+layout (binding = 2) uniform sampler2D emissive_map;
+layout (binding = 3) uniform sampler2D bump_map;
+layout (binding = 4) uniform sampler2D normal_map;
+layout (binding = 5) uniform sampler2D opacity_map;
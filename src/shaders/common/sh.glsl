@@ -0,0 +1,12 @@
+// L2 spherical harmonics with rgb coefficients evaluated at direction n, see sh9 in sh.h
+vec3 eval_sh9(vec3 c[9], vec3 n) {
+    return c[0] * 0.282095
+         + c[1] * 0.488603 * n.y
+         + c[2] * 0.488603 * n.z
+         + c[3] * 0.488603 * n.x
+         + c[4] * 1.092548 * n.x * n.y
+         + c[5] * 1.092548 * n.y * n.z
+         + c[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+         + c[7] * 1.092548 * n.x * n.z
+         + c[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
@@ -0,0 +1,10 @@
+#include "constants.glsl"
+
+// equirectangular texture coordinates of a direction
+const vec2 atan_reciprocal = vec2(1.0 / (2.0 * PI), 1.0 / PI);
+vec2 spherical_uv(vec3 V) {
+    vec2 uv = vec2(atan(V.z, V.x), asin(V.y));
+    uv *= atan_reciprocal;
+    uv += 0.5;
+    return uv;
+}
@@ -0,0 +1,19 @@
+// tangent frame from screen-space derivatives, for meshes without (reliable) tangents
+mat3 cotangent_frame(vec3 normal, vec3 pos, vec2 tex_coords) {
+    vec3 dp1 = dFdx(pos);
+    vec3 dp2 = dFdy(pos);
+
+    vec2 duv1 = dFdx(tex_coords);
+    vec2 duv2 = dFdy(tex_coords);
+
+    float f = 1.0f / (duv1.x * duv2.y - duv2.x * duv1.y);
+    vec3 T = normalize(f * (duv2.y * dp1 - duv1.y * dp2));
+    vec3 B = normalize(f * (duv2.x * dp1 - duv1.x * dp2));
+
+    float flip = 1.0;
+    if (dot(cross(T, B), normal) <= 0) flip = -1.0;
+    T = normalize(T - dot(T, normal) * normal);
+    B = cross(normal, T) * flip;
+
+    return mat3(T, B, normal);
+}
@@ -0,0 +1,7 @@
+// model matrices of the current pass, see push_transforms(), a draw with base instance i
+// reads draw_id i through the instanced attribute set up by bind_draw_ids()
+layout (std430, binding = 0) readonly buffer transforms {
+    mat4 models[];
+};
+
+layout (location = 5) in uint draw_id;
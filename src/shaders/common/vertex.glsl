@@ -0,0 +1,36 @@
+// mesh vertex attributes, see mesh::setup_gl_data, compact meshes store snorm16 or half positions relative to
+// their bounds with the bitangent sign in w, octahedral normals and tangents in xy and half uvs
+layout (location = 0) in vec4 in_pos;
+layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec2 tex_coords;
+layout (location = 3) in vec3 in_tangent;
+layout (location = 4) in vec3 in_bitangent;
+
+// the bound mesh's dequantisation, identity for full vertices
+layout (std140, binding = 4) uniform vertex_dequant {
+    vec3 pos_scale;
+    bool compact_vertex;
+    vec3 pos_offset;
+};
+
+vec3 oct_decode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+vec3 vertex_pos() {
+    return in_pos.xyz * pos_scale + pos_offset;
+}
+
+vec3 vertex_normal() {
+    return compact_vertex ? oct_decode(in_normal.xy) : in_normal;
+}
+
+vec3 vertex_tangent() {
+    return compact_vertex ? oct_decode(in_tangent.xy) : in_tangent;
+}
+
+vec3 vertex_bitangent() {
+    return compact_vertex ? cross(vertex_normal(), vertex_tangent()) * in_pos.w : in_bitangent;
+}
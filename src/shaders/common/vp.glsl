@@ -0,0 +1,6 @@
+// camera matrices and exposure, a copy per view from the constant ring bound to binding 0, see push_vp()
+layout (std140, binding = 0) uniform vp {
+    mat4 view;
+    mat4 projection;
+    float user_ev;
+};
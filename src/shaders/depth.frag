@@ -1,19 +1,16 @@
-#version 330 core
+#version 420 core
 
-struct material_type {
-    bool has_opacity_map;
-    sampler2D opacity;
-};
+#include "common/material.glsl"
 
+#ifdef HAS_OPACITY_MAP
 in vec2 frag_tex_coords;
-
-uniform material_type material;
+#endif
 
 void main() {
-    if (material.has_opacity_map) {
-        vec4 tex_color = texture(material.opacity, frag_tex_coords);
-        if (tex_color.r < 0.1) discard;
-    }
+#ifdef HAS_OPACITY_MAP
+    vec4 tex_color = texture(opacity_map, frag_tex_coords);
+    if (tex_color.r < 0.1) discard;
+#endif
 
     // just update the depth buffer
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
-#version 330 core
-layout (location = 0) in vec3 pos;
-layout (location = 2) in vec2 tex_coords;
+#version 430 core
+#include "common/vertex.glsl"
+
+#include "common/transforms.glsl"
 
 uniform mat4 light_space;
-uniform mat4 model;
 
+#ifdef HAS_OPACITY_MAP
 out vec2 frag_tex_coords;
+#endif
 
 void main() {
+    mat4 model = models[draw_id];
+    vec3 pos = vertex_pos();
+
     gl_Position = light_space * model * vec4(pos, 1.0);
+#ifdef HAS_OPACITY_MAP
     frag_tex_coords = tex_coords;
+#endif
 }
\ No newline at end of file
@@ -1,22 +1,19 @@
-#version 330 core
+#version 420 core
 
-struct material_type {
-    bool has_opacity_map;
-    sampler2D opacity;
-};
+#include "common/material.glsl"
 
 in vec4 frag_pos;
+#ifdef HAS_OPACITY_MAP
 in vec2 frag_tex_coords;
+#endif
 
 uniform vec3 light_pos;
 uniform float far;
-uniform material_type material;
-
 void main() {
-    if (material.has_opacity_map) {
-        vec4 tex_color = texture(material.opacity, frag_tex_coords);
-        if (tex_color.r < 0.1) discard;
-    }
+#ifdef HAS_OPACITY_MAP
+    vec4 tex_color = texture(opacity_map, frag_tex_coords);
+    if (tex_color.r < 0.1) discard;
+#endif
 
     float light_distance = length(frag_pos.xyz - light_pos);
     light_distance /= far;
@@ -1,13 +1,19 @@
-#version 330 core
+#version 430 core
 
-layout (location = 0) in vec3 pos;
-layout (location = 2) in vec2 tex_coords;
+#include "common/vertex.glsl"
 
-uniform mat4 model;
+#include "common/transforms.glsl"
 
+#ifdef HAS_OPACITY_MAP
 out vec2 geom_tex_coords;
+#endif
 
 void main() {
+    mat4 model = models[draw_id];
+    vec3 pos = vertex_pos();
+
     gl_Position = model * vec4(pos, 1.0);
+#ifdef HAS_OPACITY_MAP
     geom_tex_coords = tex_coords;
+#endif
 }
\ No newline at end of file
@@ -1,29 +1,37 @@
-#version 420 core
+#version 430 core
 
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec2 tex_coords;
-layout (location = 3) in vec3 tangent;
-layout (location = 4) in vec3 bitangent;
+#include "common/vertex.glsl"
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-};
+#include "common/transforms.glsl"
+
+#include "common/vp.glsl"
 
 out vec3 frag_normal;
 out vec3 frag_pos;
 out vec2 frag_tex_coords;
 out mat3 tbn;
+out vec4 curr_clip_pos;
+out vec4 prev_clip_pos;
 
-uniform mat4 model;
+uniform mat4 view_projection;
+uniform mat4 prev_view_projection;
 
 void main() {
+    mat4 model = models[draw_id];
+    vec3 pos = vertex_pos();
+    vec3 normal = vertex_normal();
+    vec3 tangent = vertex_tangent();
+    vec3 bitangent = vertex_bitangent();
+
     gl_Position = projection * view * model * vec4(pos, 1.0);
     frag_pos = vec3(model * vec4(pos, 1.0));
     frag_normal = transpose(inverse(mat3(model))) * normal;
     frag_tex_coords = tex_coords;
 
+    // unjittered positions for the velocity buffer, the scene is static so only the camera moves
+    curr_clip_pos = view_projection * vec4(frag_pos, 1.0);
+    prev_clip_pos = prev_view_projection * vec4(frag_pos, 1.0);
+
     vec3 t = normalize(vec3(model * vec4(tangent, 0.0)));
     vec3 b = normalize(vec3(model * vec4(bitangent, 0.0)));
     vec3 n = normalize(vec3(model * vec4(normal, 0.0)));
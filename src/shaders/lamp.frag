@@ -2,17 +2,18 @@
 
 uniform vec3 color;
 
-out vec4 frag_color;
+in vec4 curr_clip_pos;
+in vec4 prev_clip_pos;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec2 velocity; // uv offset from the previous frame
+
+#include "common/vp.glsl"
 
 void main() {
     //frag_color = vec4(color, 1.0);
     //frag_color = vec4(1.8 * pow(vec3(color), vec3(1.0 / 2.2)), 1.0);
     vec3 lamp_color = 4.0 * color * pow(2.0, -user_ev);
     frag_color = vec4(lamp_color, 1.0);
+    velocity = 0.5 * (curr_clip_pos.xy / curr_clip_pos.w - prev_clip_pos.xy / prev_clip_pos.w);
 }
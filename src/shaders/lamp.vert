@@ -6,19 +6,24 @@ layout (location = 2) in vec2 tex_coords;
 layout (location = 3) in vec3 tangent;
 layout (location = 4) in vec3 bitangent;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 out vec3 frag_normal;
 out vec3 frag_pos;
 out vec2 frag_tex_coords;
 out mat3 tbn;
 
+// unjittered clip positions for the velocity buffer, see g_pass.vert
+uniform mat4 view_projection;
+uniform mat4 prev_view_projection;
+out vec4 curr_clip_pos;
+out vec4 prev_clip_pos;
+
 uniform mat4 model;
 
 void main() {
-    gl_Position = projection * view * model * vec4(pos + normal * 0.1, 1.0);
+    vec4 world_pos = model * vec4(pos + normal * 0.1, 1.0);
+    gl_Position = projection * view * world_pos;
+    curr_clip_pos = view_projection * world_pos;
+    prev_clip_pos = prev_view_projection * world_pos;
 }
@@ -1,50 +1,8 @@
 #version 420 core
 
-struct dir_light_type {
-    vec3 dir;
+#include "common/lights.glsl"
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    sampler2DShadow shadow_map;
-};
-
-struct point_light_type {
-    vec3 pos;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    samplerCubeShadow shadow_cube;
-};
-
-struct spot_light_type {
-    vec3 pos;
-    vec3 dir;
-
-    float cutoff;
-    float outer_cutoff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 out vec4 frag_color;
 
@@ -57,13 +15,20 @@ uniform float far;
 uniform mat4 light_space;
 uniform bool use_ao;
 
-uniform dir_light_type dir_light;
-#define POINT_LIGHT_COUNT 4
-uniform point_light_type point_lights[POINT_LIGHT_COUNT];
-uniform spot_light_type spot_light;
 uniform bool use_spotlight;
 uniform int point_light_count;
 
+#include "common/sh.glsl"
+
+// probe grid, see probe_grid.h
+uniform bool use_probes;
+uniform samplerCubeArray probe_cubes;
+uniform sampler2D probe_sh;
+uniform vec3 probe_grid_min;
+uniform vec3 probe_grid_spacing;
+uniform ivec3 probe_grid_dims;
+uniform float probe_max_lod;
+
 // Ideas:
 //  - store light_space for each light to make it easier to convert frag_pos to light space
 
@@ -104,12 +69,59 @@ float shadow_strength_point(samplerCubeShadow shadow_cube, vec3 frag_pos, vec3 l
     return shadow;
 }
 
+int probe_index(ivec3 cell) {
+    return cell.x + probe_grid_dims.x * (cell.y + probe_grid_dims.y * cell.z);
+}
+
+// L2 spherical harmonics of the probe's irradiance / PI
+vec3 probe_sh_irradiance(int probe, vec3 n) {
+    vec3 c[9];
+    for (int i = 0; i < 9; ++i) {
+        c[i] = texelFetch(probe_sh, ivec2(i, probe), 0).rgb;
+    }
+
+    return eval_sh9(c, n);
+}
+
+vec3 calc_probe_ambient() {
+    vec3 frag_pos = texture(g_bufs[0], frag_tex_coords).rgb;
+    vec3 normal = normalize(texture(g_bufs[1], frag_tex_coords).rgb);
+    vec3 diffuse_src = texture(g_bufs[2], frag_tex_coords).rgb;
+    vec3 specular_src = texture(g_bufs[3], frag_tex_coords).rgb;
+    float gloss = texture(g_bufs[5], frag_tex_coords).r;
+    float ao = use_ao ? texture(ssao, frag_tex_coords).r : 1.0;
+
+    // trilinear blend of the irradiance of the 8 surrounding probes
+    vec3 grid_pos = clamp((frag_pos - probe_grid_min) / probe_grid_spacing, vec3(0.0), vec3(probe_grid_dims - 1));
+    ivec3 base = clamp(ivec3(floor(grid_pos)), ivec3(0), max(probe_grid_dims - 2, ivec3(0)));
+    vec3 t = grid_pos - vec3(base);
+    vec3 irradiance = vec3(0.0);
+    for (int i = 0; i < 8; ++i) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        vec3 weights = mix(1.0 - t, t, vec3(offset));
+        ivec3 cell = min(base + offset, probe_grid_dims - 1);
+        irradiance += weights.x * weights.y * weights.z * probe_sh_irradiance(probe_index(cell), normal);
+    }
+    irradiance = max(irradiance, vec3(0.0));
+
+    // glossy reflection from the nearest probe, blurrier mips for lower gloss
+    vec3 view_dir = normalize(frag_pos - view_pos);
+    vec3 reflect_dir = reflect(view_dir, normal);
+    int nearest = probe_index(ivec3(round(grid_pos)));
+    float lod = clamp(probe_max_lod - 0.5 * log2(max(2.0 * gloss, 1.0)), 0.0, probe_max_lod);
+    vec3 reflection = textureLod(probe_cubes, vec4(reflect_dir, float(nearest)), lod).rgb;
+    float fresnel = 0.04 + 0.96 * pow(1.0 - max(dot(normal, -view_dir), 0.0), 5.0);
+
+    return (irradiance * diffuse_src + fresnel * reflection * specular_src) * ao;
+}
+
 vec3 calc_base_light(vec3 ambient, vec3 diffuse, vec3 specular, vec3 light_dir, float shadow) {
     vec3 normal = texture(g_bufs[1], frag_tex_coords).rgb;
 
     vec3 diffuse_src = texture(g_bufs[2], frag_tex_coords).rgb;
     float ao = use_ao ? texture(ssao, frag_tex_coords).r : 1.0;
-    vec3 ambient_color = ambient * diffuse_src * ao;
+    // the probes replace the constant ambient terms of the lights
+    vec3 ambient_color = use_probes ? vec3(0.0) : ambient * diffuse_src * ao;
 
     float diffuse_strength = max(dot(normal, light_dir), 0.0);
     vec3 diffuse_color = diffuse_strength * diffuse * diffuse_src;
@@ -128,18 +140,18 @@ vec3 calc_base_light(vec3 ambient, vec3 diffuse, vec3 specular, vec3 light_dir,
     return em_color + ambient_color + (1.0 - shadow) * (diffuse_color + specular_color);
 }
 
-vec3 calc_dir_light(dir_light_type light) {
+vec3 calc_dir_light(light_type light) {
     vec3 light_dir = normalize(-light.dir);
-    float shadow = shadow_strength_dir(light.shadow_map, light_dir);
+    float shadow = shadow_strength_dir(dir_shadow_map, light_dir);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, shadow);
 
     return result;
 }
 
-vec3 calc_point_light(point_light_type light) {
+vec3 calc_point_light(light_type light, samplerCubeShadow shadow_cube) {
     vec3 frag_pos = texture(g_bufs[0], frag_tex_coords).rgb;
     vec3 light_dir = normalize(light.pos - frag_pos);
-    float shadow = shadow_strength_point(light.shadow_cube, frag_pos, light.pos);
+    float shadow = shadow_strength_point(shadow_cube, frag_pos, light.pos);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, shadow);
 
     float dist = length(light.pos - frag_pos);
@@ -149,7 +161,7 @@ vec3 calc_point_light(point_light_type light) {
     return result;
 }
 
-vec3 calc_spot_light(spot_light_type light) {
+vec3 calc_spot_light(light_type light) {
     vec3 frag_pos = texture(g_bufs[0], frag_tex_coords).rgb;
     vec3 light_dir = normalize(light.pos - frag_pos);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, 0.0);
@@ -169,9 +181,10 @@ void main() {
 
     result += calc_dir_light(dir_light);
     for (int i = 0; i < POINT_LIGHT_COUNT; ++i) {
-        result += calc_point_light(point_lights[i]);
+        result += calc_point_light(point_lights[i], point_shadow_cubes[i]);
     }
     if (use_spotlight) result += calc_spot_light(spot_light);
+    if (use_probes) result += calc_probe_ambient();
 
     frag_color = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -1,95 +1,26 @@
 #version 420 core
 
-struct dir_light_type {
-    vec3 dir;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    sampler2DShadow shadow_map;
-};
-
-struct point_light_type {
-    vec3 pos;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    samplerCubeShadow shadow_cube;
-};
-
-struct spot_light_type {
-    vec3 pos;
-    vec3 dir;
-
-    float cutoff;
-    float outer_cutoff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct material_type {
-    float shininess;
-    float refraction;
-    float opacity_value;
-
-    vec3 color_ambient;
-    vec3 color_diffuse;
-    vec3 color_specular;
-    vec3 color_emissive;
-    vec3 color_transport;
-
-    sampler2D diffuse;
-    sampler2D specular;
-    sampler2D emissive;
-    sampler2D bump;
-    sampler2D normal;
-    sampler2D opacity;
-
-    bool has_diffuse_map;
-    bool has_specular_map;
-    bool has_emissive_map;
-    bool has_bump_map;
-    bool has_normal_map;
-    bool has_opacity_map;
-};
+#include "common/lights.glsl"
+
+#include "common/material.glsl"
 
 in vec3 frag_pos;
 in vec4 frag_pos_light_space;
 in vec3 frag_normal;
 in vec2 frag_tex_coords;
 in mat3 tbn;
+in vec4 curr_clip_pos;
+in vec4 prev_clip_pos;
 
-out vec4 frag_color;
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec2 velocity; // uv offset from the previous frame
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 uniform vec3 view_pos;
 
-uniform dir_light_type dir_light;
-#define POINT_LIGHT_COUNT 4
-uniform point_light_type point_lights[POINT_LIGHT_COUNT];
-uniform spot_light_type spot_light;
 uniform bool use_spotlight;
 
-uniform material_type material;
-
 uniform float far;
 
 float shadow_strength_dir(sampler2DShadow shadow_map, vec3 light_dir) {
@@ -129,7 +60,7 @@ float shadow_strength_point(samplerCubeShadow shadow_cube, vec3 frag_pos, vec3 l
 vec3 calc_base_light(vec3 ambient, vec3 diffuse, vec3 specular, vec3 light_dir, float shadow) {
     vec3 normal;
     if (material.has_normal_map) {
-        normal = vec3(texture(material.normal, frag_tex_coords));
+        normal = vec3(texture(normal_map, frag_tex_coords));
         normal = normalize(normal * 2.0 - 1.0);
         normal = normalize(tbn * normal);
     } else {
@@ -137,33 +68,33 @@ vec3 calc_base_light(vec3 ambient, vec3 diffuse, vec3 specular, vec3 light_dir,
     }
     //return normal * 0.5 + 0.5;
 
-    vec3 ambient_color = ambient * (material.has_diffuse_map ? vec3(texture(material.diffuse, frag_tex_coords)) : material.color_ambient);
+    vec3 ambient_color = ambient * (material.has_diffuse_map ? vec3(texture(diffuse_map, frag_tex_coords)) : material.color_ambient);
 
     float diff_strength = max(dot(normal, light_dir), 0.0);
-    vec3 diff_color = diff_strength * diffuse * (material.has_diffuse_map ? vec3(texture(material.diffuse, frag_tex_coords)) : material.color_diffuse);
+    vec3 diff_color = diff_strength * diffuse * (material.has_diffuse_map ? vec3(texture(diffuse_map, frag_tex_coords)) : material.color_diffuse);
 
     vec3 view_dir = normalize(view_pos - frag_pos);
     vec3 halfway_dir = normalize(light_dir + view_dir);
     float spec_strength = pow(max(dot(normal, halfway_dir), 0.0), 2 * material.shininess);
-    vec3 spec_color = spec_strength * specular * (material.has_specular_map ? vec3(texture(material.specular, frag_tex_coords)) : material.color_specular);
+    vec3 spec_color = spec_strength * specular * (material.has_specular_map ? vec3(texture(specular_map, frag_tex_coords)) : material.color_specular);
 
-    vec3 emissive_src = (material.has_emissive_map ? vec3(texture(material.emissive, frag_tex_coords)) : vec3(0.0));
+    vec3 emissive_src = (material.has_emissive_map ? vec3(texture(emissive_map, frag_tex_coords)) : vec3(0.0));
     vec3 em_color = emissive_src * pow(2.0, -user_ev);
 
     return em_color + ambient_color + (1.0 - shadow) * (diff_color + spec_color);
 }
 
-vec3 calc_dir_light(dir_light_type light) {
+vec3 calc_dir_light(light_type light) {
     vec3 light_dir = normalize(-light.dir);
-    float shadow = shadow_strength_dir(light.shadow_map, light_dir);
+    float shadow = shadow_strength_dir(dir_shadow_map, light_dir);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, shadow);
 
     return result;
 }
 
-vec3 calc_point_light(point_light_type light) {
+vec3 calc_point_light(light_type light, samplerCubeShadow shadow_cube) {
     vec3 light_dir = normalize(light.pos - frag_pos);
-    float shadow = shadow_strength_point(light.shadow_cube, frag_pos, light.pos);
+    float shadow = shadow_strength_point(shadow_cube, frag_pos, light.pos);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, shadow);
 
     float dist = length(light.pos - frag_pos);
@@ -173,7 +104,7 @@ vec3 calc_point_light(point_light_type light) {
     return result;
 }
 
-vec3 calc_spot_light(spot_light_type light) {
+vec3 calc_spot_light(light_type light) {
     vec3 light_dir = normalize(light.pos - frag_pos);
     vec3 result = calc_base_light(light.ambient, light.diffuse, light.specular, light_dir, 0.0);
 
@@ -189,16 +120,17 @@ vec3 calc_spot_light(spot_light_type light) {
 
 void main() {
     if (material.has_opacity_map) {
-        vec4 tex_color = texture(material.opacity, frag_tex_coords);
+        vec4 tex_color = texture(opacity_map, frag_tex_coords);
         if (tex_color.r < 0.1) discard;
     } else {
-        vec4 tex_color = texture(material.diffuse, frag_tex_coords);
+        vec4 tex_color = texture(diffuse_map, frag_tex_coords);
         if (tex_color.a < 0.1) discard;
     }
 
     vec3 result = calc_dir_light(dir_light);
-    for (int i = 0; i < POINT_LIGHT_COUNT; ++i) result += calc_point_light(point_lights[i]);
+    for (int i = 0; i < POINT_LIGHT_COUNT; ++i) result += calc_point_light(point_lights[i], point_shadow_cubes[i]);
     if (use_spotlight) result += calc_spot_light(spot_light);
 
     frag_color = vec4(result, 1.0);
+    velocity = 0.5 * (curr_clip_pos.xy / curr_clip_pos.w - prev_clip_pos.xy / prev_clip_pos.w);
 }
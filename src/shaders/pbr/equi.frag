@@ -5,15 +5,7 @@ out vec4 frag_color;
 
 uniform sampler2D tex;
 
-const float PI = 3.14159265359;
-const vec2 atan_reciprocal = vec2(1.0 / (2.0 * PI), 1.0 / PI);
-
-vec2 spherical_uv(vec3 V) {
-    vec2 uv = vec2(atan(V.z, V.x), asin(V.y));
-    uv *= atan_reciprocal;
-    uv += 0.5;
-    return uv;
-}
+#include "../common/spherical.glsl"
 
 void main() {
     vec2 uv = spherical_uv(normalize(frag_pos));
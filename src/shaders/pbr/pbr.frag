@@ -1,6 +1,4 @@
-#version 330 core
-
-#define PI 3.14159265
+#version 430 core
 
 struct point_light_type {
     vec3 pos;
@@ -14,13 +12,6 @@ struct material_type {
     float roughness;
     float ao;
 
-    bool has_albedo_map;
-    bool has_metallic_map;
-    bool has_roughness_map;
-    bool has_ao_map;
-    bool has_normal_map;
-    bool has_height_map;
-
     sampler2D albedo_map;
     sampler2D metallic_map;
     sampler2D roughness_map;
@@ -44,17 +35,44 @@ out vec4 frag_color;
 uniform point_light_type point_lights[POINT_LIGHT_COUNT];
 uniform material_type material;
 uniform vec3 view_pos;
-uniform samplerCube irradiance_map;
 uniform samplerCube prefilter_map;
 uniform sampler2D brdf_lut;
 
-uniform bool use_ibl;
-uniform bool use_lamb;
-uniform bool use_par;
-uniform bool use_vert_tbn;
+#ifdef USE_INSTANCE_MATERIAL
+// per-instance parameters of the sphere grid in place of the material uniforms, see sphere_grid in pbr.cpp
+struct instance_material {
+    vec3 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+};
+
+layout (std430, binding = 1) readonly buffer instance_materials {
+    instance_material instances[];
+};
+
+flat in uint frag_draw_id;
+#endif
 
+// material maps and render toggles are compile-time defines, see pbr_material::feature_defines
+
+#include "../common/brdf.glsl"
+#include "../common/sh.glsl"
+#include "../common/tbn.glsl"
+
+// L2 spherical harmonics of the environment's irradiance / PI, see sh.h
+layout(std140, binding = 1) uniform sh_irradiance {
+    vec4 sh_coeffs[9];
+};
+
+vec3 eval_sh_irradiance(vec3 n) {
+    vec3 c[9];
+    for (int i = 0; i < 9; ++i) c[i] = sh_coeffs[i].rgb;
+    return max(eval_sh9(c, n), vec3(0.0));
+}
+
+#if defined(HAS_HEIGHT_MAP) && defined(USE_PARALLAX)
 vec2 parallax_mapping(vec2 tex_coords, vec3 view_dir) {
-    if (!material.has_height_map || !use_par) return tex_coords;
 
     const float depth_scale = 0.1;
     const float layer_count = 30;
@@ -85,8 +103,6 @@ vec2 parallax_mapping(vec2 tex_coords, vec3 view_dir) {
 }
 
 float parallax_shadow(vec2 tex_coords, vec3 light_dir) {
-    if (!material.has_height_map || !use_par) return 1.0;
-
     float shadow = 0.0;
 
     const float depth_scale = 0.1;
@@ -109,50 +125,15 @@ float parallax_shadow(vec2 tex_coords, vec3 light_dir) {
 
     return 1.0 - shadow;
 }
-
-mat3 cotangent_frame(vec3 normal, vec3 pos, vec2 tex_coords) {
-    vec3 dp1 = dFdx(pos);
-    vec3 dp2 = dFdy(pos);
-
-    vec2 duv1 = dFdx(tex_coords);
-    vec2 duv2 = dFdy(tex_coords);
-
-    float f = 1.0f / (duv1.x * duv2.y - duv2.x * duv1.y);
-    vec3 T = normalize(f * (duv2.y * dp1 - duv1.y * dp2));
-    vec3 B = normalize(f * (duv2.x * dp1 - duv1.x * dp2));
-
-    float flip = 1.0;
-    if (dot(cross(T, B), normal) <= 0) flip = -1.0;
-    T = normalize(T - dot(T, normal) * normal);
-    B = cross(normal, T) * flip;
-
-    return mat3(T, B, normal);
-}
-
-vec3 fresnel_schlick(float cos_theta, vec3 F0) {
-    return F0 + (1.0 - F0) * pow(1.0 - cos_theta, 5.0);
-}
-
-vec3 fresnel_schlick_90(float cos_theta, vec3 F0, float F90) {
-    return F0 + (F90 - F0) * pow(1.0 - cos_theta, 5.0);
-}
-
-vec3 fresnel_schlick_roughness(float cos_theta, vec3 F0, float roughness) {
-    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cos_theta, 5.0);
+#else
+vec2 parallax_mapping(vec2 tex_coords, vec3 view_dir) {
+    return tex_coords;
 }
 
-float distribution_ggx(vec3 N, vec3 H, float roughness) {
-    float a = roughness * roughness;
-    float a2 = a * a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH2 = NdotH * NdotH;
-
-    float num = a2;
-    float denom_base = (NdotH2 * (a2 - 1.0) + 1.0);
-    float denom = PI * denom_base * denom_base;
-
-    return num / denom;
+float parallax_shadow(vec2 tex_coords, vec3 light_dir) {
+    return 1.0;
 }
+#endif
 
 float geometry_smith_correlated(float NdotV, float NdotL, float roughness) {
     float a2 = roughness * roughness;
@@ -207,51 +188,81 @@ vec3 calc_pbr_light(point_light_type light, vec3 V, vec3 N, vec3 albedo, float m
     kD *= 1.0 - metallic;
 
     float LdotH = max(dot(L, H), 0.0);
-    vec3 diffuse = (use_lamb ? fr_disney_diffuse(NdotV, NdotL, LdotH, roughness) : 1.0) * albedo / PI;
+#ifdef USE_DISNEY_DIFFUSE
+    vec3 diffuse = fr_disney_diffuse(NdotV, NdotL, LdotH, roughness) * albedo / PI;
+#else
+    vec3 diffuse = albedo / PI;
+#endif
 
     return (kD * diffuse + specular) * radiance * NdotL;
 }
 
 vec3 calc_ambient(vec3 V, vec3 N, vec3 albedo, float metallic, float roughness, float ao) {
-    vec3 ambient = vec3(0.03) * albedo * ao;
-
-    if (use_ibl) {
-        vec3 F0 = mix(vec3(0.04), albedo, metallic);
-        vec3 kS = fresnel_schlick_roughness(max(dot(N, V), 0.0), F0, roughness);
-        vec3 kD = 1.0 - kS;
-        kD *= 1.0 - metallic;
-
-        vec3 irradiance = texture(irradiance_map, N).rgb;
-        vec3 diffuse = irradiance * albedo;
+#ifdef USE_IBL
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+    vec3 kS = fresnel_schlick_roughness(max(dot(N, V), 0.0), F0, roughness);
+    vec3 kD = 1.0 - kS;
+    kD *= 1.0 - metallic;
 
-        vec3 R = reflect(-V, N);
-        const float MAX_REFLECTION_LOD = 4.0;
-        vec3 prefiltererd_color = textureLod(prefilter_map, R, roughness * MAX_REFLECTION_LOD).rgb;
-        vec2 brdf = texture(brdf_lut, vec2(max(dot(N, V), 0.0), roughness)).rg;
-        vec3 specular = prefiltererd_color * (F0 * brdf.x + brdf.y);
+    vec3 irradiance = eval_sh_irradiance(N);
+    vec3 diffuse = irradiance * albedo;
 
-        ambient = (kD * diffuse + specular) * ao;
-    }
+    vec3 R = reflect(-V, N);
+    const float MAX_REFLECTION_LOD = 4.0;
+    vec3 prefiltererd_color = textureLod(prefilter_map, R, roughness * MAX_REFLECTION_LOD).rgb;
+    vec2 brdf = texture(brdf_lut, vec2(max(dot(N, V), 0.0), roughness)).rg;
+    vec3 specular = prefiltererd_color * (F0 * brdf.x + brdf.y);
 
-    return ambient;
+    return (kD * diffuse + specular) * ao;
+#else
+    return vec3(0.03) * albedo * ao;
+#endif
 }
 
 void main() {
     mat3 tbn = cotangent_frame(normalize(frag_normal), frag_pos, frag_tex_coords); 
+#ifdef USE_VERT_TBN
+    mat3 inv_tbn = inv_vert_tbn;
+#else
     mat3 inv_tbn = inverse(tbn);
-    if (use_vert_tbn) inv_tbn = inv_vert_tbn;
+#endif
     vec2 tex_coords = parallax_mapping(frag_tex_coords, normalize(inv_tbn * normalize(view_pos - frag_pos)));
 
-    vec3 albedo = material.has_albedo_map ? texture(material.albedo_map, tex_coords).rgb : material.albedo;
-    float metallic = material.has_metallic_map ? texture(material.metallic_map, tex_coords).r : material.metallic;
-    float roughness = material.has_roughness_map ? texture(material.roughness_map, tex_coords).r : material.roughness;
-    float ao = material.has_ao_map ? texture(material.ao_map, tex_coords).r : material.ao;
+#if defined(USE_INSTANCE_MATERIAL)
+    vec3 albedo = instances[frag_draw_id].albedo;
+#elif defined(HAS_ALBEDO_MAP)
+    vec3 albedo = texture(material.albedo_map, tex_coords).rgb;
+#else
+    vec3 albedo = material.albedo;
+#endif
+#if defined(USE_INSTANCE_MATERIAL)
+    float metallic = instances[frag_draw_id].metallic;
+#elif defined(HAS_METALLIC_MAP)
+    float metallic = texture(material.metallic_map, tex_coords).r;
+#else
+    float metallic = material.metallic;
+#endif
+#if defined(USE_INSTANCE_MATERIAL)
+    float roughness = instances[frag_draw_id].roughness;
+#elif defined(HAS_ROUGHNESS_MAP)
+    float roughness = texture(material.roughness_map, tex_coords).r;
+#else
+    float roughness = material.roughness;
+#endif
+#if defined(USE_INSTANCE_MATERIAL)
+    float ao = instances[frag_draw_id].ao;
+#elif defined(HAS_AO_MAP)
+    float ao = texture(material.ao_map, tex_coords).r;
+#else
+    float ao = material.ao;
+#endif
+#ifdef HAS_NORMAL_MAP
+    vec3 normal = texture(material.normal_map, tex_coords).rgb;
+    normal = normalize(normal * 2.0 - 1.0);
+    normal = normalize(tbn * normal);
+#else
     vec3 normal = frag_normal;
-    if (material.has_normal_map) {
-        normal = texture(material.normal_map, tex_coords).rgb;
-        normal = normalize(normal * 2.0 - 1.0);
-        normal = normalize(tbn * normal);
-    }
+#endif
 
     vec3 N = normalize(normal);
     vec3 V = normalize(view_pos - frag_pos);
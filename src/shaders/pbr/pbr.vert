@@ -1,10 +1,8 @@
-#version 330 core
+#version 430 core
 
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec2 tex_coords;
-layout (location = 3) in vec3 tangent;
-layout (location = 4) in vec3 bitangent;
+#include "../common/vertex.glsl"
+
+#include "../common/transforms.glsl"
 
 out vec3 frag_pos;
 out vec3 frag_normal;
@@ -15,13 +13,25 @@ out mat3 inv_vert_tbn;
 out vec3 tan_view_pos;
 out vec3 tan_frag_pos;
 
-uniform mat4 model;
+#ifdef USE_INSTANCE_MATERIAL
+flat out uint frag_draw_id;
+#endif
+
 uniform mat4 view;
 uniform mat4 projection;
 
 uniform vec3 view_pos;
 
 void main() {
+    mat4 model = models[draw_id];
+    vec3 pos = vertex_pos();
+    vec3 normal = vertex_normal();
+    vec3 tangent = vertex_tangent();
+    vec3 bitangent = vertex_bitangent();
+#ifdef USE_INSTANCE_MATERIAL
+    frag_draw_id = draw_id;
+#endif
+
     gl_Position = projection * view * model * vec4(pos, 1.0);
     frag_pos = vec3(model * vec4(pos, 1.0));
     frag_normal = mat3(transpose(inverse(model))) * normal;
@@ -3,11 +3,7 @@ in vec3 frag_tex_coords;
 
 out vec4 frag_color;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "../common/vp.glsl"
 
 uniform bool is_day;
 
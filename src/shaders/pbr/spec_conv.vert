@@ -3,11 +3,7 @@ layout (location = 0) in vec3 pos;
 
 out vec3 frag_pos;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "../common/vp.glsl"
 
 uniform mat4 model;
 
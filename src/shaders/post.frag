@@ -3,11 +3,7 @@ in vec2 frag_tex_coords[9];
 
 out vec4 frag_color;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 uniform sampler2D tex;
 uniform sampler2D bloom;
@@ -20,28 +16,6 @@ uniform bool use_filmic;
 
 uniform bool DEBUG;
 
-const float radius = 1.0;
-const float offset = 0.5 * (radius / 450.0);
-
-const float weights[] = float[] (0.06136, 0.24477, 0.38774, 0.24477, 0.06136);
-const int kernel_size = 5;
-const int half_kernel_size = kernel_size / 2;
-
-vec3 bloom_color(vec2 tex_coords) {
-    vec2 texel_size = 1.0 / textureSize(bloom, 0);
-
-    vec3 color = vec3(0.0);
-
-    for (int x = -half_kernel_size; x <= half_kernel_size; ++x) {
-        for (int y = -half_kernel_size; y <= half_kernel_size; ++y) {
-            vec3 bloom_sample = vec3(texture(bloom, tex_coords + texel_size * vec2(x, y)));
-            float mult = weights[x + half_kernel_size] * weights[y + half_kernel_size];
-            color += mult * bloom_sample;
-        }
-    }
-    return color;
-}
-
 vec3 uncharted2_tonemap_partial(vec3 x)
 {
     float A = 0.15f;
@@ -71,7 +45,7 @@ vec3 reinhard_jodie(vec3 v) {
 
 void main() {
     vec3 color = texture(tex, frag_tex_coords[4]).rgb;
-    if (use_bloom) color += bloom_color(frag_tex_coords[4]);
+    if (use_bloom) color += texture(bloom, frag_tex_coords[4]).rgb;
 
     // EV
     color = color * pow(2.0, user_ev);
@@ -4,11 +4,7 @@ in vec2 frag_tex_coords;
 
 out vec4 bright_color;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 uniform sampler2D tex;
 
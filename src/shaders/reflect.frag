@@ -2,15 +2,22 @@
 
 in vec3 frag_pos;
 in vec3 frag_normal;
+in vec4 curr_clip_pos;
+in vec4 prev_clip_pos;
 
-out vec4 frag_color;
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec2 velocity; // uv offset from the previous frame
 
 uniform vec3 camera_pos;
 uniform samplerCube tex;
+uniform samplerCube prev_tex; // previous probe capture, blended out while blend goes to 1
+uniform float blend;
 
 void main() {
     vec3 view_dir = normalize(frag_pos - camera_pos);
     vec3 reflect_dir = reflect(view_dir, normalize(frag_normal));
 
-    frag_color = vec4(texture(tex, reflect_dir).rgb, 1.0);
+    vec3 color = mix(texture(prev_tex, reflect_dir).rgb, texture(tex, reflect_dir).rgb, blend);
+    frag_color = vec4(color, 1.0);
+    velocity = 0.5 * (curr_clip_pos.xy / curr_clip_pos.w - prev_clip_pos.xy / prev_clip_pos.w);
 }
\ No newline at end of file
@@ -2,18 +2,23 @@
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 normal;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-};
+#include "common/vp.glsl"
 
 out vec3 frag_pos;
 out vec3 frag_normal;
 
+// unjittered clip positions for the velocity buffer, see g_pass.vert
+uniform mat4 view_projection;
+uniform mat4 prev_view_projection;
+out vec4 curr_clip_pos;
+out vec4 prev_clip_pos;
+
 uniform mat4 model;
 
 void main() {
     frag_normal = mat3(transpose(inverse(model))) * normal;
     frag_pos = vec3(model * vec4(pos, 1.0));
     gl_Position = projection * view * model * vec4(pos, 1.0);
+    curr_clip_pos = view_projection * vec4(frag_pos, 1.0);
+    prev_clip_pos = prev_view_projection * vec4(frag_pos, 1.0);
 }
\ No newline at end of file
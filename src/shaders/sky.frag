@@ -1,13 +1,12 @@
 #version 420 core
 in vec3 frag_tex_coords;
+in vec4 curr_clip_pos;
+in vec4 prev_clip_pos;
 
-out vec4 frag_color;
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec2 velocity; // uv offset from the previous frame
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+#include "common/vp.glsl"
 
 uniform bool is_day;
 
@@ -19,4 +18,5 @@ void main() {
     if (!is_day) {
         frag_color.rgb = pow(frag_color.rgb, vec3(1.6));
     }
+    velocity = 0.5 * (curr_clip_pos.xy / curr_clip_pos.w - prev_clip_pos.xy / prev_clip_pos.w);
 }
\ No newline at end of file
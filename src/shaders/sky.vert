@@ -3,15 +3,21 @@ layout (location = 0) in vec3 pos;
 
 out vec3 frag_tex_coords;
 
-layout (std140, binding = 0) uniform vp {
-    mat4 view;
-    mat4 projection;
-    float user_ev;
-};
+// unjittered clip positions for the velocity buffer, see g_pass.vert
+uniform mat4 view_projection;
+uniform mat4 prev_view_projection;
+out vec4 curr_clip_pos;
+out vec4 prev_clip_pos;
+
+#include "common/vp.glsl"
 
 uniform mat4 model;
 
 void main() {
     frag_tex_coords = pos;
     gl_Position = (projection * view * model * vec4(pos, 1.0)).xyww;
+
+    // the sky is infinitely far away, as a direction only the camera's rotation moves it
+    curr_clip_pos = view_projection * vec4(mat3(model) * pos, 0.0);
+    prev_clip_pos = prev_view_projection * vec4(mat3(model) * pos, 0.0);
 }
\ No newline at end of file
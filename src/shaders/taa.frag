@@ -0,0 +1,73 @@
+#version 420 core
+
+in vec2 frag_tex_coords;
+
+out vec4 frag_color;
+
+#include "common/vp.glsl"
+
+uniform sampler2D tex;
+uniform sampler2D history;
+uniform sampler2D velocity;
+
+uniform bool use_history;
+uniform float feedback;
+
+vec3 rgb_to_ycocg(vec3 c) {
+    return vec3(
+         0.25 * c.r + 0.5 * c.g + 0.25 * c.b,
+         0.5  * c.r             - 0.5  * c.b,
+        -0.25 * c.r + 0.5 * c.g - 0.25 * c.b
+    );
+}
+
+vec3 ycocg_to_rgb(vec3 c) {
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+// compress HDR values so a single bright sample doesn't dominate the blend
+vec3 tonemap(vec3 c) {
+    return c / (1.0 + rgb_to_ycocg(c * pow(2.0, user_ev)).x);
+}
+
+vec3 untonemap(vec3 c) {
+    return c / max(1.0 - rgb_to_ycocg(c * pow(2.0, user_ev)).x, 0.00001);
+}
+
+void main() {
+    vec3 current = texture(tex, frag_tex_coords).rgb;
+    if (!use_history) {
+        frag_color = vec4(current, 1.0);
+        return;
+    }
+
+    vec2 texel_size = 1.0 / textureSize(tex, 0);
+
+    // neighbourhood bounds of the current frame, and the longest motion vector around us so edges don't trail
+    vec3 neighbour_min = vec3(1e20);
+    vec3 neighbour_max = vec3(-1e20);
+    vec2 motion = vec2(0.0);
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            vec2 offset = vec2(x, y) * texel_size;
+            vec3 neighbour = rgb_to_ycocg(tonemap(texture(tex, frag_tex_coords + offset).rgb));
+            neighbour_min = min(neighbour_min, neighbour);
+            neighbour_max = max(neighbour_max, neighbour);
+
+            vec2 neighbour_motion = texture(velocity, frag_tex_coords + offset).rg;
+            if (dot(neighbour_motion, neighbour_motion) > dot(motion, motion)) motion = neighbour_motion;
+        }
+    }
+
+    vec2 history_coords = frag_tex_coords - motion;
+    if (any(lessThan(history_coords, vec2(0.0))) || any(greaterThan(history_coords, vec2(1.0)))) {
+        frag_color = vec4(current, 1.0);
+        return;
+    }
+
+    vec3 prev = rgb_to_ycocg(tonemap(texture(history, history_coords).rgb));
+    prev = clamp(prev, neighbour_min, neighbour_max);
+
+    vec3 result = mix(tonemap(current), ycocg_to_rgb(prev), feedback);
+    frag_color = vec4(untonemap(result), 1.0);
+}
@@ -0,0 +1,264 @@
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh_opt.h"
+#include "vertex.h"
+
+// generated shapes as CPU side triangle lists without any GL calls, geometry.h turns them into meshes
+
+enum class shape {
+    uv_sphere,  // radius 1
+    ico_sphere, // radius 1, spherical uvs with the seam along -x
+    cube,       // [-1, 1]^3
+    plane,      // [-1, 1]^2 in the xz plane facing +y, like res/models/quad.obj
+    torus       // major radius 1, minor radius 0.25, around the y axis
+};
+
+// triangle list of a generated shape, sized up front by each generator and filled in place
+struct geometry_data {
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+
+    geometry_data(size_t vertex_count, size_t index_count) : vertices(vertex_count), indices(index_count) { }
+};
+
+// (u_steps + 1) x (v_steps + 1) vertices from func(u, v) with u, v in [0, 1], func's du x dv has to point out of the surface
+// for counter clockwise triangles, returns the next free vertex and index
+template<typename Func>
+std::pair<size_t, size_t> write_grid(geometry_data& data, size_t first_vertex, size_t first_index, size_t u_steps, size_t v_steps, Func const& func) {
+    for (size_t j = 0; j <= v_steps; ++j) {
+        for (size_t i = 0; i <= u_steps; ++i) {
+            data.vertices[first_vertex + j * (u_steps + 1) + i] = func(static_cast<float>(i) / u_steps, static_cast<float>(j) / v_steps);
+        }
+    }
+
+    GLuint * out = data.indices.data() + first_index;
+    for (size_t j = 0; j < v_steps; ++j) {
+        for (size_t i = 0; i < u_steps; ++i) {
+            GLuint a = first_vertex + j * (u_steps + 1) + i;
+            GLuint b = a + 1;
+            GLuint c = a + u_steps + 1;
+            GLuint d = c + 1;
+            *out++ = a; *out++ = b; *out++ = c;
+            *out++ = b; *out++ = d; *out++ = c;
+        }
+    }
+
+    return {first_vertex + (u_steps + 1) * (v_steps + 1), first_index + u_steps * v_steps * 6};
+}
+
+inline size_t grid_vertex_count(size_t u_steps, size_t v_steps) {
+    return (u_steps + 1) * (v_steps + 1);
+}
+
+inline size_t grid_index_count(size_t u_steps, size_t v_steps) {
+    return u_steps * v_steps * 6;
+}
+
+// the seam column is duplicated so uvs wrap, the pole rows hold degenerate triangles
+inline geometry_data make_uv_sphere(size_t segments, size_t rings) {
+    static constexpr float PI = 3.14159265359f;
+
+    geometry_data data{grid_vertex_count(segments, rings), grid_index_count(segments, rings)};
+    write_grid(data, 0, 0, segments, rings, [](float u, float v) {
+        float phi = u * 2.0f * PI;
+        float theta = v * PI;
+        glm::vec3 n{std::cos(phi) * std::sin(theta), std::cos(theta), std::sin(phi) * std::sin(theta)};
+        return vertex{
+            n, n, glm::vec2(u, v),
+            glm::vec3(-std::sin(phi), 0.0f, std::cos(phi)),
+            glm::vec3(std::cos(phi) * std::cos(theta), -std::sin(theta), std::sin(phi) * std::cos(theta))
+        };
+    });
+    return data;
+}
+
+// icosahedron with every face split into 4^subdivisions triangles, midpoints are pushed onto the sphere at every level
+// so the triangles stay even, triangles across the u seam get copies of their low u vertices with u + 1 and the pole
+// vertices a copy per triangle with its u, like the seam column and pole rows of make_uv_sphere(), without subdivisions
+// the poles lie on two edges and the four triangles there still span half the u range
+inline geometry_data make_ico_sphere(size_t subdivisions) {
+    static constexpr float PI = 3.14159265359f;
+    static constexpr float T = 1.61803398875f;
+
+    std::vector<glm::vec3> positions{
+        {-1, T, 0}, {1, T, 0}, {-1, -T, 0}, {1, -T, 0},
+        {0, -1, T}, {0, 1, T}, {0, -1, -T}, {0, 1, -T},
+        {T, 0, -1}, {T, 0, 1}, {-T, 0, -1}, {-T, 0, 1}
+    };
+    for (auto& p : positions) p = glm::normalize(p);
+    std::vector<GLuint> faces{
+        0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+        1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+        3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+        4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+    };
+
+    // edge midpoints are shared by both triangles of the edge
+    std::unordered_map<uint64_t, GLuint> midpoints;
+    auto midpoint = [&](GLuint a, GLuint b) {
+        uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+        auto found = midpoints.find(key);
+        if (found != midpoints.end()) return found->second;
+
+        positions.push_back(glm::normalize(positions[a] + positions[b]));
+        GLuint idx = positions.size() - 1;
+        midpoints.emplace(key, idx);
+        return idx;
+    };
+
+    for (size_t level = 0; level < subdivisions; ++level) {
+        std::vector<GLuint> split;
+        split.reserve(faces.size() * 4);
+        for (size_t f = 0; f < faces.size(); f += 3) {
+            GLuint a = faces[f], b = faces[f + 1], c = faces[f + 2];
+            GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            split.insert(split.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        faces = std::move(split);
+        midpoints.clear();
+    }
+
+    // the tangent points along increasing u
+    auto make_vertex = [](glm::vec3 n, float u) {
+        float phi = (u - 0.5f) * 2.0f * PI;
+        glm::vec3 tangent{-std::sin(phi), 0.0f, std::cos(phi)};
+        return vertex{n, n, glm::vec2(u, std::acos(glm::clamp(n.y, -1.0f, 1.0f)) / PI), tangent, glm::cross(n, tangent)};
+    };
+    std::vector<vertex> vertices;
+    vertices.reserve(positions.size());
+    for (glm::vec3 n : positions) vertices.push_back(make_vertex(n, std::atan2(n.z, n.x) / (2.0f * PI) + 0.5f));
+
+    auto at_pole = [&vertices](GLuint v) { return glm::length(glm::vec2(vertices[v].pos.x, vertices[v].pos.z)) < 1e-6f; };
+    std::unordered_map<GLuint, GLuint> wrapped; // seam copies of vertices
+    std::vector<bool> pole_used(positions.size(), false);
+    for (size_t f = 0; f < faces.size(); f += 3) {
+        GLuint * tri = faces.data() + f;
+        float lo{1.0f}, hi{0.0f};
+        for (size_t k = 0; k < 3; ++k) {
+            if (at_pole(tri[k])) continue;
+            lo = std::min(lo, vertices[tri[k]].tex_coords.x);
+            hi = std::max(hi, vertices[tri[k]].tex_coords.x);
+        }
+        if (hi - lo > 0.5f) {
+            for (size_t k = 0; k < 3; ++k) {
+                if (at_pole(tri[k]) || vertices[tri[k]].tex_coords.x >= 0.5f) continue;
+                auto found = wrapped.find(tri[k]);
+                if (found == wrapped.end()) {
+                    vertices.push_back(make_vertex(positions[tri[k]], vertices[tri[k]].tex_coords.x + 1.0f));
+                    found = wrapped.emplace(tri[k], static_cast<GLuint>(vertices.size() - 1)).first;
+                }
+                tri[k] = found->second;
+            }
+        }
+
+        // the first triangle at a pole keeps its vertex
+        for (size_t k = 0; k < 3; ++k) {
+            if (!at_pole(tri[k])) continue;
+            float u = 0.5f * (vertices[tri[(k + 1) % 3]].tex_coords.x + vertices[tri[(k + 2) % 3]].tex_coords.x);
+            vertex pole = make_vertex(positions[tri[k]], u);
+            if (!pole_used[tri[k]]) {
+                pole_used[tri[k]] = true;
+                vertices[tri[k]] = pole;
+            } else {
+                vertices.push_back(pole);
+                tri[k] = static_cast<GLuint>(vertices.size() - 1);
+            }
+        }
+    }
+
+    geometry_data data{vertices.size(), faces.size()};
+    std::copy(vertices.begin(), vertices.end(), data.vertices.begin());
+    std::copy(faces.begin(), faces.end(), data.indices.begin());
+    return data;
+}
+
+// every face is a subdivisions x subdivisions grid with its own vertices so normals stay flat
+inline geometry_data make_cube(size_t subdivisions) {
+    struct face {
+        glm::vec3 normal;
+        glm::vec3 tangent; // tangent x bitangent == normal
+        glm::vec3 bitangent;
+    };
+    static const face faces[6]{
+        {{ 1, 0, 0}, { 0, 0, -1}, {0, 1,  0}},
+        {{-1, 0, 0}, { 0, 0,  1}, {0, 1,  0}},
+        {{ 0, 1, 0}, { 1, 0,  0}, {0, 0, -1}},
+        {{ 0, -1, 0}, { 1, 0,  0}, {0, 0,  1}},
+        {{ 0, 0, 1}, { 1, 0,  0}, {0, 1,  0}},
+        {{ 0, 0, -1}, {-1, 0,  0}, {0, 1,  0}}
+    };
+
+    geometry_data data{6 * grid_vertex_count(subdivisions, subdivisions), 6 * grid_index_count(subdivisions, subdivisions)};
+    std::pair<size_t, size_t> next{0, 0};
+    for (auto const& f : faces) {
+        next = write_grid(data, next.first, next.second, subdivisions, subdivisions, [&f](float u, float v) {
+            glm::vec3 pos = f.normal + (2.0f * u - 1.0f) * f.tangent + (2.0f * v - 1.0f) * f.bitangent;
+            return vertex{pos, f.normal, glm::vec2(u, v), f.tangent, f.bitangent};
+        });
+    }
+    return data;
+}
+
+inline geometry_data make_plane(size_t subdivisions) {
+    geometry_data data{grid_vertex_count(subdivisions, subdivisions), grid_index_count(subdivisions, subdivisions)};
+    // v runs towards -z so du x dv faces +y, the uvs match quad.obj loaded with flipped v
+    write_grid(data, 0, 0, subdivisions, subdivisions, [](float u, float v) {
+        return vertex{
+            glm::vec3(2.0f * u - 1.0f, 0.0f, 1.0f - 2.0f * v), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec2(u, 1.0f - v),
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)
+        };
+    });
+    return data;
+}
+
+inline geometry_data make_torus(float major_radius, float minor_radius, size_t segments, size_t sides) {
+    static constexpr float PI = 3.14159265359f;
+
+    geometry_data data{grid_vertex_count(segments, sides), grid_index_count(segments, sides)};
+    write_grid(data, 0, 0, segments, sides, [=](float u, float v) {
+        float phi = u * 2.0f * PI;
+        float theta = v * 2.0f * PI;
+        glm::vec3 ring_dir{std::cos(phi), 0.0f, std::sin(phi)};
+        // theta runs downwards on the outside so du x dv points out of the tube
+        glm::vec3 n = std::cos(theta) * ring_dir - std::sin(theta) * glm::vec3(0.0f, 1.0f, 0.0f);
+        return vertex{
+            major_radius * ring_dir + minor_radius * n, n, glm::vec2(u, v),
+            glm::vec3(-std::sin(phi), 0.0f, std::cos(phi)),
+            -std::sin(theta) * ring_dir - std::cos(theta) * glm::vec3(0.0f, 1.0f, 0.0f)
+        };
+    });
+    return data;
+}
+
+// every LOD level halves the tessellation along each direction, about a quarter of the triangles
+inline size_t lod_steps(size_t base, size_t lod, size_t min_steps) {
+    return std::max(base >> std::min<size_t>(lod, 31), min_steps);
+}
+
+// LOD 0 of the uv sphere matches the 64 x 64 sphere pbr.cpp used to build by hand
+inline geometry_data generate_shape(shape s, size_t lod) {
+    geometry_data data = [&]() {
+        switch (s) {
+            case shape::uv_sphere: return make_uv_sphere(lod_steps(64, lod, 8), lod_steps(64, lod, 4));
+            case shape::ico_sphere: return make_ico_sphere(lod < 4 ? 4 - lod : 0);
+            case shape::cube: return make_cube(lod_steps(4, lod, 1));
+            case shape::plane: return make_plane(lod_steps(16, lod, 1));
+            default: return make_torus(1.0f, 0.25f, lod_steps(64, lod, 8), lod_steps(32, lod, 4));
+        }
+    }();
+    optimize_mesh(data.vertices, data.indices);
+    return data;
+}
+
+#endif
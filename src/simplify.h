@@ -0,0 +1,271 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh_opt.h"
+
+// symmetric 4x4 quadric of Garland and Heckbert's "Surface Simplification Using Quadric Error Metrics", a weighted sum of
+// squared distances to planes, divided by the summed weights eval() is a mean squared distance in object space units
+struct quadric {
+    double a2{0}, ab{0}, ac{0}, ad{0}, b2{0}, bc{0}, bd{0}, c2{0}, cd{0}, d2{0};
+    double weight{0};
+
+    // plane n . x + d = 0 with unit n
+    static quadric plane(glm::vec3 n, float d, double weight) {
+        quadric q;
+        q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z; q.ad = weight * n.x * d;
+        q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+        q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+        q.d2 = weight * d * d;
+        q.weight = weight;
+        return q;
+    }
+
+    quadric& operator+=(quadric const& o) {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+        b2 += o.b2; bc += o.bc; bd += o.bd;
+        c2 += o.c2; cd += o.cd;
+        d2 += o.d2;
+        weight += o.weight;
+        return *this;
+    }
+
+    double eval(glm::vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double res = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                   + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                   + c2 * z * z + 2 * cd * z
+                   + d2;
+        return weight > 0 ? std::max(res, 0.0) / weight : 0.0;
+    }
+};
+
+struct lod_level {
+    std::vector<GLuint> indices;
+    float error; // deviation from the full detail mesh, in object space units
+};
+
+// vertices sharing a position get the same id, these are uv or normal seams when the vertices differ otherwise
+template<typename Vertex>
+std::vector<GLuint> weld_positions(std::vector<Vertex> const& vertices) {
+    struct pos_hash {
+        size_t operator()(glm::vec3 const& p) const {
+            uint32_t bits[3];
+            std::memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    std::unordered_map<glm::vec3, GLuint, pos_hash> first_at;
+    first_at.reserve(vertices.size());
+    std::vector<GLuint> res(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        res[v] = first_at.emplace(vertices[v].pos, static_cast<GLuint>(v)).first->second;
+    }
+    return res;
+}
+
+// half edge collapses in passes of independent collapses, cheapest first, until at most target_index_count indices remain
+// or the next collapse would cost more than max_error, vertices only ever collapse onto neighbours so the result indexes
+// the same vertex buffer, returns the largest error of an applied collapse
+// to keep attributes intact vertices on seams never move, border vertices only slide along the border, and the cost adds
+// normal_weight * (1 - cos) of the normals times the squared edge length to the positional error
+template<typename Vertex>
+float simplify(std::vector<GLuint>& indices, std::vector<Vertex> const& vertices, size_t target_index_count,
+               float max_error = FLT_MAX, float normal_weight = 1.0f) {
+    size_t vertex_count = vertices.size();
+    std::vector<GLuint> pos_id = weld_positions(vertices);
+    std::vector<bool> seam(vertex_count, false);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        if (pos_id[v] != v) seam[v] = seam[pos_id[v]] = true;
+    }
+
+    // triangles around position p are vertex_tris[offsets[p], offsets[p + 1]), rebuilt every pass
+    std::vector<uint32_t> offsets(vertex_count + 1), vertex_tris, fill;
+    auto build_adjacency = [&]() {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (GLuint idx : indices) ++offsets[pos_id[idx] + 1];
+        for (size_t p = 0; p < vertex_count; ++p) offsets[p + 1] += offsets[p];
+        vertex_tris.resize(indices.size());
+        fill.assign(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) vertex_tris[fill[pos_id[indices[i]]]++] = i / 3;
+    };
+
+    // triangles sharing the welded edge, 1 is a border and more than 2 is non-manifold
+    auto edge_uses = [&](GLuint a, GLuint b) {
+        GLuint pa = pos_id[a], pb = pos_id[b];
+        uint32_t uses{0};
+        for (uint32_t k = offsets[pa]; k < offsets[pa + 1]; ++k) {
+            GLuint const * tri = &indices[3 * vertex_tris[k]];
+            uses += pos_id[tri[0]] == pb || pos_id[tri[1]] == pb || pos_id[tri[2]] == pb;
+        }
+        return uses;
+    };
+
+    // area weighted triangle planes, and planes perpendicular to border edges so borders keep their outline
+    build_adjacency();
+    std::vector<quadric> quadrics(vertex_count);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        glm::vec3 p[3] = {vertices[indices[i]].pos, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos};
+        glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float area = 0.5f * glm::length(n);
+        if (area <= 0.0f) continue;
+        n = glm::normalize(n);
+
+        quadric q = quadric::plane(n, -glm::dot(n, p[0]), area);
+        for (size_t k = 0; k < 3; ++k) quadrics[pos_id[indices[i + k]]] += q;
+
+        for (size_t k = 0; k < 3; ++k) {
+            GLuint a = indices[i + k], b = indices[i + (k + 1) % 3];
+            if (edge_uses(a, b) != 1) continue;
+            glm::vec3 edge = p[(k + 1) % 3] - p[k];
+            float length2 = glm::dot(edge, edge);
+            if (length2 <= 0.0f) continue;
+            glm::vec3 border_n = glm::normalize(glm::cross(edge, n));
+            quadric border = quadric::plane(border_n, -glm::dot(border_n, p[k]), 10.0 * length2);
+            quadrics[pos_id[a]] += border;
+            quadrics[pos_id[b]] += border;
+        }
+    }
+
+    struct collapse {
+        GLuint from;
+        GLuint to;
+        float cost;
+    };
+
+    float result_error{0.0f};
+    std::vector<bool> border(vertex_count), locked(vertex_count), touched(vertex_count);
+    std::vector<GLuint> remap(vertex_count);
+    std::vector<collapse> collapses;
+
+    while (indices.size() > target_index_count) {
+        build_adjacency();
+
+        // only vertices off seams can move, and for those the position's triangles are the vertex's own
+        for (size_t u = 0; u < vertex_count; ++u) {
+            border[u] = locked[u] = false;
+            if (seam[u]) continue;
+            for (uint32_t k = offsets[u]; k < offsets[u + 1]; ++k) {
+                GLuint const * tri = &indices[3 * vertex_tris[k]];
+                for (size_t j = 0; j < 3; ++j) {
+                    if (tri[j] == u) continue;
+                    uint32_t uses = edge_uses(u, tri[j]);
+                    border[u] = border[u] || uses == 1;
+                    locked[u] = locked[u] || uses > 2;
+                }
+            }
+        }
+
+        // the cheapest allowed collapse of every vertex
+        collapses.clear();
+        for (size_t u = 0; u < vertex_count; ++u) {
+            if (seam[u] || locked[u] || offsets[u] == offsets[u + 1]) continue;
+
+            collapse best{static_cast<GLuint>(u), 0, FLT_MAX};
+            for (uint32_t k = offsets[u]; k < offsets[u + 1]; ++k) {
+                GLuint const * tri = &indices[3 * vertex_tris[k]];
+                for (size_t j = 0; j < 3; ++j) {
+                    GLuint v = tri[j];
+                    if (v == u) continue;
+                    if (border[u] && edge_uses(u, v) != 1) continue;
+
+                    quadric q = quadrics[pos_id[u]];
+                    q += quadrics[pos_id[v]];
+                    glm::vec3 edge = vertices[v].pos - vertices[u].pos;
+                    float normal_cost = normal_weight * glm::dot(edge, edge) * (1.0f - glm::dot(vertices[u].normal, vertices[v].normal));
+                    float cost = static_cast<float>(q.eval(vertices[v].pos)) + std::max(normal_cost, 0.0f);
+                    if (cost < best.cost) {
+                        best.to = v;
+                        best.cost = cost;
+                    }
+                }
+            }
+            if (best.cost < FLT_MAX) collapses.push_back(best);
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](collapse const& a, collapse const& b) { return a.cost < b.cost; });
+
+        // collapses in one pass must not share triangles, so their costs and flip tests stay valid, only the cheapest
+        // third is tried so blocked cheap collapses get another go next pass before expensive ones are applied
+        collapses.resize((collapses.size() + 2) / 3);
+        std::fill(touched.begin(), touched.end(), false);
+        for (size_t v = 0; v < vertex_count; ++v) remap[v] = v;
+        size_t tri_count = indices.size() / 3;
+        size_t target_tri_count = target_index_count / 3;
+        float max_cost = max_error * max_error;
+        size_t applied{0};
+        for (auto const& c : collapses) {
+            if (tri_count <= target_tri_count || c.cost > max_cost) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            size_t removed{0};
+            bool flips{false};
+            for (uint32_t k = offsets[c.from]; k < offsets[c.from + 1] && !flips; ++k) {
+                GLuint const * tri = &indices[3 * vertex_tris[k]];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    ++removed;
+                    continue;
+                }
+
+                glm::vec3 p[3], moved[3];
+                for (size_t j = 0; j < 3; ++j) {
+                    p[j] = vertices[tri[j]].pos;
+                    moved[j] = tri[j] == c.from ? vertices[c.to].pos : p[j];
+                }
+                glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 n1 = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(n0, n1) <= 0.0f;
+            }
+            if (flips) continue;
+
+            remap[c.from] = c.to;
+            quadrics[pos_id[c.to]] += quadrics[pos_id[c.from]];
+            for (uint32_t k = offsets[c.from]; k < offsets[c.from + 1]; ++k) {
+                GLuint const * tri = &indices[3 * vertex_tris[k]];
+                for (size_t j = 0; j < 3; ++j) touched[tri[j]] = true;
+            }
+            tri_count -= removed;
+            result_error = std::max(result_error, std::sqrt(c.cost));
+            ++applied;
+        }
+        if (applied == 0) break;
+
+        for (GLuint& idx : indices) idx = remap[idx];
+        remove_degenerate_triangles(indices);
+    }
+
+    return result_error;
+}
+
+// successive simplifications to ratio of the previous level's triangles, stops early once a level barely shrinks,
+// the errors add up since each level only measures against the one before, every level is reordered for the vertex cache
+template<typename Vertex>
+std::vector<lod_level> build_lod_chain(std::vector<Vertex> const& vertices, std::vector<GLuint> const& indices,
+                                       size_t max_levels = 4, float ratio = 0.5f, float max_error = FLT_MAX) {
+    std::vector<lod_level> res;
+    std::vector<GLuint> current = indices;
+    float error{0.0f};
+    for (size_t level = 0; level < max_levels; ++level) {
+        size_t prev_size = current.size();
+        size_t target = static_cast<size_t>(prev_size / 3 * ratio) * 3;
+        error += simplify(current, vertices, target, max_error);
+        if (current.size() == 0 || current.size() > prev_size * 9 / 10) break;
+
+        optimize_vertex_cache_tipsify(current, vertices.size());
+        res.push_back({current, error});
+    }
+    return res;
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <iostream>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -133,10 +134,31 @@ struct texture {
     }
 };
 
+// decoded rgb float pixels of an hdr image, bottom row first
+struct hdr_image {
+    int width{0};
+    int height{0};
+    std::vector<float> data;
+
+    hdr_image(std::string const& path) {
+        int channel_count;
+        stbi_set_flip_vertically_on_load(true);
+        float * img_data = stbi_loadf(path.c_str(), &width, &height, &channel_count, 3);
+        stbi_set_flip_vertically_on_load(false);
+        if (!img_data) {
+            std::cerr << "ERROR loading " << path << std::endl;
+            return;
+        }
+
+        data.assign(img_data, img_data + static_cast<size_t>(width) * height * 3);
+        stbi_image_free(img_data);
+    }
+};
+
 struct hdr {
     GLuint id;
 
-    hdr(std::string const& path) {
+    hdr(hdr_image const& image) {
         glActiveTexture(GL_TEXTURE0);
         glGenTextures(1, &id);
         glBindTexture(GL_TEXTURE_2D, id);
@@ -146,18 +168,11 @@ struct hdr {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        int width, height, channel_count;
-        stbi_set_flip_vertically_on_load(true);
-        float * img_data = stbi_loadf(path.c_str(), &width, &height, &channel_count, 0);
-        if (!img_data) {
-            std::cerr << "ERROR loading " << path << std::endl;
-        }
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, img_data);
-        stbi_image_free(img_data);
-        stbi_set_flip_vertically_on_load(false);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, image.width, image.height, 0, GL_RGB, GL_FLOAT, image.data.empty() ? nullptr : image.data.data());
     }
 
+    hdr(std::string const& path) : hdr(hdr_image{path}) { }
+
     hdr(hdr && other) {
         id = other.id;
         other.id = 0;
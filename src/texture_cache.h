@@ -0,0 +1,175 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "util.h"
+
+// an allocated texture level that is persisted by texture_cache, format and type describe the cached pixel data
+struct texture_slot {
+    GLuint tex;
+    GLenum target; // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP_ARRAY or one of the cube map faces
+    GLint level;
+    GLenum format;
+    GLenum type;
+
+    GLenum bind_target() const {
+        return target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP_ARRAY ? target : GL_TEXTURE_CUBE_MAP;
+    }
+
+    // layered targets hold all of their layer-faces in one level
+    bool is_layered() const {
+        return target == GL_TEXTURE_CUBE_MAP_ARRAY;
+    }
+
+    size_t pixel_size() const {
+        if (type == GL_UNSIGNED_INT_5_9_9_9_REV || type == GL_UNSIGNED_INT_10F_11F_11F_REV) return 4;
+
+        size_t component_count = format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4;
+        size_t component_size = type == GL_HALF_FLOAT ? 2 : type == GL_FLOAT ? 4 : 1;
+        return component_count * component_size;
+    }
+};
+
+// binary file holding a list of texture levels and loose float values, invalidated whenever the key or the contents
+// of one of the files change, the files are large inputs like source images that are only read in full when their
+// path, size or modification time differ from the ones the cache was saved with
+struct texture_cache {
+    static constexpr uint32_t magic = 0x43584554; // "TEXC"
+    static constexpr uint32_t version = 4;
+    static constexpr std::streamoff stamp_offset = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    std::string path;
+    size_t key;
+    std::vector<std::string> files{};
+
+    size_t files_stamp() const {
+        size_t res{0};
+        for (auto const& file : files) hash_combine(res, hash_file_stamp(file));
+        return res;
+    }
+
+    size_t files_content() const {
+        size_t res{0};
+        for (auto const& file : files) hash_combine(res, hash_file(file));
+        return res;
+    }
+
+    bool load(std::vector<texture_slot> const& slots, std::vector<float>& values) const {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) return false;
+
+        uint32_t file_magic, file_version, slot_count, value_count;
+        uint64_t file_key, file_stamp, file_content;
+        ifs.read(reinterpret_cast<char *>(&file_magic), sizeof(file_magic));
+        ifs.read(reinterpret_cast<char *>(&file_version), sizeof(file_version));
+        ifs.read(reinterpret_cast<char *>(&file_key), sizeof(file_key));
+        ifs.read(reinterpret_cast<char *>(&file_stamp), sizeof(file_stamp));
+        ifs.read(reinterpret_cast<char *>(&file_content), sizeof(file_content));
+        ifs.read(reinterpret_cast<char *>(&slot_count), sizeof(slot_count));
+        ifs.read(reinterpret_cast<char *>(&value_count), sizeof(value_count));
+        bool stale = !ifs || file_magic != magic || file_version != version || file_key != key || slot_count != slots.size() || value_count != values.size();
+
+        // files that were touched but still hold the same contents keep the cache, which then remembers their new stamp
+        size_t stamp = files_stamp();
+        bool restamp = !stale && file_stamp != stamp;
+        if (restamp) stale = file_content != files_content();
+        if (stale) {
+            std::cout << "texture cache " << path << " is stale, regenerating" << std::endl;
+            return false;
+        }
+
+        ifs.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(float));
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<char> data;
+        for (auto& slot : slots) {
+            GLint width, height, depth, level_width, level_height, level_depth;
+            ifs.read(reinterpret_cast<char *>(&width), sizeof(width));
+            ifs.read(reinterpret_cast<char *>(&height), sizeof(height));
+            ifs.read(reinterpret_cast<char *>(&depth), sizeof(depth));
+            data.resize(static_cast<size_t>(width) * height * depth * slot.pixel_size());
+            ifs.read(data.data(), data.size());
+
+            // the textures may have immutable storage, so only their contents are replaced
+            glBindTexture(slot.bind_target(), slot.tex);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_WIDTH, &level_width);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_HEIGHT, &level_height);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_DEPTH, &level_depth);
+            if (!ifs || width != level_width || height != level_height || depth != level_depth) {
+                std::cerr << "ERROR reading texture cache " << path << std::endl;
+                glBindTexture(slot.bind_target(), 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                return false;
+            }
+
+            if (slot.is_layered()) {
+                glTexSubImage3D(slot.target, slot.level, 0, 0, 0, width, height, depth, slot.format, slot.type, data.data());
+            } else {
+                glTexSubImage2D(slot.target, slot.level, 0, 0, width, height, slot.format, slot.type, data.data());
+            }
+            glBindTexture(slot.bind_target(), 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        if (restamp) {
+            ifs.close();
+            std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+            uint64_t new_stamp = stamp;
+            fs.seekp(stamp_offset);
+            fs.write(reinterpret_cast<char const *>(&new_stamp), sizeof(new_stamp));
+        }
+        return true;
+    }
+
+    void save(std::vector<texture_slot> const& slots, std::vector<float> const& values) const {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs) {
+            std::cerr << "ERROR writing texture cache " << path << std::endl;
+            return;
+        }
+
+        uint32_t slot_count = slots.size();
+        uint32_t value_count = values.size();
+        uint64_t file_key = key;
+        uint64_t file_stamp = files_stamp();
+        uint64_t file_content = files_content();
+        ofs.write(reinterpret_cast<char const *>(&magic), sizeof(magic));
+        ofs.write(reinterpret_cast<char const *>(&version), sizeof(version));
+        ofs.write(reinterpret_cast<char const *>(&file_key), sizeof(file_key));
+        ofs.write(reinterpret_cast<char const *>(&file_stamp), sizeof(file_stamp));
+        ofs.write(reinterpret_cast<char const *>(&file_content), sizeof(file_content));
+        ofs.write(reinterpret_cast<char const *>(&slot_count), sizeof(slot_count));
+        ofs.write(reinterpret_cast<char const *>(&value_count), sizeof(value_count));
+        ofs.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(float));
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        std::vector<char> data;
+        for (auto& slot : slots) {
+            GLint width, height, depth;
+            glBindTexture(slot.bind_target(), slot.tex);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(slot.target, slot.level, GL_TEXTURE_DEPTH, &depth);
+            data.resize(static_cast<size_t>(width) * height * depth * slot.pixel_size());
+            glGetTexImage(slot.target, slot.level, slot.format, slot.type, data.data());
+            glBindTexture(slot.bind_target(), 0);
+
+            ofs.write(reinterpret_cast<char const *>(&width), sizeof(width));
+            ofs.write(reinterpret_cast<char const *>(&height), sizeof(height));
+            ofs.write(reinterpret_cast<char const *>(&depth), sizeof(depth));
+            ofs.write(data.data(), data.size());
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+};
+
+#endif
@@ -1,12 +1,22 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
 
 // load a file into a single string
 template<typename PathType>
@@ -16,6 +26,14 @@ std::string load_string(PathType path) {
     return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
 }
 
+// hash the raw contents of a file, for keying caches derived from it
+template<typename PathType>
+size_t hash_file(PathType path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) std::cerr << "ERROR opening " << path << std::endl;
+    return std::hash<std::string>()(std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()));
+}
+
 // stream output operator for glm::vec3
 std::ostream& operator<<(std::ostream& os, glm::vec3 v) {
     os << "(" << v.x << ", " << v.y << ", " << v.z << ")";
@@ -48,6 +66,102 @@ namespace std {
     };
 }
 
+// hash a file's path, size and modification time without reading it, for cheaply checking large cache inputs
+template<typename PathType>
+size_t hash_file_stamp(PathType path) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error) std::cerr << "ERROR reading the size and modification time of " << path << std::endl;
+    return hash_values(std::filesystem::path(path).string(), size, static_cast<int64_t>(time.time_since_epoch().count()));
+}
+
+// calls func(i) for every i in [0, count) on all hardware threads, items are handed out one at a time since their cost varies
+template<typename Func>
+void parallel_for(size_t count, Func const& func) {
+    if (count == 0) return;
+
+    size_t thread_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, count);
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&next, &func, count]() {
+            for (size_t i = next++; i < count; i = next++) func(i);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+// parallel_for() on threads that are started once and kept waiting between calls, for work that runs every frame
+// where spawning threads would cost more than the work, the calling thread takes items too
+struct thread_pool {
+    explicit thread_pool(size_t thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1)) {
+        for (size_t t = 1; t < thread_count; ++t) threads.emplace_back([this]() { work_loop(); });
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    // calls func(i) for every i in [0, count) and returns when all calls are done
+    template<typename Func>
+    void parallel_for(size_t count, Func const& func) {
+        if (count == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &func;
+            call = [](void const * f, size_t i) { (*static_cast<Func const *>(f))(i); };
+            job_count = count;
+            next = 0;
+            running = threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        run_items();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return running == 0; });
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    void const * job{nullptr};
+    void (*call)(void const *, size_t){nullptr};
+    size_t job_count{0};
+    std::atomic<size_t> next{0};
+    size_t running{0}; // workers that haven't finished the current job
+    size_t generation{0};
+    bool stopping{false};
+
+    void run_items() {
+        for (size_t i = next++; i < job_count; i = next++) call(job, i);
+    }
+
+    void work_loop() {
+        size_t seen{0};
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            lock.unlock();
+            run_items();
+            lock.lock();
+            if (--running == 0) done.notify_one();
+        }
+    }
+};
+
 // shared cache
 template<typename ResType, typename... ParamTypes>
 struct shared_cache {